@@ -0,0 +1,87 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+
+#include <stdint.h>
+
+/**
+ * @file chunk_pool.h
+ *
+ * @brief Reference counted, pool allocated, chunk payloads.
+ *
+ * Chunk payloads (and the buffers messages are received into) can be
+ * allocated from a pool of size-classed slabs instead of using malloc()
+ * for every chunk. Each pool block carries a reference counter, so that
+ * the same block can be shared (without copying it) by the chunk buffer,
+ * the output module and the code sending the chunk to other peers: every
+ * user takes a reference with chunk_payload_ref() and drops it with
+ * chunk_payload_release().
+ *
+ * Pointers to any byte inside a pool block are accepted by
+ * chunk_payload_ref() and chunk_payload_release(), so a chunk can point
+ * inside a larger block (see decodeChunkAdopt()). Memory which does not
+ * come from the pool is released with free(), hence chunk_payload_release()
+ * can always be used in place of free() for chunk data and attributes.
+ *
+ * Allocations, references and releases can be performed by different
+ * threads at the same time (the pool is protected by a lock), but
+ * chunk_pool_init() and chunk_pool_destroy() must not run concurrently
+ * with any other pool function.
+ */
+
+/**
+ * @brief Configure the chunk payload pool.
+ *
+ * Configure the pool; this must be done once, before any allocation.
+ * If the pool is not initialised, chunk_payload_alloc() simply falls
+ * back to malloc().
+ * @param config a configuration string, containing "min_size=<n>" (size of
+ *        the smallest block, default 1024), "max_size=<n>" (size of the
+ *        largest block, default 65536; larger allocations use malloc())
+ *        and "slab_blocks=<n>" (number of blocks allocated at once for
+ *        each size class, default 32). Sizes are rounded up to powers of 2
+ * @return 0 on success, <0 on error
+ */
+int chunk_pool_init(const char *config);
+
+/**
+ * @brief Allocate a chunk payload.
+ *
+ * Allocate a buffer of at least size bytes, holding one reference.
+ * @param size the requested size
+ * @return a pointer to the buffer, or NULL on error
+ */
+uint8_t *chunk_payload_alloc(int size);
+
+/**
+ * @brief Take a reference to a chunk payload.
+ *
+ * @param p a pointer inside a block returned by chunk_payload_alloc()
+ * @return p on success, NULL if p does not belong to the pool (in this
+ *         case, the caller has to make a private copy of the data)
+ */
+void *chunk_payload_ref(void *p);
+
+/**
+ * @brief Drop a reference to a chunk payload.
+ *
+ * When the last reference is dropped, the block is returned to the pool.
+ * If p does not belong to the pool, it is released with free().
+ * @param p a pointer inside a block returned by chunk_payload_alloc(), or
+ *        a malloc()ed pointer, or NULL
+ */
+void chunk_payload_release(void *p);
+
+/**
+ * @brief Release all the memory used by the pool.
+ *
+ * The pool is destroyed only if all its blocks have been released: a block
+ * still in use would otherwise be passed to free() by
+ * chunk_payload_release(), even through a pointer inside it. After it,
+ * chunk_payload_alloc() falls back to malloc() until the pool is
+ * initialised again.
+ * @return 0 on success, -1 if some blocks are still in use (the pool is
+ *         not destroyed, and can still be used)
+ */
+int chunk_pool_destroy(void);
+
+#endif	/* CHUNK_POOL_H */
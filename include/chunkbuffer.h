@@ -42,7 +42,14 @@ typedef struct chunk_buffer ChunkBuffer;
  *
  * @param config a text string containing some configuration parameters for
  *        the buffer, such as the playout delay and maybe some additional
- *        parameters (estimated size of the buffer, etc...)
+ *        parameters (estimated size of the buffer, etc...). The "type" tag
+ *        selects the implementation: "array" (default) keeps the newest
+ *        "size" chunks, while "ring" keeps the chunks whose IDs are within
+ *        "size" of the largest received ID, adding and looking up
+ *        chunks in constant time. The two evict differently: with
+ *        "size=8", after receiving 5, 10, 12 and 40 the array keeps
+ *        all of them, while the ring only keeps 40 (its window is
+ *        33 - 40). The ring does not accept negative IDs.
  * @return a pointer to the allocated chunk buffer in case of success, NULL
  *         otherwise
  */
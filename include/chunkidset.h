@@ -35,7 +35,16 @@ typedef struct chunkID_set ChunkIDSet;
   *                   the chunk ID set. For example, the "size" tag indicates
   *                   the expected number of chunk IDs that will be stored
   *                   in the set; 0 or not present if such a number is not
-  *                   known.
+  *                   known. The "type" tag selects how the set is stored
+  *                   and encoded in signaling messages: "priority" (the
+  *                   default: insertion order is kept, 4 bytes per chunk
+  *                   ID), "bitmap" (a bitmap from the smallest to the
+  *                   largest chunk ID), "ranges" (runs of consecutive chunk
+  *                   IDs), "auto" (the smallest of the previous
+  *                   encodings, chosen for each message) or "bitset"
+  *                   (insertion order is kept, and a window of bits makes
+  *                   adding and checking a chunk ID O(1); encoded as
+  *                   "bitmap").
   * @return the pointer to the new set on success, NULL on error
   */
 struct chunkID_set *chunkID_set_init(const char *config);
@@ -82,8 +91,9 @@ int chunkID_set_get_chunk(const struct chunkID_set *h, int i);
   *
   * @param h a pointer to the set
   * @param chunk_id the chunk ID we are searching for
-  * @return the priority of the chunk ID if it is present in the set,
-  *         < 0 on error or if the chunk ID is not in the set
+  * @return the priority of the chunk ID if it is present in the set (0
+  *         for "bitset" sets, which do not track it), < 0 on error or if
+  *         the chunk ID is not in the set
   */
 int chunkID_set_check(const struct chunkID_set *h, int chunk_id);
 
@@ -101,6 +111,57 @@ int chunkID_set_check(const struct chunkID_set *h, int chunk_id);
   */
 int chunkID_set_union(struct chunkID_set *h, struct chunkID_set *a);
 
+ /**
+  * Intersect a chunk ID set with another one
+  *
+  * Remove from a set all the chunk IDs which are not in another one,
+  * keeping the order of the remaining ones. No memory is allocated: if
+  * both the sets are sorted ("bitmap", "ranges" or "auto" sets) they are
+  * merged in a single pass, if both are "bitset" sets they are combined a
+  * word at a time, otherwise a is searched for each chunk ID of h.
+  *
+  * @param h a pointer to the set to be modified
+  * @param a a pointer to the other set
+  * @return the number of chunk IDs left in h, or < 0 on error
+  */
+int chunkID_set_intersect(struct chunkID_set *h, const struct chunkID_set *a);
+
+ /**
+  * Subtract a chunk ID set from another one
+  *
+  * Remove from a set all the chunk IDs which are in another one (for
+  * example, the chunks a neighbour has but the local peer lacks are
+  * obtained subtracting the local buffer map from the neighbour's one).
+  * Works as chunkID_set_intersect().
+  *
+  * @param h a pointer to the set to be modified
+  * @param a a pointer to the set to be subtracted
+  * @return the number of chunk IDs left in h, or < 0 on error
+  */
+int chunkID_set_difference(struct chunkID_set *h, const struct chunkID_set *a);
+
+ /**
+  * Count the chunk IDs which are in two sets
+  *
+  * As chunkID_set_intersect(), without modifying h.
+  *
+  * @param h a pointer to a set
+  * @param a a pointer to the other set
+  * @return the number of chunk IDs in both h and a, or < 0 on error
+  */
+int chunkID_set_intersect_size(const struct chunkID_set *h, const struct chunkID_set *a);
+
+ /**
+  * Count the chunk IDs of a set which are not in another one
+  *
+  * As chunkID_set_difference(), without modifying h.
+  *
+  * @param h a pointer to a set
+  * @param a a pointer to the set to be subtracted
+  * @return the number of chunk IDs in h but not in a, or < 0 on error
+  */
+int chunkID_set_difference_size(const struct chunkID_set *h, const struct chunkID_set *a);
+
  /**
   * Clear a set
   *
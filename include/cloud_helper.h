@@ -154,6 +154,18 @@ int is_cloud_node(struct cloud_helper_context *context,
  */
 int wait4cloud(struct cloud_helper_context *context, struct timeval *tout);
 
+/**
+ * @brief Give a file descriptor signalling cloud responses.
+ * Return a file descriptor which is readable while some GET operation has
+ * concluded, so that the cloud can be monitored together with the network
+ * (see wait4data() and reactor.h) instead of calling wait4cloud(). After
+ * the descriptor becomes readable, wait4cloud() returns without blocking.
+ * @param[in] context The contex representing the desired cloud_helper
+ *                    instance.
+ * @return The file descriptor, or -1 if the cloud helper does not provide it.
+ */
+int get_cloud_fd(struct cloud_helper_context *context);
+
 
 /**
  * @brief Receive data from the cloud.
@@ -29,6 +29,9 @@
  *
  * This function handles the waiting for data by peers and cloud
  * in a threaded way, hiding the need to manually managing threads.
+ * If the cloud helper provides a completion file descriptor (see
+ * get_cloud_fd()), no thread is created and the network and the cloud
+ * are monitored by a single wait4data().
  *
  * @param[in] n A pointer to the nodeID for which waiting data
  * @param[in] cloud A pointer to the cloud_helper_context for which
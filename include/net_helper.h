@@ -20,6 +20,18 @@
 */
 struct nodeID;
 
+#ifndef _WIN32
+struct iovec;
+#else
+/**
+* Scattered buffer, as in <sys/uio.h> (which Windows does not provide).
+*/
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#endif
+
 /**
 * @brief Duplicate a nodeID.
 *
@@ -48,6 +60,15 @@ int nodeid_equal(const struct nodeID *s1, const struct nodeID *s2);
 */
 int nodeid_cmp(const struct nodeID *s1, const struct nodeID *s2);
 
+/**
+* @brief Compute a hash of a nodeID.
+*
+* Nodes that are identical according to nodeid_equal() have the same hash.
+* @param[in] s The nodeID to be hashed.
+* @return A 32 bit hash of the nodeID.
+*/
+uint32_t nodeid_hash(const struct nodeID *s);
+
 /**
 * @brief Create a new nodeID.
 *
@@ -72,7 +93,34 @@ void nodeid_free(struct nodeID *s);
 * Initialize the parameters for the networking facilities and create a nodeID representing the caller.
 * @param[in] IPaddr The IP in string form to be associated to the caller.
 * @param[in] port The port to be associated to the caller.
-* @param[in] config Additional configuration options.
+* @param[in] config Additional configuration options. For example,
+*                   "nodeid_dump=legacy" makes nodeid_dump() always produce
+*                   the old (larger) serialisation understood by older
+*                   peers, and "nodeid_dump=compact" always the compact one
+*                   (see nodeid_dump() for the default), and
+*                   "nodeid_intern=1" makes all the nodeIDs referring to
+*                   the same address share a single, reference counted,
+*                   instance (so that nodeid_equal() is a pointer comparison).
+*                   Large messages are sent as multiple fragments: with
+*                   "mtu=n" each fragment fits in an IP packet of n bytes
+*                   (with the "don't fragment" bit set; if the path MTU
+*                   towards a peer is smaller, the fragments sent to that
+*                   peer shrink, and grow back after "pmtu_timeout" ms,
+*                   10 minutes by default), otherwise
+*                   fragments are up to 60KB long and the IP layer splits
+*                   them further. Incomplete messages are dropped after
+*                   "reasm_timeout" ms, or if they use more than
+*                   "reasm_memory" bytes. On Linux, "gso=1" sends the
+*                   fragments of a message with few system calls (UDP
+*                   segmentation offload) and "gro=1" lets the kernel
+*                   return many fragments at once; both are disabled (with a
+*                   warning) if the kernel does not support them. With
+*                   "gro=1", use wait4data() rather than polling node_fd()
+*                   directly, since some fragments may already have been
+*                   read from the socket. "send_threads=n" starts n
+*                   threads sending the messages queued by
+*                   send_to_peer_async(), each of them queueing at most
+*                   "send_queue" messages.
 * @return A pointer to a nodeID representing the caller, initialized with all the necessary data.
 */
 struct nodeID *net_helper_init(const char *IPaddr, int port,const char *config);
@@ -92,14 +140,71 @@ void bind_msg_type(uint8_t msgtype);
 * @brief Send data to a remote peer.
 *
 * This function provides a transparently handles the sending routines.
+* The send functions can be invoked by different threads at the same time
+* (the receive functions, instead, must be invoked by one thread at a time).
+* nodeIDs can be created, duplicated and freed by different threads (the
+* interning table of the "nodeid_intern" option of net_helper_init() is
+* locked), but a nodeID must not be freed while another thread uses it.
 * @param[in] from A pointer to the nodeID representing the caller.
 * @param[in] to A pointer to the nodeID representing the remote peer.
 * @param[in] buffer_ptr A pointer to the buffer containing the data to be sent.
 * @param[in] buffer_size The length of the data buffer.
-* @return The number of bytes sent or -1 if some error occurred.
+* @return buffer_size if the whole message has been handed to the network,
+*         or -1 if some error occurred (for a fragmented message, if any of
+*         its fragments could not be sent).
 */
 int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size);
 
+/**
+* @brief Send data to a remote peer without waiting for the socket.
+*
+* The data and the destination address are copied and queued for one of
+* the sender threads (see the "send_threads" option of net_helper_init()),
+* without taking any lock, so the nodeIDs can be freed as soon as this
+* returns; the messages to the same peer are sent in order. If no sender thread
+* has been started, this is the same as send_to_peer().
+* @param[in] from A pointer to the nodeID representing the caller.
+* @param[in] to A pointer to the nodeID representing the remote peer.
+* @param[in] buffer_ptr A pointer to the buffer containing the data to be sent.
+* @param[in] buffer_size The length of the data buffer.
+* @return buffer_size, or -1 if the message could not be queued (for
+*         example, because the queue is full). As for send_to_peer(), a
+*         return value of buffer_size means that the whole message has been
+*         accepted; errors happening later, while the sender thread sends
+*         it, are not reported.
+*/
+int send_to_peer_async(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size);
+
+/**
+* @brief Wait until all the messages queued by send_to_peer_async() have been sent.
+*/
+void send_to_peer_flush(void);
+
+/**
+* @brief Release the resources of the net helper.
+*
+* Send the messages queued by send_to_peer_async(), stop and join the
+* sender threads, and free the internal buffers (including the messages
+* still being reassembled). The local nodeIDs are not closed: free them
+* with nodeid_free(). After this, net_helper_init() can be invoked again.
+*/
+void net_helper_deinit(void);
+
+/**
+* @brief Send data scattered in multiple buffers to a remote peer.
+*
+* Like send_to_peer(), but the message is the concatenation of the buffers
+* described by the iov array, which are sent without being copied in an
+* intermediate buffer.
+* @param[in] from A pointer to the nodeID representing the caller.
+* @param[in] to A pointer to the nodeID representing the remote peer.
+* @param[in] iov An array of buffers containing the data to be sent.
+* @param[in] iovcnt The number of elements in the iov array (at most 8).
+* @return The size of the message, or -1 if some error occurred (as for
+*         send_to_peer()).
+*/
+int send_to_peer_iov(const struct nodeID *from, const struct nodeID *to, const struct iovec *iov, int iovcnt);
+
 /**
 * @brief Receive data from a remote peer.
 *
@@ -112,6 +217,51 @@ int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8
 */
 int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *buffer_ptr, int buffer_size);
 
+/**
+* @brief Send the same data to a set of remote peers.
+*
+* Send a message to each of the peers in the "to" array. Net helpers
+* supporting batched I/O (e.g., the "udp-mmsg" incarnation) move many
+* datagrams per system call; the others fall back to one send_to_peer()
+* per destination.
+* @param[in] from A pointer to the nodeID representing the caller.
+* @param[in] to An array of pointers to the nodeIDs representing the remote peers.
+* @param[in] n The number of elements in the "to" array.
+* @param[in] buffer_ptr A pointer to the buffer containing the data to be sent.
+* @param[in] buffer_size The length of the data buffer.
+* @return The number of peers the message has been sent to, or -1 if some error occurred.
+*/
+int send_to_peers_batch(const struct nodeID *from, struct nodeID * const *to, int n, const uint8_t *buffer_ptr, int buffer_size);
+
+/**
+* @brief Send the same scattered data to a set of remote peers.
+*
+* Combination of send_to_peers_batch() and send_to_peer_iov().
+* @param[in] from A pointer to the nodeID representing the caller.
+* @param[in] to An array of pointers to the nodeIDs representing the remote peers.
+* @param[in] n The number of elements in the "to" array.
+* @param[in] iov An array of buffers containing the data to be sent.
+* @param[in] iovcnt The number of elements in the iov array (at most 8).
+* @return The number of peers the message has been sent to, or -1 if some error occurred.
+*/
+int send_to_peers_iov(const struct nodeID *from, struct nodeID * const *to, int n, const struct iovec *iov, int iovcnt);
+
+/**
+* @brief Receive a batch of messages.
+*
+* Block until at least one message is available, and then receive up to n
+* messages without blocking further. The i-th received message is stored
+* in buffer_ptr[i], its size in len[i] and its sender in remote[i].
+* @param[in] local A pointer to the nodeID representing the caller.
+* @param[out] remote An array of n pointers to be set to new nodeIDs representing the sender peers.
+* @param[out] buffer_ptr An array of n buffers where to store the received data.
+* @param[in] buffer_size The size of each data buffer.
+* @param[out] len An array of n integers, set to the sizes of the received messages.
+* @param[in] n The maximum number of messages to be received.
+* @return The number of received messages or -1 if some error occurred.
+*/
+int recv_from_peer_batch(const struct nodeID *local, struct nodeID **remote, uint8_t **buffer_ptr, int buffer_size, int *len, int n);
+
 
 /**
 * @brief Check for newly arrived data.
@@ -139,16 +289,36 @@ int node_addr(const struct nodeID *s, char *addr, int len);
 * @brief Create a nodeID structure from a serialized object.
 *
 * Read from a properly filled byte array (@see #nodeid_dump) and build a new nodeID from its serialized representation in the buffer.
+* All the serialisation formats produced by nodeid_dump() are recognised.
 * @param[in] b A pointer to the byte array containing the data to be used.
-* @param[in] len The number of bytes to be read from the buffer to build the new nodeID.
+* @param[out] len The number of bytes read from the buffer to build the new nodeID.
 * @return A pointer to the new nodeID.
 */
 struct nodeID *nodeid_undump(const uint8_t *b, int *len);
 
+/**
+* @brief Create a nodeID structure from a serialized object, reusing memory.
+*
+* Like nodeid_undump(), but the nodeID s (if not NULL) is released or
+* overwritten, so that repeatedly parsing nodeIDs does not need to allocate
+* memory. s must not be referenced anywhere else.
+* @param[in] s A pointer to a nodeID which is not needed anymore, or NULL.
+* @param[in] b A pointer to the byte array containing the data to be used.
+* @param[out] len The number of bytes read from the buffer to build the new nodeID.
+* @return A pointer to the new nodeID.
+*/
+struct nodeID *nodeid_undump_reuse(struct nodeID *s, const uint8_t *b, int *len);
+
 /**
 * @brief Serialize a nodeID in a byte array.
 *
 * Serialize a nodeID in a byte array.
+* Older peers only parse the legacy serialisation, while nodeid_undump()
+* accepts both the legacy and the compact ones: unless the "nodeid_dump"
+* option of net_helper_init() selects a format, the legacy one is used until
+* a compact nodeID is received, so mixing old and new peers is safe. Once all
+* the peers are upgraded, starting some of them with "nodeid_dump=compact"
+* switches all the others to the compact format.
 * @param[in] b A pointer to the byte array that will contain the nodeID serialization.
 * @param[in] s A pointer to the nodeID to be serialized.
 * @param[in] max_write_size A number of bytes available in b
@@ -176,4 +346,51 @@ int node_ip(const struct nodeID *s, char *ip, int len);
 */
 int node_port(const struct nodeID *s);
 
+/**
+* Traffic counters of the net helper.
+*/
+struct net_helper_stats {
+  uint64_t msgs_sent;		/**< messages sent */
+  uint64_t frags_sent;		/**< datagrams sent */
+  uint64_t bytes_sent;		/**< payload bytes sent */
+  uint64_t msgs_received;	/**< complete messages received */
+  uint64_t frags_received;	/**< datagrams received */
+  uint64_t bytes_received;	/**< payload bytes of the complete messages received (goodput) */
+  uint64_t msgs_lost;		/**< messages dropped because some fragment did not arrive in time (only the messages of which some fragment has been received) */
+  uint64_t bytes_wasted;	/**< received bytes belonging to the dropped messages */
+  uint64_t frags_dropped;	/**< invalid, duplicate or unexpected datagrams */
+  int frag_size;		/**< size of a fragment (smaller for the peers with a smaller path MTU) */
+};
+
+/**
+* @brief Read the traffic counters.
+*
+* Messages are delivered only if all their fragments arrive, so using
+* smaller fragments (see the "mtu" option of net_helper_init()) does not
+* improve the goodput (bytes_received) for a given packet loss rate.
+* msgs_lost and bytes_wasted only count what the receiver can see: a 60KB
+* fragment which lost an IP packet is discarded by the kernel, so without
+* "mtu" they stay 0 even on a lossy link, and the two modes can be compared
+* only by counting the lost messages on the sender side (as frag_loss_test
+* does). A message is counted as lost when the receive path notices that
+* its reassembly timed out.
+* @param[out] s Where to store the counters.
+* @return 0 on success, -1 if the net helper does not provide counters.
+*/
+int net_helper_stats(struct net_helper_stats *s);
+
+/**
+* @brief Give the file descriptor used by a local nodeID.
+*
+* Return the file descriptor which becomes readable when some data arrives
+* for the nodeID (this is the descriptor monitored by wait4data()), so that
+* it can be registered in an event loop (see reactor.h).
+* @param[in] s A pointer to the nodeID returned by net_helper_init().
+* @return The file descriptor. The result is meaningful only for the
+*         nodeIDs returned by net_helper_init(): the descriptor is not
+*         checked, and a nodeID with the same address as a local one
+*         (for example, a duplicate of it) can share its descriptor.
+*/
+int node_fd(const struct nodeID *s);
+
 #endif /* NET_HELPER_H */
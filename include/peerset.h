@@ -128,6 +128,30 @@ void peerset_clear(struct peerset *h, int size);
 
 int peerset_push_peer(struct peerset *h, struct peer *e);
 
+ /**
+  * @brief Remove a peer from a set without destroying it
+  *
+  * The caller becomes the owner of the returned peer structure: it can be
+  * inserted in another set with peerset_push_peer(), or released with
+  * peerset_peer_free(). It must not be released with free(), because the
+  * peers created by the peer sets come from a pool of slabs (shared by all
+  * the sets, and never released); peers allocated by the user with
+  * malloc() can be pushed into a set too.
+  *
+  * @param h a pointer to the set
+  * @param id the nodeID of the peer to be removed
+  * @return a pointer to the peer, or NULL if the peer is not in the set
+  */
 struct peer * peerset_pop_peer(struct peerset *h, const struct nodeID *id);
 
+ /**
+  * @brief Destroy a peer structure
+  *
+  * Release a peer structure which is not in a set (see peerset_pop_peer()),
+  * together with its nodeID and associated data.
+  *
+  * @param p a pointer to the peer
+  */
+void peerset_peer_free(struct peer *p);
+
 #endif	/* PEERSET_H */
@@ -0,0 +1,129 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/time.h>
+
+/**
+ * @file reactor.h
+ *
+ * @brief Event loop for the GRAPES modules.
+ *
+ * A reactor waits for events on a set of file descriptors (the net helper
+ * socket, see node_fd(), the chunkiser descriptors returned by
+ * input_get_fds(), the cloud helper completion descriptor returned by
+ * get_cloud_fd(), ...) and for the expiration of periodic timers, and
+ * invokes a callback for each one of them.
+ * The file descriptors are registered only once (on Linux, an epoll set is
+ * used), so that waiting for events has no setup cost and its cost does
+ * not depend on the number or on the values of the registered descriptors.
+ */
+
+/**
+ * Opaque reactor state.
+ */
+struct reactor;
+
+/**
+ * Callback invoked when a registered file descriptor is ready for reading.
+ */
+typedef void (*reactor_fd_cb)(void *arg, int fd);
+
+/**
+ * Callback invoked when a timer expires.
+ */
+typedef void (*reactor_timer_cb)(void *arg);
+
+/**
+ * @brief Create a reactor.
+ *
+ * @param[in] config Configuration options. "max_events=n" sets the maximum
+ *                   number of ready file descriptors handled after a single
+ *                   wakeup.
+ * @return A pointer to the new reactor, or NULL on error.
+ */
+struct reactor *reactor_init(const char *config);
+
+/**
+ * @brief Destroy a reactor.
+ *
+ * The registered file descriptors are not closed.
+ * @param[in,out] r A pointer to the reactor to be destroyed; it is set to NULL.
+ */
+void reactor_destroy(struct reactor **r);
+
+/**
+ * @brief Monitor a file descriptor.
+ *
+ * @param[in] r The reactor.
+ * @param[in] fd The file descriptor to be monitored for reading.
+ * @param[in] cb The function invoked when fd is readable.
+ * @param[in] arg Opaque argument passed to cb.
+ * @return 0 on success, < 0 on error (for example, if fd is already monitored).
+ */
+int reactor_add_fd(struct reactor *r, int fd, reactor_fd_cb cb, void *arg);
+
+/**
+ * @brief Stop monitoring a file descriptor.
+ *
+ * Can be invoked from a callback.
+ * @param[in] r The reactor.
+ * @param[in] fd The file descriptor.
+ * @return 0 on success, < 0 if fd is not monitored.
+ */
+int reactor_del_fd(struct reactor *r, int fd);
+
+/**
+ * @brief Add a periodic timer.
+ *
+ * The timer first expires a period after its creation. This can be used,
+ * for example, to periodically invoke psample_parse_data(ctx, NULL, 0) so
+ * that a peer sampler can send its messages when its period elapses.
+ * @param[in] r The reactor.
+ * @param[in] period The timer period.
+ * @param[in] cb The function invoked when the timer expires.
+ * @param[in] arg Opaque argument passed to cb.
+ * @return A timer identifier (>= 0), or < 0 on error.
+ */
+int reactor_add_timer(struct reactor *r, const struct timeval *period, reactor_timer_cb cb, void *arg);
+
+/**
+ * @brief Remove a timer.
+ *
+ * Can be invoked from a callback.
+ * @param[in] r The reactor.
+ * @param[in] id The timer identifier returned by reactor_add_timer().
+ * @return 0 on success, < 0 if the timer does not exist.
+ */
+int reactor_del_timer(struct reactor *r, int id);
+
+/**
+ * @brief Wait for events and dispatch them.
+ *
+ * Wait until some file descriptor is ready, some timer expires or the
+ * timeout elapses, and then invoke the callbacks of all the ready file
+ * descriptors and expired timers.
+ * @param[in] r The reactor.
+ * @param[in] tout The maximum time to wait, or NULL to wait until an
+ *                 event happens.
+ * @return The number of invoked callbacks (0 if the timeout expired), or
+ *         < 0 on error.
+ */
+int reactor_run_once(struct reactor *r, const struct timeval *tout);
+
+/**
+ * @brief Dispatch events until reactor_stop() is invoked.
+ *
+ * @param[in] r The reactor.
+ * @return 0 when stopped by reactor_stop(), < 0 on error.
+ */
+int reactor_run(struct reactor *r);
+
+/**
+ * @brief Make reactor_run() return.
+ *
+ * Usually invoked from a callback.
+ * @param[in] r The reactor.
+ */
+void reactor_stop(struct reactor *r);
+
+#endif /* REACTOR_H */
@@ -17,6 +17,9 @@
 		-# Weighted: Weighted random selection accorging to the given weight functions
 	-# filter functions: selections are typically filtered by functions such as whether a given peer (according to local knowledge) needs a given chunk.
 		The abstraction of the filter concept allows for easy modification of these filter conditions.
+
+  Weighted selection uses log(), so the applications using these functions
+  must link with the math library (-lm) too.
 */
 
 /**
@@ -160,6 +163,16 @@ void schedSelectHybrid(SchedOrdering ordering, schedPeerID  *peers, size_t peers
   */
 typedef double (*evaluateFunction)(void*);
 
+/**
+  * @brief Seed the random number generator used by the scheduler.
+
+  Random choices (weighted selection, tie breaking) use a generator which is
+  private to the scheduler, so that they are reproducible for a given seed.
+  If no seed is set, the generator is seeded by rand() on first use.
+  @param [in] seed the seed
+  */
+void schedSeed(unsigned int seed);
+
 /**
   * Select best N of K with the given ordering method
   */
@@ -7,6 +7,16 @@
  *
  * This is the Topology Manager interface.
  *
+ * Many independent Topology Manager instances (overlays) can run in the
+ * same process: each one is handled through a struct tman_context, created
+ * by tman_init(). Instances do not share any Topology Manager state, so
+ * different instances can be driven by different threads (the nodeIDs of
+ * the net helper can be created and freed concurrently), but the calls
+ * on the same instance must be serialised.
+ * The tmanXxx() functions (tmanInit(), tmanParseData(), ...) operate on a
+ * single, implicitly created, instance, and fail (returning -1, or NULL)
+ * if tmanInit() has not been successfully invoked.
+ *
  */
 
 /**
@@ -22,6 +32,91 @@
 */
 typedef int (*tmanRankingFunction)(const void *target, const void *p1, const void *p2);
 
+/**
+   @brief Maintains the context of a Topology Manager instance.
+ */
+struct tman_context;
+
+/**
+  @brief Create a Topology Manager instance.
+
+  @param myID the ID of this peer.
+  @param metadata Pointer to data associated with the local peer.
+  @param metadata_size Size (number of bytes) of the metadata associated with the local peer.
+  @param rfun Ranking function that may be used to order the peers in tman cache.
+  @param config Configuration string. "protocol=tman" selects the T-Man
+         protocol, "protocol=dumb" (default) a simpler topology manager.
+         "overlay=<n>" (n > 0) tags all the messages of this instance with
+         the overlay ID n, so that the messages of many instances sharing the
+         same socket can be told apart (see tman_overlay()).
+  @return the context of the new instance, or NULL in case of error.
+*/
+struct tman_context *tman_init(struct nodeID *myID, void *metadata, int metadata_size, tmanRankingFunction rfun, const char *config);
+
+/**
+  @brief Destroy a Topology Manager instance.
+
+  @param tc pointer to the context to be destroyed; it is set to NULL.
+*/
+void tman_destroy(struct tman_context **tc);
+
+/**
+  @brief Get the overlay a received message belongs to.
+
+  Use this function to dispatch the received Topology Manager messages to
+  the right instance (the one configured with the same overlay ID).
+  @param buff a memory buffer containing the received message.
+  @param len the size of such a memory buffer.
+  @return the overlay ID of the message (0 if the message is not tagged), or
+          -1 if this is not a Topology Manager message.
+*/
+int tman_overlay(const uint8_t *buff, int len);
+
+/**
+  @brief Insert a peer in the neighbourhood of an instance (see tmanAddNeighbour()).
+*/
+int tman_add_neighbour(struct tman_context *tc, struct nodeID *neighbour, void *metadata, int metadata_size);
+
+/**
+  @brief Pass a received packet to an instance (see tmanParseData()).
+*/
+int tman_parse_data(struct tman_context *tc, const uint8_t *buff, int len, struct nodeID **peers, int size, const void *metadata, int metadata_size);
+
+/**
+  @brief Change the metadata of the local peer in an instance (see tmanChangeMetadata()).
+*/
+int tman_change_metadata(struct tman_context *tc, void *metadata, int metadata_size);
+
+/**
+  @brief Get the metadata of the neighbors of an instance (see tmanGetMetadata()).
+*/
+const void *tman_get_metadata(struct tman_context *tc, int *metadata_size);
+
+/**
+  @brief Get the neighbourhood size of an instance (see tmanGetNeighbourhoodSize()).
+*/
+int tman_get_neighbourhood_size(struct tman_context *tc);
+
+/**
+  @brief Get the best peers of an instance (see tmanGivePeers()).
+*/
+int tman_give_peers(struct tman_context *tc, int n, struct nodeID **peers, void *metadata);
+
+/**
+  @brief Increase the neighbourhood size of an instance (see tmanGrowNeighbourhood()).
+*/
+int tman_grow_neighbourhood(struct tman_context *tc, int n);
+
+/**
+  @brief Decrease the neighbourhood size of an instance (see tmanShrinkNeighbourhood()).
+*/
+int tman_shrink_neighbourhood(struct tman_context *tc, int n);
+
+/**
+  @brief Remove a neighbour from an instance (see tmanRemoveNeighbour()).
+*/
+int tman_remove_neighbour(struct tman_context *tc, struct nodeID *neighbour);
+
 /**
   @brief Initialise the Topology Manager.
 
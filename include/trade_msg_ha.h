@@ -28,6 +28,20 @@
  */
 int parseChunkMsg(const uint8_t *buff, int buff_len, struct chunk *c, uint16_t *transid);
 
+/**
+ * @brief Parse an incoming chunk message without copying the chunk payload.
+ *
+ * Like parseChunkMsg(), but the chunk data and attributes point inside buff
+ * when it has been allocated with chunk_payload_alloc() (see decodeChunkAdopt()).
+ *
+ * @param[in] buff containing the incoming message.
+ * @param[in] buff_len length of the buffer.
+ * @param[out] c the chunk filled with data (an already allocated chunk structure must be passed!).
+ * @param[out] transid the transaction ID.
+ * @return 1 on success, <0 on error.
+ */
+int parseChunkMsgAdopt(uint8_t *buff, int buff_len, struct chunk *c, uint16_t *transid);
+
 /**
   * @brief Send a Chunk to a target Peer
   *
@@ -40,6 +54,22 @@ int parseChunkMsg(const uint8_t *buff, int buff_len, struct chunk *c, uint16_t *
   */
 int sendChunk(const struct nodeID * localID, const struct nodeID *to, const struct chunk *c, uint16_t transid);
 
+/**
+  * @brief Send a Chunk to a set of Peers
+  *
+  * Send the same Chunk to all the given Peers. The chunk header is encoded
+  * only once, and the chunk payload is passed to the net helper without
+  * being copied.
+  *
+  * @param[in] localID the local peer
+  * @param[in] to array of destination peers
+  * @param[in] n number of elements in the "to" array
+  * @param[in] c Chunk to send
+  * @param[in] transid the ID of transaction this send belongs to (if any)
+  * @return the number of peers the chunk has been sent to, <0 on error
+  */
+int sendChunkToPeers(const struct nodeID *localID, struct nodeID * const *to, int n, const struct chunk *c, uint16_t transid);
+
 /**
   * @brief Init the Chunk trading internals.
   *
@@ -32,10 +32,26 @@
   */
 int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len);
 
+ /**
+  * @brief Encode the header of a chunk.
+  *
+  * Encode only the first CHUNK_HEADER_SIZE bytes of the bit stream
+  * produced by encodeChunk(); the chunk data and attributes follow them.
+  * This allows to send the payload without copying it (see sendChunkToPeers()).
+  *
+  * @param[in] c Chunk to send
+  * @param[in] buff Buffer that will be filled with the header
+  * @param[in] buff_len length of the buffer (at least CHUNK_HEADER_SIZE bytes)
+  * @return CHUNK_HEADER_SIZE on success, <0 on error
+  */
+int encodeChunkHeader(const struct chunk *c, uint8_t *buff, int buff_len);
+
 /**
   * @brief Decode the bit stream.
   *
   * Decode the bit stream contained int the buffer, filling the other parameters. This is the dual of the encode function.
+  * The chunk data and attributes are allocated with malloc(), and the
+  * caller releases them with free() (or with chunk_payload_release()).
   *
   * @param[in] c Chunks that has been transmitted
   * @param[in] buff Buffer which contain the bit stream to decode, filling the above parameters
@@ -43,3 +59,23 @@ int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len);
   * @return 0 on success, <0 on error
   */
 int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len);
+
+/**
+  * @brief Decode the bit stream, without copying the payload.
+  *
+  * Like decodeChunk(), but if buff has been allocated with
+  * chunk_payload_alloc() the chunk data and attributes point inside buff
+  * (a reference to the buffer is taken for each of them) instead of being
+  * copied. Hence, the received buffer can be shared with the chunk buffer
+  * and the other users of the chunk; the caller still owns its own reference
+  * to buff, and must drop it with chunk_payload_release() when done.
+  * If buff does not come from the pool, the payload is copied (as done by
+  * decodeChunk()). In both cases, the chunk data and attributes must be
+  * released with chunk_payload_release(), never with free().
+  *
+  * @param[in] c Chunks that has been transmitted
+  * @param[in] buff Buffer which contain the bit stream to decode, filling the above parameters
+  * @param[in] buff_len length of the buffer that contain the bit stream
+  * @return 0 on success, <0 on error
+  */
+int decodeChunkAdopt(struct chunk *c, uint8_t *buff, int buff_len);
@@ -32,6 +32,26 @@ enum signaling_type {
  */
 int chunkSignalingInit(struct nodeID *myID);
 
+/**
+ * @brief Configure the signaling.
+ *
+ * With "bmap_delta=1", sendBufferMap() sends our own buffer maps as the
+ * changes (added and removed chunks) with respect to the last full buffer
+ * map sent to the same peer; a full buffer map is sent again after
+ * "bmap_refresh" deltas (default 10), or when it is smaller than the
+ * delta. Full buffer maps are encoded as usual (hence, they are not
+ * larger than in the default mode). Both peers must enable this mode:
+ * parseSignaling() rebuilds the complete buffer map, and fails if the full
+ * buffer map a delta refers to has not been received: in this case,
+ * requestBufferMap() makes the sender of the delta send a full buffer map
+ * to the requesting peer. State is kept for at most "bmap_peers" peers
+ * (default 64).
+ *
+ * @param[in] config configuration string.
+ * @return 1 on success, <0 on error.
+ */
+int chunkSignalingConfig(const char *config);
+
 /**
  * @brief Parse an incoming signaling message, providing the signal type and the information of the signaling message.
  *
@@ -44,7 +64,8 @@ int chunkSignalingInit(struct nodeID *myID);
  * @param[out] max_deliver deliver at most this number of Chunks.
  * @param[out] trans_id transaction number associated with this message.
  * @param[out] sig_type Type of signaling message.
- * @return 1 on success, <0 on error.
+ * @return 1 on success, <0 on error (including the reception of a delta
+ *         buffer map whose full buffer map is missing; see chunkSignalingConfig()).
  */
 int parseSignaling(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
                    struct chunkID_set **cset, int *max_deliver, uint16_t *trans_id,
@@ -312,26 +312,44 @@ struct nodeID *blist_rand_peer(struct peer_cache *c, void **meta, int max)
   return c->entries[j].id;
 }
 
-struct peer_cache *blist_entries_undump(const uint8_t *buff, int size)
+/*
+ * Parse a received cache in c (if not NULL), reusing its memory and the
+ * nodeIDs still owned by it (see entries_undump_reuse())
+ */
+struct peer_cache *blist_entries_undump_reuse(struct peer_cache *c, const uint8_t *buff, int size)
 {
-  struct peer_cache *res;
   int i = 0;
   const uint8_t *p = buff;
   uint8_t *meta;
-  int cache_size, metadata_size;
+  int cache_size, metadata_size, owned;
 
   cache_size = int_rcpy(buff);
   metadata_size = int_rcpy(buff + 4);
   p = buff + 8;
-  res = blist_cache_init(cache_size, metadata_size, 0);
-  meta = res->metadata;
+  if (c && (c->cache_size != cache_size || c->metadata_size != metadata_size)) {
+    blist_cache_free(c);
+    c = NULL;
+  }
+  if (c == NULL) {
+    c = blist_cache_init(cache_size, metadata_size, 0);
+    if (c == NULL) {
+      return NULL;
+    }
+  }
+  owned = c->current_size;
+  meta = c->metadata;
   while (p - buff < size) {
     int len;
 
-    res->entries[i].timestamp = int_rcpy(p);
+    c->entries[i].timestamp = int_rcpy(p);
     p += sizeof(uint32_t);
-    res->entries[i].flags = p[0];
-    res->entries[i++].id = nodeid_undump(++p, &len);
+    c->entries[i].flags = p[0];
+    if (i < owned) {
+      c->entries[i].id = nodeid_undump_reuse(c->entries[i].id, ++p, &len);
+    } else {
+      c->entries[i].id = nodeid_undump(++p, &len);
+    }
+    i++;
     p += len;
     if (metadata_size) {
       memcpy(meta, p, metadata_size);
@@ -339,10 +357,19 @@ struct peer_cache *blist_entries_undump(const uint8_t *buff, int size)
       meta += metadata_size;
     }
   }
-  res->current_size = i;
+  while (owned > i) {
+    nodeid_free(c->entries[--owned].id);
+    c->entries[owned].id = NULL;
+  }
+  c->current_size = i;
 if (p - buff != size) { fprintf(stderr, "Waz!! %d != %d\n", (int)(p - buff), size); exit(-1);}
 
-  return res;
+  return c;
+}
+
+struct peer_cache *blist_entries_undump(const uint8_t *buff, int size)
+{
+  return blist_entries_undump_reuse(NULL, buff, size);
 }
 
 int blist_cache_header_dump(uint8_t *b, const struct peer_cache *c)
@@ -421,6 +448,156 @@ struct peer_cache *blist_cache_rank (const struct peer_cache *c, ranking_functio
 	return res;
 }
 
+/*
+ * The following functions work on caches ordered according to a ranking
+ * function (as built by blist_cache_rank()): the position of a new entry
+ * is found by bisection, so that the ranking function is invoked O(log n)
+ * times instead of n times. As in blist_cache_rank(), if the ranking
+ * function is NULL the entries are ordered by timestamp
+ */
+static int ranked_before(const struct peer_cache *c, int i, ranking_function rank, const void *tmeta, const uint8_t *meta, uint32_t timestamp)
+{
+  if (rank == NULL) {
+    return c->entries[i].timestamp < timestamp;
+  }
+
+  return rank(tmeta, meta, c->metadata + c->metadata_size * i) == 2;
+}
+
+static int rank_pos(const struct peer_cache *c, int n, ranking_function rank, const void *tmeta, const uint8_t *meta, uint32_t timestamp)
+{
+  int lo = 0, hi = n;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+
+    if (ranked_before(c, mid, rank, tmeta, meta, timestamp)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static void entry_insert(struct peer_cache *c, int pos, const struct cache_entry *e, const uint8_t *meta)
+{
+  if (c->metadata_size) {
+    memmove(c->metadata + (pos + 1) * c->metadata_size, c->metadata + pos * c->metadata_size, (c->current_size - pos) * c->metadata_size);
+    memcpy(c->metadata + pos * c->metadata_size, meta, c->metadata_size);
+  }
+  memmove(c->entries + pos + 1, c->entries + pos, (c->current_size - pos) * sizeof(struct cache_entry));
+  c->entries[pos] = *e;
+  c->current_size++;
+}
+
+static void entry_remove(struct peer_cache *c, int pos)
+{
+  c->current_size--;
+  if (c->metadata_size) {
+    memmove(c->metadata + pos * c->metadata_size, c->metadata + (pos + 1) * c->metadata_size, (c->current_size - pos) * c->metadata_size);
+  }
+  memmove(c->entries + pos, c->entries + pos + 1, (c->current_size - pos) * sizeof(struct cache_entry));
+}
+
+/*
+ * Same result as blist_cache_rank(), but only the n best entries are
+ * selected (partial selection: the ranking function is invoked
+ * O(c->current_size * log n) times)
+ */
+struct peer_cache *blist_cache_rank_top(const struct peer_cache *c, ranking_function rank, const struct nodeID *target, const void *target_meta, int n)
+{
+  struct peer_cache *res;
+  int i;
+
+  res = blist_cache_init(c->cache_size, c->metadata_size, c->max_timestamp);
+  if (res == NULL) {
+    return res;
+  }
+  if (n <= 0 || n > c->current_size) {
+    n = c->current_size;
+  }
+
+  for (i = 0; i < c->current_size; i++) {
+    const uint8_t *meta = c->metadata + c->metadata_size * i;
+    struct cache_entry e;
+    int pos;
+
+    if (target && nodeid_equal(c->entries[i].id, target)) {
+      continue;
+    }
+    if (res->current_size == n) {
+      if (ranked_before(res, n - 1, rank, target_meta, meta, c->entries[i].timestamp)) {
+        continue;
+      }
+      nodeid_free(res->entries[n - 1].id);
+      res->current_size--;
+    }
+    pos = rank_pos(res, res->current_size, rank, target_meta, meta, c->entries[i].timestamp);
+    e = c->entries[i];
+    e.id = nodeid_dup(e.id);
+    entry_insert(res, pos, &e, meta);
+  }
+
+  for (i = 0; i < c->blist_size; i++) {
+    res->blist[i] = nodeid_dup(c->blist[i]);
+  }
+  res->blist_size = c->blist_size;
+
+  return res;
+}
+
+/*
+ * Incremental version of blist_cache_union() + blist_cache_rank(): c1 must
+ * be ranked according to tmeta, and the entries of c2 are merged in it (the
+ * nodeIDs inserted in c1 are moved out of c2). c1 is enlarged if needed
+ */
+int blist_cache_merge_ranked(struct peer_cache *c1, struct peer_cache *c2, ranking_function rank, const void *tmeta)
+{
+  int n, pos;
+
+  if (c1->metadata_size != c2->metadata_size) {
+    return -1;
+  }
+  if (c1->current_size + c2->current_size > c1->cache_size) {
+    blist_cache_resize(c1, c1->current_size + c2->current_size);
+  }
+
+  if (c2->current_size) {
+    pos = find_in_bl(c1, c2->entries[0].id); // sender should never be blacklisted
+    if (pos < c1->blist_size) {
+      nodeid_free(c1->blist[pos]);
+      c1->blist_size--;
+      memmove(c1->blist + pos, c1->blist + pos + 1, (c1->blist_size - pos) * sizeof(struct nodeID *));
+    }
+  }
+
+  for (n = 0; n < c2->current_size; n++) {
+    const uint8_t *meta = c2->metadata + n * c2->metadata_size;
+    struct cache_entry e;
+
+    pos = in_cache(c1, &c2->entries[n]);
+    if (pos >= 0) {
+      if (!n) c1->entries[pos].flags &= NOREPLY_FLAG_UNSET; // reset flags of sender
+      if (c1->entries[pos].timestamp > c2->entries[n].timestamp) {
+        /* Newer metadata: the entry has to be ranked again */
+        e = c1->entries[pos];
+        e.timestamp = c2->entries[n].timestamp;
+        e.flags = c2->entries[n].flags;
+        entry_remove(c1, pos);
+        entry_insert(c1, rank_pos(c1, c1->current_size, rank, tmeta, meta, e.timestamp), &e, meta);
+      }
+    } else if (find_in_bl(c1, c2->entries[n].id) == c1->blist_size) {
+      e = c2->entries[n];
+      c2->entries[n].id = NULL;
+      entry_insert(c1, rank_pos(c1, c1->current_size, rank, tmeta, meta, e.timestamp), &e, meta);
+    }
+  }
+
+  return c1->current_size;
+}
+
 // It MUST always be called with c1 = current local_cache to ensure black_list continuity
 struct peer_cache *blist_cache_union(struct peer_cache *c1, struct peer_cache *c2, int *size) {
 	int n,pos;
@@ -486,13 +663,13 @@ int blist_cache_resize (struct peer_cache *c, int size) {
 		return c->current_size;
 	}
 
+	while (c->current_size > size) {
+		nodeid_free(c->entries[--c->current_size].id);
+	}
 	c->entries = realloc(c->entries, sizeof(struct cache_entry) * size);
 	if (dif > 0) {
 		memset(c->entries + c->cache_size, 0, sizeof(struct cache_entry) * dif);
 	}
-	else if (c->current_size > size) {
-		c->current_size = size;
-	}
 
 	if (c->metadata_size) {
 		c->metadata = realloc(c->metadata, c->metadata_size * size);
@@ -20,11 +20,14 @@ int blist_cache_del(struct peer_cache *c, struct nodeID *neighbour);
 struct nodeID *blist_rand_peer(struct peer_cache *c, void **meta, int max);
 
 struct peer_cache *blist_entries_undump(const uint8_t *buff, int size);
+struct peer_cache *blist_entries_undump_reuse(struct peer_cache *c, const uint8_t *buff, int size);
 int blist_cache_header_dump(uint8_t *b, const struct peer_cache *c);
 int blist_entry_dump(uint8_t *b, struct peer_cache *e, int i, size_t max_write_size);
 
 struct peer_cache *blist_merge_caches(struct peer_cache *c1, struct peer_cache *c2, int newsize, int *source);
 struct peer_cache *blist_cache_rank (const struct peer_cache *c, ranking_function rank, const struct nodeID *target, const void *target_meta);
+struct peer_cache *blist_cache_rank_top(const struct peer_cache *c, ranking_function rank, const struct nodeID *target, const void *target_meta, int n);
+int blist_cache_merge_ranked(struct peer_cache *c1, struct peer_cache *c2, ranking_function rank, const void *tmeta);
 struct peer_cache *blist_cache_union(struct peer_cache *c1, struct peer_cache *c2, int *size);
 int blist_cache_resize (struct peer_cache *c, int size);
 
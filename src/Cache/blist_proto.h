@@ -1,13 +1,15 @@
 #ifndef BLIST_PROTO
 #define BLIST_PROTO
 
-int blist_ncast_reply(const struct peer_cache *c, struct peer_cache *local_cache);
-int blist_tman_reply(const struct peer_cache *c, struct peer_cache *local_cache, int max_peers);
-int blist_ncast_query(struct peer_cache *local_cache);
-int blist_tman_query(struct peer_cache *local_cache);
-int blist_tman_query_peer(struct peer_cache *local_cache, struct nodeID *dst, int max_peers);
-int blist_ncast_query_peer(struct peer_cache *local_cache, struct nodeID *dst);
-int blist_proto_metadata_update(void *meta, int meta_size);
-int blist_proto_init(struct nodeID *s, void *meta, int meta_size);
+struct blist_proto_context;
+
+int blist_ncast_reply(struct blist_proto_context *context, const struct peer_cache *c, struct peer_cache *local_cache);
+int blist_tman_reply(struct blist_proto_context *context, const struct peer_cache *c, struct peer_cache *local_cache, int max_peers);
+int blist_ncast_query(struct blist_proto_context *context, struct peer_cache *local_cache);
+int blist_tman_query_peer(struct blist_proto_context *context, struct peer_cache *local_cache, struct nodeID *dst, int max_peers);
+int blist_ncast_query_peer(struct blist_proto_context *context, struct peer_cache *local_cache, struct nodeID *dst);
+int blist_proto_metadata_update(struct blist_proto_context *context, void *meta, int meta_size);
+struct blist_proto_context *blist_proto_init(struct nodeID *s, void *meta, int meta_size, uint32_t overlay);
+void blist_proto_destroy(struct blist_proto_context **context);
 
 #endif	/* BLIST_PROTO */
@@ -16,4 +16,6 @@ struct topo_header {
 #define CLOUDCAST_REPLY 0x08
 #define CLOUDCAST_CLOUD 0x09
 
+#define TOPO_OVERLAY 0x80	/* type flag: a 32 bit overlay ID follows the header */
+
 #endif  /* PROTO */
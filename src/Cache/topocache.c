@@ -9,7 +9,6 @@
 #include <string.h>
 
 #include <stdio.h>
-#undef NDEBUG
 #include <assert.h>
 
 #include "net_helper.h"
@@ -28,42 +27,103 @@ struct peer_cache {
   int metadata_size;
   uint8_t *metadata;
   int max_timestamp;
+  int *index;		/* hash table of positions in entries (-1: empty slot) */
+  int index_size;	/* power of 2, at least twice cache_size */
 };
 
+/*
+ * The index maps nodeIDs to positions in the entries array (linear probing).
+ * Entries are often moved inside the array: in this case the index is
+ * rebuilt, which costs as much as moving the entries. Entries having a NULL
+ * id (moved to another cache by merge_caches() or cache_union()) are ignored.
+ */
+static int index_alloc(struct peer_cache *c, int n)
+{
+  int size = 8;
+  int *res;
+
+  while (size < 2 * n) {
+    size *= 2;
+  }
+  res = realloc(c->index, size * sizeof(int));
+  if (res == NULL) {
+    return -1;
+  }
+  c->index = res;
+  c->index_size = size;
+  memset(c->index, 0xff, size * sizeof(int));
+
+  return 0;
+}
+
+static int index_slot(const struct peer_cache *c, const struct nodeID *id)
+{
+  unsigned int mask = c->index_size - 1;
+  unsigned int i = nodeid_hash(id) & mask;
+
+  while (c->index[i] >= 0) {
+    const struct nodeID *e = c->entries[c->index[i]].id;
+
+    if (e && nodeid_equal(e, id)) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+
+  return i;
+}
+
+static void index_add(const struct peer_cache *c, int pos)
+{
+  if (c->entries[pos].id) {
+    c->index[index_slot(c, c->entries[pos].id)] = pos;
+  }
+}
+
+static void index_rebuild(const struct peer_cache *c)
+{
+  int i;
+
+  memset(c->index, 0xff, c->index_size * sizeof(int));
+  for (i = 0; i < c->current_size; i++) {
+    index_add(c, i);
+  }
+}
+
 static int cache_insert(struct peer_cache *c, struct cache_entry *e, const void *meta)
 {
-  int i, position;
+  int i, position, found;
 
   if (c->current_size == c->cache_size) {
     return -2;
   }
+  assert(e->id);
+  found = cache_pos(c, e->id);
+  if (found >= 0 && c->entries[found].timestamp <= e->timestamp) {
+    return -1;
+  }
   position = 0;
-  for (i = 0; i < c->current_size; i++) {
-    assert(e->id);
+  for (i = 0; i < (found >= 0 ? found : c->current_size); i++) {
     assert(c->entries[i].id);
 
-    if (nodeid_equal(e->id, c->entries[i].id)) {
-      if (c->entries[i].timestamp > e->timestamp) {
-        assert(i >= position);
-        nodeid_free(c->entries[i].id);
-
-        if (position != i) {
-          memmove(c->entries + position + 1, c->entries + position, sizeof(struct cache_entry) * (i - position));
-          memmove(c->metadata + (position + 1) * c->metadata_size, c->metadata + position * c->metadata_size, (i -position) * c->metadata_size);
-        }
+    if (c->entries[i].timestamp <= e->timestamp) {
+      position = i + 1;
+    }
+  }
 
-        c->entries[position] = *e;
-        memcpy(c->metadata + position * c->metadata_size, meta, c->metadata_size);
+  if (found >= 0) {
+    nodeid_free(c->entries[found].id);
 
-        return position;
-      }
-
-      return -1;
+    if (position != found) {
+      memmove(c->entries + position + 1, c->entries + position, sizeof(struct cache_entry) * (found - position));
+      memmove(c->metadata + (position + 1) * c->metadata_size, c->metadata + position * c->metadata_size, (found - position) * c->metadata_size);
     }
 
-    if (c->entries[i].timestamp <= e->timestamp) {
-      position = i + 1;
-    }
+    c->entries[position] = *e;
+    memcpy(c->metadata + position * c->metadata_size, meta, c->metadata_size);
+    index_rebuild(c);
+
+    return position;
   }
 
   if (position != c->current_size) {
@@ -73,6 +133,11 @@ static int cache_insert(struct peer_cache *c, struct cache_entry *e, const void
   c->current_size++;
   c->entries[position] = *e;
   memcpy(c->metadata + position * c->metadata_size, meta, c->metadata_size);
+  if (position == c->current_size - 1) {
+    index_add(c, position);
+  } else {
+    index_rebuild(c);
+  }
 
   return position;
 }
@@ -82,8 +147,8 @@ int cache_add_cache(struct peer_cache *dst, const struct peer_cache *src)
   struct cache_entry *e_orig;
   int count, j;
   struct cache_entry e_dup;
-cache_check(dst);
-cache_check(src);
+cache_debug_check(dst);
+cache_debug_check(src);
 
   count = 0;
   j=0;
@@ -100,8 +165,8 @@ cache_check(src);
     }
     j++;
   }
-cache_check(dst);
-cache_check(src);
+cache_debug_check(dst);
+cache_debug_check(src);
 
   return dst->current_size;
 }
@@ -128,11 +193,10 @@ int cache_metadata_update(struct peer_cache *c, const struct nodeID *p, const vo
   if (!meta_size || meta_size != c->metadata_size) {
     return -3;
   }
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, p)) {
-      memcpy(c->metadata + i * meta_size, meta, meta_size);
-      return 1;
-    }
+  i = cache_pos(c, p);
+  if (i >= 0) {
+    memcpy(c->metadata + i * meta_size, meta, meta_size);
+    return 1;
   }
 
   return 0;
@@ -145,17 +209,15 @@ int cache_add_ranked(struct peer_cache *c, struct nodeID *neighbour, const void
   if (meta_size && meta_size != c->metadata_size) {
     return -3;
   }
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, neighbour)) {
-      if (f != NULL) {
-        cache_del(c,neighbour);
-        if (i == c->current_size) break;
-      } else {
-          cache_metadata_update(c,neighbour,meta,meta_size);
-          return -1;
-      }
+  if (cache_pos(c, neighbour) >= 0) {
+    if (f == NULL) {
+      cache_metadata_update(c,neighbour,meta,meta_size);
+      return -1;
     }
-    if ((f != NULL) && f(tmeta, meta, c->metadata+(c->metadata_size * i)) == 2) {
+    cache_del(c,neighbour);
+  }
+  for (i = 0; (f != NULL) && i < c->current_size; i++) {
+    if (f(tmeta, meta, c->metadata+(c->metadata_size * i)) == 2) {
       pos++;
     }
   }
@@ -176,6 +238,11 @@ int cache_add_ranked(struct peer_cache *c, struct nodeID *neighbour, const void
   c->entries[pos].id = nodeid_dup(neighbour);
   c->entries[pos].timestamp = 1;
   c->current_size++;
+  if (pos == c->current_size - 1) {
+    index_add(c, pos);
+  } else {
+    index_rebuild(c);
+  }
 
   return c->current_size;
 }
@@ -188,22 +255,18 @@ int cache_add(struct peer_cache *c, struct nodeID *neighbour, const void *meta,
 int cache_del(struct peer_cache *c, const struct nodeID *neighbour)
 {
   int i;
-  int found = 0;
 
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, neighbour)) {
-      nodeid_free(c->entries[i].id);
-      c->current_size--;
-      found = 1;
-      if (c->metadata_size && (i < c->current_size)) {
-        memmove(c->metadata + c->metadata_size * i,
-                c->metadata + c->metadata_size * (i + 1),
-                c->metadata_size * (c->current_size - i));
-      }
-    }
-    if (found && (i < c->current_size)) {
-      c->entries[i] = c->entries[i + 1];
+  i = cache_pos(c, neighbour);
+  if (i >= 0) {
+    nodeid_free(c->entries[i].id);
+    c->current_size--;
+    if (c->metadata_size && (i < c->current_size)) {
+      memmove(c->metadata + c->metadata_size * i,
+              c->metadata + c->metadata_size * (i + 1),
+              c->metadata_size * (c->current_size - i));
     }
+    memmove(c->entries + i, c->entries + i + 1, sizeof(struct cache_entry) * (c->current_size - i));
+    index_rebuild(c);
   }
 
   return c->current_size;
@@ -225,6 +288,7 @@ void cache_delay(struct peer_cache *c, int dts)
 				   all the other entries wiil be older than
 				   this one, so remove all of them
 				*/
+      index_rebuild(c);
     } else {
       c->entries[i].timestamp = c->entries[i].timestamp + dts > 0 ? c->entries[i].timestamp + dts : 0;
     }
@@ -269,6 +333,15 @@ struct peer_cache *cache_init(int n, int metadata_size, int max_timestamp)
     res->metadata_size = 0;
   }
 
+  res->index = NULL;
+  if (index_alloc(res, n) < 0) {
+    free(res->metadata);
+    free(res->entries);
+    free(res);
+
+    return NULL;
+  }
+
   return res;
 }
 
@@ -289,6 +362,7 @@ struct peer_cache *cache_copy(const struct peer_cache *c1)
   if (new_cache->metadata_size) {
     memcpy(new_cache->metadata, c1->metadata, c1->metadata_size * c1->current_size);
   }
+  index_rebuild(new_cache);
 
   return new_cache;
 }
@@ -304,20 +378,17 @@ void cache_free(struct peer_cache *c)
   }
   free(c->entries);
   free(c->metadata);
+  free(c->index);
   free(c);
 }
 
 int cache_pos(const struct peer_cache *c, const struct nodeID *n)
 {
-  int i;
-
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, n)) {
-      return i;
-    }
+  if (n == NULL) {
+    return -1;
   }
 
-  return -1;
+  return c->index[index_slot(c, n)];
 }
 
 static int in_cache(const struct peer_cache *c, const struct cache_entry *elem)
@@ -359,8 +430,8 @@ int cache_fill_ordered(struct peer_cache *dst, const struct peer_cache *src, int
 {
   struct cache_entry *e_orig, e_dup;
   int count, j, err;
-cache_check(dst);
-cache_check(src);
+cache_debug_check(dst);
+cache_debug_check(src);
   if (target_size <= 0 || target_size > dst->cache_size) {
     target_size = dst->cache_size;
   }
@@ -384,8 +455,8 @@ cache_check(src);
 
     j++;
   }
-cache_check(dst);
-cache_check(src);
+cache_debug_check(dst);
+cache_debug_check(src);
  return dst->current_size;
 }
 
@@ -394,8 +465,8 @@ int cache_fill_rand(struct peer_cache *dst, const struct peer_cache *src, int ta
   int added[src->current_size];
   struct cache_entry *e_orig, e_dup;
   int count, j, err;
-cache_check(dst);
-cache_check(src);
+cache_debug_check(dst);
+cache_debug_check(src);
   if (target_size <= 0 || target_size > dst->cache_size) {
     target_size = dst->cache_size;
   }
@@ -421,8 +492,8 @@ cache_check(src);
       nodeid_free(e_dup.id);
     }
   }
-cache_check(dst);
-cache_check(src);
+cache_debug_check(dst);
+cache_debug_check(src);
  return dst->current_size;
 }
 
@@ -435,7 +506,7 @@ struct peer_cache *rand_cache_except(struct peer_cache *c, int n,
   int present[len];
   int count = 0;
 
-cache_check(c);
+cache_debug_check(c);
 
  memset(present, 0, sizeof(int) * len);
 
@@ -467,8 +538,9 @@ cache_check(c);
     memmove(c->entries + j, c->entries + j + 1, sizeof(struct cache_entry) * (c->current_size - j));
     memmove(c->metadata + c->metadata_size * j, c->metadata + c->metadata_size * (j + 1), c->metadata_size * (c->current_size - j));
     c->entries[c->current_size].id = NULL;
-cache_check(c);
   }
+  index_rebuild(c);
+cache_debug_check(c);
 
   return res;
 }
@@ -477,7 +549,7 @@ struct peer_cache *rand_cache(struct peer_cache *c, int n)
 {
   struct peer_cache *res;
 
-cache_check(c);
+cache_debug_check(c);
   if (c->current_size < n) {
     n = c->current_size;
   }
@@ -492,31 +564,55 @@ cache_check(c);
     memmove(c->entries + j, c->entries + j + 1, sizeof(struct cache_entry) * (c->current_size - j));
     memmove(c->metadata + c->metadata_size * j, c->metadata + c->metadata_size * (j + 1), c->metadata_size * (c->current_size - j));
     c->entries[c->current_size].id = NULL;
-cache_check(c);
   }
+  index_rebuild(c);
+cache_debug_check(c);
 
   return res;
 }
 
-struct peer_cache *entries_undump(const uint8_t *buff, int size)
+/*
+ * Parse a received cache in c (if not NULL), reusing its memory: the
+ * entries arrays are kept if the sizes match, and the nodeIDs still owned by
+ * c (the ones not moved out by merge_caches() or cache_union()) are
+ * overwritten by nodeid_undump_reuse(). So, parsing the caches received from
+ * other peers does not allocate memory in the common case
+ */
+struct peer_cache *entries_undump_reuse(struct peer_cache *c, const uint8_t *buff, int size)
 {
-  struct peer_cache *res;
   int i = 0;
   const uint8_t *p = buff;
   uint8_t *meta;
-  int cache_size, metadata_size;
+  int cache_size, metadata_size, owned;
 
   cache_size = int_rcpy(buff);
   metadata_size = int_rcpy(buff + 4);
   p = buff + 8;
-  res = cache_init(cache_size, metadata_size, 0);
-  meta = res->metadata;
+  if (c && c->metadata_size != metadata_size) {
+    cache_free(c);
+    c = NULL;
+  }
+  if (c == NULL) {
+    c = cache_init(cache_size, metadata_size, 0);
+    if (c == NULL) {
+      return NULL;
+    }
+  } else if (c->cache_size != cache_size) {
+    cache_resize(c, cache_size);
+  }
+  owned = c->current_size;
+  meta = c->metadata;
   while (p - buff < size) {
     int len;
 
-    res->entries[i].timestamp = int_rcpy(p);
+    c->entries[i].timestamp = int_rcpy(p);
     p += sizeof(uint32_t);
-    res->entries[i++].id = nodeid_undump(p, &len);
+    if (i < owned) {
+      c->entries[i].id = nodeid_undump_reuse(c->entries[i].id, p, &len);
+    } else {
+      c->entries[i].id = nodeid_undump(p, &len);
+    }
+    i++;
     p += len;
     if (metadata_size) {
       memcpy(meta, p, metadata_size);
@@ -524,10 +620,20 @@ struct peer_cache *entries_undump(const uint8_t *buff, int size)
       meta += metadata_size;
     }
   }
-  res->current_size = i;
+  while (owned > i) {
+    nodeid_free(c->entries[--owned].id);
+    c->entries[owned].id = NULL;
+  }
+  c->current_size = i;
+  index_rebuild(c);
   assert(p - buff == size);
 
-  return res;
+  return c;
+}
+
+struct peer_cache *entries_undump(const uint8_t *buff, int size)
+{
+  return entries_undump_reuse(NULL, buff, size);
 }
 
 int cache_header_dump(uint8_t *b, const struct peer_cache *c, int include_me)
@@ -595,6 +701,7 @@ struct peer_cache *cache_rank (const struct peer_cache *c, ranking_function rank
       res->current_size++;
     }
   }
+  index_rebuild(res);
 
   return res;
 }
@@ -622,6 +729,7 @@ struct peer_cache *cache_union(const struct peer_cache *c1, const struct peer_ca
       meta += new_cache->metadata_size;
     }
     new_cache->entries[new_cache->current_size++] = c1->entries[n];
+    index_add(new_cache, new_cache->current_size - 1);
     c1->entries[n].id = NULL;
   }
   
@@ -637,6 +745,7 @@ struct peer_cache *cache_union(const struct peer_cache *c1, const struct peer_ca
         meta += new_cache->metadata_size;
       }
       new_cache->entries[new_cache->current_size++] = c2->entries[n];
+      index_add(new_cache, new_cache->current_size - 1);
       c2->entries[n].id = NULL;
     }
   }
@@ -664,11 +773,12 @@ int cache_resize (struct peer_cache *c, int size)
     return c->current_size;
   }
 
+  while (c->current_size > size) {
+    nodeid_free(c->entries[--c->current_size].id);
+  }
   c->entries = realloc(c->entries, sizeof(struct cache_entry) * size);
   if (dif > 0) {
     memset(c->entries + c->cache_size, 0, sizeof(struct cache_entry) * dif);
-  } else if (c->current_size > size) {
-    c->current_size = size;
   }
 
   if (c->metadata_size) {
@@ -679,6 +789,10 @@ int cache_resize (struct peer_cache *c, int size)
   }
 
   c->cache_size = size;
+  if (2 * size > c->index_size) {
+    index_alloc(c, size);
+  }
+  index_rebuild(c);
 
   return c->current_size;
 }
@@ -707,6 +821,7 @@ struct peer_cache *merge_caches(const struct peer_cache *c1, const struct peer_c
           meta += new_cache->metadata_size;
         }
         new_cache->entries[new_cache->current_size++] = c2->entries[n2];
+        index_add(new_cache, new_cache->current_size - 1);
         c2->entries[n2].id = NULL;
         *source |= 0x02;
       }
@@ -718,6 +833,7 @@ struct peer_cache *merge_caches(const struct peer_cache *c1, const struct peer_c
           meta += new_cache->metadata_size;
         }
         new_cache->entries[new_cache->current_size++] = c1->entries[n1];
+        index_add(new_cache, new_cache->current_size - 1);
         c1->entries[n1].id = NULL;
         *source |= 0x01;
       }
@@ -730,6 +846,7 @@ struct peer_cache *merge_caches(const struct peer_cache *c1, const struct peer_c
             meta += new_cache->metadata_size;
           }
           new_cache->entries[new_cache->current_size++] = c1->entries[n1];
+          index_add(new_cache, new_cache->current_size - 1);
           c1->entries[n1].id = NULL;
           *source |= 0x01;
         }
@@ -741,6 +858,7 @@ struct peer_cache *merge_caches(const struct peer_cache *c1, const struct peer_c
             meta += new_cache->metadata_size;
           }
           new_cache->entries[new_cache->current_size++] = c2->entries[n2];
+          index_add(new_cache, new_cache->current_size - 1);
           c2->entries[n2].id = NULL;
           *source |= 0x02;
         }
@@ -807,6 +925,7 @@ void cache_randomize(const struct peer_cache *c)
 
     i = j - 1;
   }
+  index_rebuild(c);
 }
 
 void cache_check(const struct peer_cache *c)
@@ -818,11 +937,18 @@ void cache_check(const struct peer_cache *c)
     if (c->entries[i].timestamp < ts) {
       fprintf(stderr, "WTF!!!! %d.ts=%d > %d.ts=%d!!!\n",
               i-1, ts, i, c->entries[i].timestamp);
-      *((char *)0) = 1;
+      abort();
     }
     ts = c->entries[i].timestamp;
     for (j = i + 1; j < c->current_size; j++) {
-      assert(!nodeid_equal(c->entries[i].id, c->entries[j].id));
+      if (nodeid_equal(c->entries[i].id, c->entries[j].id)) {
+        fprintf(stderr, "Cache entries %d and %d are the same node!\n", i, j);
+        abort();
+      }
+    }
+    if (cache_pos(c, c->entries[i].id) != i) {
+      fprintf(stderr, "Cache entry %d is not correctly indexed!\n", i);
+      abort();
     }
   }
 }
@@ -26,6 +26,7 @@ struct peer_cache *rand_cache_except(struct peer_cache *c, int n, struct nodeID
 void cache_randomize(const struct peer_cache *c);
 
 struct peer_cache *entries_undump(const uint8_t *buff, int size);
+struct peer_cache *entries_undump_reuse(struct peer_cache *c, const uint8_t *buff, int size);
 int cache_header_dump(uint8_t *b, const struct peer_cache *c, int include_me);
 int entry_dump(uint8_t *b, const struct peer_cache *e, int i, size_t max_write_size);
 
@@ -42,6 +43,17 @@ int cache_fill_ordered(struct peer_cache *dst, const struct peer_cache *src, int
 
 void cache_check(const struct peer_cache *c);
 
+/*
+ * The cache invariants are verified after every operation only when
+ * compiling with CACHE_CHECKS defined ("make CACHE_CHECKS=1"): cache_check()
+ * is quadratic in the cache size
+ */
+#ifdef CACHE_CHECKS
+#define cache_debug_check(c) cache_check(c)
+#else
+#define cache_debug_check(c)
+#endif
+
 void cache_log(const struct peer_cache *c, const char *name);
 
 int cache_add_cache(struct peer_cache *dst, const struct peer_cache *src);
@@ -10,21 +10,37 @@
 
 #include "chunk.h"
 #include "chunkbuffer.h"
+#include "cb_private.h"
+#include "cb_iface.h"
 
 const struct chunk *cb_get_chunk(const struct chunk_buffer *cb, int id)
 {
-  int i, n;
+  int n, lo, hi;
   const struct chunk *buffer;
 
+  if (cb->ops->get_chunk) {
+    return cb->ops->get_chunk(cb, id);
+  }
+
   buffer = cb_get_chunks(cb, &n);
   if (buffer == NULL) {
     return NULL;
   }
 
-  for (i = 0; i < n; i++) {
+  /* cb_get_chunks() returns the chunks ordered by ID */
+  lo = 0;
+  hi = n - 1;
+  while (lo <= hi) {
+    int i = (lo + hi) / 2;
+
     if (buffer[i].id == id) {
       return &buffer[i];
     }
+    if (buffer[i].id < id) {
+      lo = i + 1;
+    } else {
+      hi = i - 1;
+    }
   }
 
   return NULL;
@@ -0,0 +1,196 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see lgpl-2.1.txt
+ */
+
+/*
+ * Chunk buffer implemented as a ring indexed by chunk ID: chunk "id" is
+ * stored in slot id % size, and the buffer contains the chunks with IDs
+ * in (last - size, last], where last is the largest ID received so far.
+ * Adding, looking up and discarding chunks is O(1); the ordered array
+ * returned by cb_get_chunks() is rebuilt only when the buffer changed.
+ * IDs must not be negative (-1 marks the empty slots), and they can go up
+ * to INT_MAX: the loops scanning the window never step past last.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "chunkbuffer.h"
+#include "cb_private.h"
+#include "cb_iface.h"
+
+struct cb_ring {
+  int first;		/* smallest ID in the buffer */
+  int last;		/* largest ID in the buffer */
+  int dirty;		/* sorted is not up to date */
+  struct chunk *sorted;
+};
+
+static inline struct chunk *slot(const struct chunk_buffer *cb, int id)
+{
+  return &cb->buffer[(unsigned int)id % cb->size];
+}
+
+static int cb_init_ring(struct chunk_buffer *cb)
+{
+  int i;
+
+  cb->ring = malloc(sizeof(struct cb_ring));
+  if (cb->ring == NULL) {
+    return -1;
+  }
+  cb->buffer = malloc(sizeof(struct chunk) * cb->size);
+  cb->ring->sorted = malloc(sizeof(struct chunk) * cb->size);
+  if (cb->buffer == NULL || cb->ring->sorted == NULL) {
+    free(cb->buffer);
+    free(cb->ring->sorted);
+    free(cb->ring);
+
+    return -1;
+  }
+  memset(cb->buffer, 0, sizeof(struct chunk) * cb->size);
+  for (i = 0; i < cb->size; i++) {
+    cb->buffer[i].id = -1;
+  }
+  cb->ring->dirty = 0;
+
+  return 0;
+}
+
+static int cb_clear_ring(struct chunk_buffer *cb)
+{
+  int i;
+
+  for (i = 0; cb->num_chunks && i < cb->size; i++) {
+    if (cb->buffer[i].id >= 0) {
+      chunk_free(&cb->buffer[i]);
+      cb->num_chunks--;
+    }
+  }
+  cb->num_chunks = 0;
+  cb->ring->dirty = 1;
+
+  return 0;
+}
+
+/* Make room for "id", discarding the chunks which exit the window */
+static void advance(struct chunk_buffer *cb, int id)
+{
+  int start = id - cb->size + 1;
+
+  while (cb->ring->first < start && cb->num_chunks) {
+    struct chunk *c = slot(cb, cb->ring->first);
+
+    if (c->id == cb->ring->first) {
+      chunk_free(c);
+      cb->num_chunks--;
+    }
+    cb->ring->first++;
+  }
+  cb->ring->last = id;
+  if (cb->num_chunks == 0) {
+    cb->ring->first = id;
+  } else {
+    /* first might now point to a hole: find the next chunk */
+    while (slot(cb, cb->ring->first)->id != cb->ring->first) {
+      cb->ring->first++;
+    }
+  }
+}
+
+static int cb_add_chunk_ring(struct chunk_buffer *cb, const struct chunk *c)
+{
+  struct chunk *s;
+
+  if (c->id < 0) {
+    return E_CB_OLD;
+  }
+  /* Neither c->id nor last is negative, so the differences cannot overflow */
+  if (cb->num_chunks == 0) {
+    cb->ring->first = cb->ring->last = c->id;
+  } else if (c->id > cb->ring->last) {
+    if (c->id - cb->ring->last >= cb->size) {
+      cb_clear_ring(cb);
+      cb->ring->first = cb->ring->last = c->id;
+    } else {
+      advance(cb, c->id);
+    }
+  } else if (c->id <= cb->ring->last - cb->size) {
+    // check for ID looparound and other anomalies
+    if (slot(cb, cb->ring->first)->timestamp < c->timestamp) {
+      cb_clear_ring(cb);
+      cb->ring->first = cb->ring->last = c->id;
+    } else {
+      return E_CB_OLD;
+    }
+  }
+
+  s = slot(cb, c->id);
+  if (s->id == c->id) {
+    return E_CB_DUPLICATE;
+  }
+  *s = *c;
+  cb->num_chunks++;
+  if (c->id < cb->ring->first) {
+    cb->ring->first = c->id;
+  }
+  cb->ring->dirty = 1;
+
+  return 0;
+}
+
+static struct chunk *cb_get_chunks_ring(const struct chunk_buffer *cb, int *n)
+{
+  *n = cb->num_chunks;
+  if (*n == 0) {
+    return NULL;
+  }
+
+  if (cb->ring->dirty) {
+    int k, i = 0;
+
+    /* k is an offset from first, so that id never goes past last */
+    for (k = 0; i < cb->num_chunks; k++) {
+      int id = cb->ring->first + k;
+
+      if (slot(cb, id)->id == id) {
+        cb->ring->sorted[i++] = *slot(cb, id);
+      }
+    }
+    cb->ring->dirty = 0;
+  }
+
+  return cb->ring->sorted;
+}
+
+static const struct chunk *cb_get_chunk_ring(const struct chunk_buffer *cb, int id)
+{
+  const struct chunk *c;
+
+  if (cb->num_chunks == 0 || id < 0) {
+    return NULL;
+  }
+  c = slot(cb, id);
+
+  return c->id == id ? c : NULL;
+}
+
+static void cb_destroy_ring(struct chunk_buffer *cb)
+{
+  free(cb->ring->sorted);
+  free(cb->ring);
+  free(cb->buffer);
+}
+
+struct cb_ops_iface ring_ops = {
+  .init = cb_init_ring,
+  .add_chunk = cb_add_chunk_ring,
+  .get_chunks = cb_get_chunks_ring,
+  .get_chunk = cb_get_chunk_ring,
+  .clear = cb_clear_ring,
+  .destroy = cb_destroy_ring,
+};
@@ -13,13 +13,11 @@
 #include "chunk.h"
 #include "chunkbuffer.h"
 #include "grapes_config.h"
+#include "cb_private.h"
+#include "cb_iface.h"
 
-struct chunk_buffer {
-  int size;
-  int num_chunks;
-  int flow_id;
-  struct chunk *buffer;
-};
+extern struct cb_ops_iface array_ops;
+extern struct cb_ops_iface ring_ops;
 
 static void insert_sort(struct chunk *b, int size)
 {
@@ -37,15 +35,6 @@ static void insert_sort(struct chunk *b, int size)
   }
 }
 
-static void chunk_free(struct chunk *c)
-{
-    free(c->data);
-    c->data = NULL;
-    free(c->attributes);
-    c->attributes = NULL;
-    c->id = -1;
-}
-
 static int remove_oldest_chunk(struct chunk_buffer *cb, int id, uint64_t ts)
 {
   int i, min, pos_min;
@@ -71,17 +60,34 @@ static int remove_oldest_chunk(struct chunk_buffer *cb, int id, uint64_t ts)
   }
   // check for ID looparound and other anomalies
   if (cb->buffer[pos_min].timestamp < ts) {
-    cb_clear(cb);
+    cb->ops->clear(cb);
     return 0;
   }
   return E_CB_OLD;
 }
 
+static int cb_init_array(struct chunk_buffer *cb)
+{
+  int i;
+
+  cb->buffer = malloc(sizeof(struct chunk) * cb->size);
+  if (cb->buffer == NULL) {
+    return -1;
+  }
+  memset(cb->buffer, 0, sizeof(struct chunk) * cb->size);
+  for (i = 0; i < cb->size; i++) {
+    cb->buffer[i].id = -1;
+  }
+
+  return 0;
+}
+
 struct chunk_buffer *cb_init(const char *config)
 {
   struct tag *cfg_tags;
   struct chunk_buffer *cb;
-  int res, i;
+  const char *type;
+  int res;
 
   cb = malloc(sizeof(struct chunk_buffer));
   if (cb == NULL) {
@@ -95,29 +101,36 @@ struct chunk_buffer *cb_init(const char *config)
     return NULL;
   }
   res = grapes_config_value_int(cfg_tags, "size", &cb->size);
-  if (!res) {
+  if (!res || cb->size <= 0) {
     free(cb);
     free(cfg_tags);
 
     return NULL;
   }
+  cb->ops = &array_ops;
+  type = grapes_config_value_str(cfg_tags, "type");
+  if (type) {
+    if (!strcmp(type, "ring")) {
+      cb->ops = &ring_ops;
+    } else if (strcmp(type, "array")) {
+      free(cb);
+      free(cfg_tags);
+
+      return NULL;
+    }
+  }
   free(cfg_tags);
 
-  cb->buffer = malloc(sizeof(struct chunk) * cb->size);
-  if (cb->buffer == NULL) {
+  if (cb->ops->init(cb) < 0) {
     free(cb);
     return NULL;
   }
-  memset(cb->buffer, 0, sizeof(struct chunk) * cb->size);
-  for (i = 0; i < cb->size; i++) {
-    cb->buffer[i].id = -1;
-  }
 
   cb->flow_id=0;
   return cb;
 }
 
-int cb_add_chunk(struct chunk_buffer *cb, const struct chunk *c)
+static int cb_add_chunk_array(struct chunk_buffer *cb, const struct chunk *c)
 {
   int i;
 
@@ -145,7 +158,7 @@ int cb_add_chunk(struct chunk_buffer *cb, const struct chunk *c)
   }
 }
 
-struct chunk *cb_get_chunks(const struct chunk_buffer *cb, int *n)
+static struct chunk *cb_get_chunks_array(const struct chunk_buffer *cb, int *n)
 {
   *n = cb->num_chunks;
   if (*n == 0) {
@@ -157,7 +170,7 @@ struct chunk *cb_get_chunks(const struct chunk_buffer *cb, int *n)
   return cb->buffer;
 }
 
-int cb_clear(struct chunk_buffer *cb)
+static int cb_clear_array(struct chunk_buffer *cb)
 {
   int i;
 
@@ -169,10 +182,39 @@ int cb_clear(struct chunk_buffer *cb)
   return 0;
 }
 
-void cb_destroy(struct chunk_buffer *cb)
+static void cb_destroy_array(struct chunk_buffer *cb)
 {
-  cb_clear(cb);
   free(cb->buffer);
+}
+
+struct cb_ops_iface array_ops = {
+  .init = cb_init_array,
+  .add_chunk = cb_add_chunk_array,
+  .get_chunks = cb_get_chunks_array,
+  .get_chunk = NULL,
+  .clear = cb_clear_array,
+  .destroy = cb_destroy_array,
+};
+
+int cb_add_chunk(struct chunk_buffer *cb, const struct chunk *c)
+{
+  return cb->ops->add_chunk(cb, c);
+}
+
+struct chunk *cb_get_chunks(const struct chunk_buffer *cb, int *n)
+{
+  return cb->ops->get_chunks(cb, n);
+}
+
+int cb_clear(struct chunk_buffer *cb)
+{
+  return cb->ops->clear(cb);
+}
+
+void cb_destroy(struct chunk_buffer *cb)
+{
+  cb->ops->clear(cb);
+  cb->ops->destroy(cb);
   free(cb);
 }
 
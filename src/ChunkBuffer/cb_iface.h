@@ -0,0 +1,16 @@
+#ifndef CB_IFACE
+#define CB_IFACE
+
+struct chunk_buffer;
+struct chunk;
+
+struct cb_ops_iface {
+  int (*init)(struct chunk_buffer *cb);
+  int (*add_chunk)(struct chunk_buffer *cb, const struct chunk *c);
+  struct chunk *(*get_chunks)(const struct chunk_buffer *cb, int *n);
+  const struct chunk *(*get_chunk)(const struct chunk_buffer *cb, int id);
+  int (*clear)(struct chunk_buffer *cb);
+  void (*destroy)(struct chunk_buffer *cb);
+};
+
+#endif	/* CB_IFACE */
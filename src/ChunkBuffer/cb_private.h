@@ -0,0 +1,26 @@
+#ifndef CB_PRIVATE
+#define CB_PRIVATE
+
+#include "chunk_pool.h"
+
+struct cb_ring;
+
+struct chunk_buffer {
+  int size;
+  int num_chunks;
+  int flow_id;
+  struct chunk *buffer;
+  struct cb_ops_iface *ops;
+  struct cb_ring *ring;
+};
+
+static inline void chunk_free(struct chunk *c)
+{
+    chunk_payload_release(c->data);
+    c->data = NULL;
+    chunk_payload_release(c->attributes);
+    c->attributes = NULL;
+    c->id = -1;
+}
+
+#endif	/* CB_PRIVATE */
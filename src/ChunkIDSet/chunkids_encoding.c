@@ -16,28 +16,60 @@
 #include "trade_sig_la.h"
 #include "int_coding.h"
 
+extern struct cids_encoding_iface prio_encoding;
+extern struct cids_encoding_iface bmap_encoding;
+extern struct cids_encoding_iface ranges_encoding;
+
 static const char *type_name(uint32_t type)
 {
   if (type == CIST_PRIORITY) {
     return "priority";
   } else if (type == CIST_BITMAP) {
     return "bitmap";
+  } else if (type == CIST_RANGES) {
+    return "ranges";
   }
 
   return "Unknown";
 }
 
+/* Pick the encoding producing the smallest message for h */
+static struct cids_encoding_iface *auto_encoding(const struct chunkID_set *h, uint32_t *type)
+{
+  struct cids_encoding_iface *encs[] = {&prio_encoding, &bmap_encoding, &ranges_encoding};
+  uint32_t types[] = {CIST_PRIORITY, CIST_BITMAP, CIST_RANGES};
+  int i, best, best_size;
+
+  best = 0;
+  best_size = encs[0]->size(h);
+  for (i = 1; i < sizeof(encs) / sizeof(encs[0]); i++) {
+    int size = encs[i]->size(h);
+
+    if (size < best_size) {
+      best = i;
+      best_size = size;
+    }
+  }
+  *type = types[best];
+
+  return encs[best];
+}
+
 int encodeChunkSignaling(const struct chunkID_set *h, const void *meta, int meta_len, uint8_t *buff, int buff_len)
 {
   uint8_t *meta_p;
   uint32_t type = h ? h->type : -1;
+  struct cids_encoding_iface *enc = h ? h->enc : NULL;
 
+  if (h && h->type == CIST_AUTO) {
+    enc = auto_encoding(h, &type);
+  }
   int_cpy(buff + 4, type);
-  int_cpy(buff + 8, h->flow_id);
+  int_cpy(buff + 8, h ? h->flow_id : 0);
   int_cpy(buff + 12, meta_len);
 
   if (h) {
-    meta_p = h->enc->encode(h, buff, buff_len, meta_len);
+    meta_p = enc->encode(h, buff, buff_len, meta_len);
   } else {
     int_cpy(buff, 0);
     meta_p = buff + 16;
@@ -67,7 +99,7 @@ struct chunkID_set *decodeChunkSignaling(void **meta, int *meta_len, const uint8
   *meta_len = int_rcpy(buff + 12);
 
   if (type != -1) {
-    char cfg[32];
+    char cfg[64];
 
     memset(cfg, 0, sizeof(cfg));
     sprintf(cfg, "size=%d,type=%s,flow_id=%d", size, type_name(type),flow_id);
@@ -78,6 +110,13 @@ struct chunkID_set *decodeChunkSignaling(void **meta, int *meta_len, const uint8
       return NULL;
     }
     meta_p = h->enc->decode(h, buff, buff_len, meta_len);
+    if (meta_p == NULL) {
+      /* h has been freed by the decoder */
+      *meta = NULL;
+      *meta_len = 0;
+
+      return NULL;
+    }
   } else {
     h = NULL;
     meta_p = buff + 16;
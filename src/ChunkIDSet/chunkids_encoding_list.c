@@ -41,7 +41,13 @@ static const uint8_t *prio_decode(struct chunkID_set *h, const uint8_t *buff, in
   return buff + 16 + h->size * 4;
 }
 
+static int prio_size(const struct chunkID_set *h)
+{
+  return h->n_elements * 4;
+}
+
 struct cids_encoding_iface prio_encoding = {
   .encode = prio_encode,
   .decode = prio_decode,
+  .size = prio_size,
 };
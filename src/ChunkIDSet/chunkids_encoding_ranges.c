@@ -0,0 +1,154 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Range encoding: the (sorted) chunk IDs are described as runs of
+ *  consecutive IDs. Each run is coded as the distance from the end of the
+ *  previous one (the first run starts from 0) and its length, both as
+ *  variable length integers (7 bits per byte, most significant bit set if
+ *  more bytes follow), so a contiguous window costs a few bytes whatever
+ *  its size is, and an isolated ID costs a few bytes wherever it is.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chunkids_private.h"
+#include "chunkids_iface.h"
+#include "int_coding.h"
+#include "chunkidset.h"
+
+static int varint_size(uint32_t v)
+{
+  int n = 1;
+
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+
+  return n;
+}
+
+static uint8_t *varint_cpy(uint8_t *p, uint32_t v)
+{
+  while (v >= 0x80) {
+    *p++ = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+
+  return p;
+}
+
+/* Return the first byte after the integer, or NULL if it does not end
+   before end */
+static const uint8_t *varint_rcpy(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+  int shift;
+
+  *v = 0;
+  for (shift = 0; p < end && shift < 32; shift += 7) {
+    *v |= (uint32_t)(*p & 0x7F) << shift;
+    if ((*p++ & 0x80) == 0) {
+      return p;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Code the runs of h->elements (sorted, since these sets use the set ops)
+ * in *p, if p is not NULL, and return the size of the code
+ */
+static int runs_scan(const struct chunkID_set *h, uint8_t **p)
+{
+  int i, size;
+  uint32_t next;
+
+  size = 0;
+  next = 0;
+  for (i = 0; i < h->n_elements;) {
+    uint32_t start = h->elements[i];
+    int j = i + 1;
+
+    while (j < h->n_elements && h->elements[j] == h->elements[j - 1] + 1) {
+      j++;
+    }
+    size += varint_size(start - next) + varint_size(j - i - 1);
+    if (p) {
+      *p = varint_cpy(*p, start - next);
+      *p = varint_cpy(*p, j - i - 1);
+    }
+    /* The next run cannot start before h->elements[j - 1] + 2 */
+    next = h->elements[j - 1] + 2;
+    i = j;
+  }
+
+  return size;
+}
+
+static int ranges_size(const struct chunkID_set *h)
+{
+  return runs_scan(h, NULL);
+}
+
+static uint8_t *ranges_encode(const struct chunkID_set *h, uint8_t *buff, int buff_len, int meta_len)
+{
+  uint8_t *p;
+
+  int_cpy(buff, h->n_elements);
+  if (buff_len < ranges_size(h) + 16 + meta_len) {
+    return NULL;
+  }
+  p = buff + 16;
+  runs_scan(h, &p);
+
+  return p;
+}
+
+static const uint8_t *ranges_decode(struct chunkID_set *h, const uint8_t *buff, int buff_len, int *meta_len)
+{
+  const uint8_t *p, *end;
+  uint32_t next;
+
+  if (buff_len < 16 + *meta_len) {
+    goto error;
+  }
+  p = buff + 16;
+  end = buff + buff_len - *meta_len;
+  next = 0;
+  while (h->n_elements < h->size) {
+    uint32_t gap, len;
+
+    p = varint_rcpy(p, end, &gap);
+    if (p) {
+      p = varint_rcpy(p, end, &len);
+    }
+    if (p == NULL || len >= h->size - h->n_elements) {
+      goto error;
+    }
+    next += gap;
+    do {
+      h->elements[h->n_elements++] = next++;
+    } while (len--);
+    next++;
+  }
+
+  return p;
+
+error:
+  fprintf(stderr, "Error in decoding chunkid set - wrong length.\n");
+  chunkID_set_free(h);
+
+  return NULL;
+}
+
+struct cids_encoding_iface ranges_encoding = {
+  .encode = ranges_encode,
+  .decode = ranges_decode,
+  .size = ranges_size,
+};
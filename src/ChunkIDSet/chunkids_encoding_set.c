@@ -2,23 +2,86 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <limits.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "chunkids_private.h"
 #include "chunkids_iface.h"
 #include "int_coding.h"
 #include "chunkidset.h"
 
+/*
+ * The bitmap is handled 64 bits at a time: bit k of the (little endian)
+ * word w describes chunk base + 64 * w + k, which is the same as bit k % 8
+ * of byte k / 8 on the wire
+ */
+extern struct cids_ops_iface set_ops;
+
+static inline uint64_t word_load(const uint8_t *p, int len)
+{
+  uint64_t w = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (len >= 8) {
+    memcpy(&w, p, 8);
+
+    return w;
+  }
+#endif
+  if (len > 8) {
+    len = 8;
+  }
+  while (len--) {
+    w = (w << 8) | p[len];
+  }
+
+  return w;
+}
+
+static inline void word_store(uint8_t *p, uint64_t w, int len)
+{
+  int i;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (len >= 8) {
+    memcpy(p, &w, 8);
+
+    return;
+  }
+#endif
+  for (i = 0; i < len && i < 8; i++) {
+    p[i] = w >> (8 * i);
+  }
+}
+
+/* The set ops keep the elements sorted (decoded bitmaps in decreasing order) */
+static int is_sorted(const struct chunkID_set *h)
+{
+  return h->ops == &set_ops;
+}
+
 static uint8_t *bmap_encode(const struct chunkID_set *h, uint8_t *buff, int buff_len, int meta_len)
 {
   int i, elements;
   uint32_t c_min, c_max;
 
-  c_min = c_max = h->n_elements ? h->elements[0] : 0;
-  for (i = 1; i < h->n_elements; i++) {
-    if (h->elements[i] < c_min)
-      c_min = h->elements[i];
-    else if (h->elements[i] > c_max)
-      c_max = h->elements[i];
+  if (is_sorted(h) && h->n_elements) {
+    c_min = h->elements[0];
+    c_max = h->elements[h->n_elements - 1];
+    if (c_min > c_max) {
+      c_min = c_max;
+      c_max = h->elements[0];
+    }
+  } else {
+    c_min = c_max = h->n_elements ? h->elements[0] : 0;
+    for (i = 1; i < h->n_elements; i++) {
+      if (h->elements[i] < c_min)
+        c_min = h->elements[i];
+      else if (h->elements[i] > c_max)
+        c_max = h->elements[i];
+    }
   }
   elements = h->n_elements ? c_max - c_min + 1 : 0;
   int_cpy(buff, elements);
@@ -28,18 +91,101 @@ static uint8_t *bmap_encode(const struct chunkID_set *h, uint8_t *buff, int buff
   }
   int_cpy(buff + 16, c_min); //first value in the bitmap, i.e., base value
   memset(buff + 20, 0, elements);
-  for (i = 0; i < h->n_elements; i++) {
-    buff[20 + (h->elements[i] - c_min) / 8] |= 1 << ((h->elements[i] - c_min) % 8);
+  if (is_sorted(h) && h->n_elements) {
+    /* Visit the chunks in increasing order, so that each word is
+       completed before moving to the next one */
+    int step = h->elements[0] <= h->elements[h->n_elements - 1] ? 1 : -1;
+    int n = h->n_elements;
+    const int *p = step > 0 ? h->elements : h->elements + n - 1;
+    uint64_t w = 0;
+    int cur = 0;
+
+    while (n) {
+      uint32_t off = *p - c_min;
+
+      if (off / 64 != cur) {
+        word_store(buff + 20 + cur * 8, w, elements - cur * 8);
+        w = 0;
+        cur = off / 64;
+      }
+      if (off % 64 == 0 && n >= 64 && (uint32_t)(p[63 * step] - c_min) == off + 63) {
+        /* 64 consecutive chunks */
+        w = ~(uint64_t)0;
+        p += 64 * step;
+        n -= 64;
+        continue;
+      }
+      w |= (uint64_t)1 << (off % 64);
+      p += step;
+      n--;
+    }
+    word_store(buff + 20 + cur * 8, w, elements - cur * 8);
+  } else {
+    for (i = 0; i < h->n_elements; i++) {
+      buff[20 + (h->elements[i] - c_min) / 8] |= 1 << ((h->elements[i] - c_min) % 8);
+    }
   }
 
   return buff + 20 + elements;
 }
 
+/* offsets[b]: the positions of the bits set in byte b, in decreasing order */
+static int32_t offsets[256][8];
+static int offsets_ready;
+
+static void offsets_init(void)
+{
+  int b, i, n;
+
+  for (b = 0; b < 256; b++) {
+    for (i = 7, n = 0; i >= 0; i--) {
+      if (b & (1 << i)) {
+        offsets[b][n++] = i;
+      }
+    }
+  }
+  offsets_ready = 1;
+}
+
+/*
+ * Decode a word with many bits set, a byte at a time (from the last one):
+ * 8 chunk IDs are stored for each byte, and only the first popcount(byte)
+ * of them are kept. out must have room for 8 more IDs than the decoded ones
+ */
+static int *word_decode(int *out, uint64_t w, int base)
+{
+  int j;
+
+  for (j = 7; j >= 0; j--) {
+    uint8_t b = w >> (8 * j);
+#ifdef __AVX2__
+    __m256i v;
+
+    v = _mm256_loadu_si256((const __m256i *)offsets[b]);
+    v = _mm256_add_epi32(v, _mm256_set1_epi32(base + 8 * j));
+    _mm256_storeu_si256((__m256i *)out, v);
+#else
+    int k;
+
+    for (k = 0; k < 8; k++) {
+      out[k] = base + 8 * j + offsets[b][k];
+    }
+#endif
+    out += __builtin_popcount(b);
+  }
+
+  return out;
+}
+
 static const uint8_t *bmap_decode(struct chunkID_set *h, const uint8_t *buff, int buff_len, int *meta_len)
 {
-  int i;
-  int base;
+  int w, n, bits, base;
   int byte_cnt;
+  int *out;
+
+  if (!offsets_ready) {
+    offsets_init();
+  }
 
   byte_cnt = h->size / 8 + (h->size % 8 ? 1 : 0);
   if (buff_len < 20 + byte_cnt + *meta_len) {
@@ -49,15 +195,59 @@ static const uint8_t *bmap_decode(struct chunkID_set *h, const uint8_t *buff, in
     return NULL;
   }
   base = int_rcpy(buff + 16);
-  for (i = h->size - 1; i >= 0; i--) {
-  if (buff[20 + (i / 8)] & 1 << (i % 8))
-    h->elements[h->n_elements++] = base + i;
+  /* From the largest chunk ID to the smallest one */
+  out = h->elements;
+  for (w = (byte_cnt + 7) / 8 - 1; w >= 0; w--) {
+    uint64_t word = word_load(buff + 20 + w * 8, byte_cnt - w * 8);
+
+    n = h->size - w * 64;
+    if (n < 64) {
+      /* Ignore the padding bits */
+      word &= ((uint64_t)1 << n) - 1;
+    }
+    bits = __builtin_popcountll(word);
+    if (bits >= 16 && out + bits + 8 <= h->elements + h->size) {
+      out = word_decode(out, word, base + w * 64);
+      continue;
+    }
+    /* Few bits set: find them one by one */
+    while (word) {
+      int bit = 63 - __builtin_clzll(word);
+
+      *out++ = base + w * 64 + bit;
+      word &= ~((uint64_t)1 << bit);
+    }
   }
+  h->n_elements = out - h->elements;
 
   return buff + 20 + byte_cnt;
 }
 
+static int bmap_size(const struct chunkID_set *h)
+{
+  int i;
+  uint32_t c_min, c_max, elements;
+
+  if (h->n_elements == 0) {
+    return 4;
+  }
+  c_min = c_max = h->elements[0];
+  for (i = 1; i < h->n_elements; i++) {
+    if (h->elements[i] < c_min)
+      c_min = h->elements[i];
+    else if (h->elements[i] > c_max)
+      c_max = h->elements[i];
+  }
+  elements = c_max - c_min + 1;
+  if (elements / 8 > INT_MAX - 5) {
+    return INT_MAX;
+  }
+
+  return 4 + elements / 8 + (elements % 8 ? 1 : 0);
+}
+
 struct cids_encoding_iface bmap_encoding = {
   .encode = bmap_encode,
   .decode = bmap_decode,
+  .size = bmap_size,
 };
@@ -8,8 +8,66 @@
 #include <stdint.h>
 #include <assert.h>
 
+#include "chunkids_private.h"
+#include "chunkids_iface.h"
 #include "chunkidset.h"
 
+extern struct cids_ops_iface set_ops;
+
+/* 1 if the elements of h are increasing, -1 if decreasing (decoded bitmaps), 0 if unsorted */
+static int sort_order(const struct chunkID_set *h)
+{
+  if (h->ops != &set_ops) {
+    return 0;
+  }
+
+  return h->n_elements < 2 || h->elements[0] < h->elements[h->n_elements - 1] ? 1 : -1;
+}
+
+/*
+ * Count the elements of h which are (keep = 1) or are not (keep = 0) in a,
+ * storing them in out (if not NULL; out can be h->elements). If both the
+ * sets are sorted, they are merged in a single pass; otherwise, a is
+ * searched for each element of h
+ */
+static int select_chunks(const struct chunkID_set *h, const struct chunkID_set *a, int keep, int *out)
+{
+  int i, j, n, dir, first, step;
+
+  dir = sort_order(h);
+  if (dir && sort_order(a)) {
+    /* Visit a in the same direction as h */
+    first = sort_order(a) == dir ? 0 : a->n_elements - 1;
+    step = sort_order(a) == dir ? 1 : -1;
+  } else {
+    dir = 0;
+    first = step = 0;
+  }
+
+  for (i = 0, j = 0, n = 0; i < h->n_elements; i++) {
+    int c = h->elements[i];
+    int found;
+
+    if (dir) {
+      while (j < a->n_elements &&
+             (dir > 0 ? a->elements[first + step * j] < c : a->elements[first + step * j] > c)) {
+        j++;
+      }
+      found = j < a->n_elements && a->elements[first + step * j] == c;
+    } else {
+      found = a->ops->check(a, c) >= 0;
+    }
+    if (found == keep) {
+      if (out) {
+        out[n] = c;
+      }
+      n++;
+    }
+  }
+
+  return n;
+}
+
 uint32_t chunkID_set_get_earliest(const struct chunkID_set *h)
 {
   int i;
@@ -50,6 +108,9 @@ int chunkID_set_union(struct chunkID_set *h, struct chunkID_set *a)
 {
   int i;
 
+  if (h->ops == a->ops && h->ops->union_set) {
+    return h->ops->union_set(h, a);
+  }
   for (i = 0; i < chunkID_set_size(a); i++) {
     int ret = chunkID_set_add_chunk(h, chunkID_set_get_chunk(a, i));
     if (ret < 0) return ret;
@@ -57,3 +118,37 @@ int chunkID_set_union(struct chunkID_set *h, struct chunkID_set *a)
 
   return chunkID_set_size(h);
 }
+
+int chunkID_set_intersect(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  if (h->ops->intersect) {
+    return h->ops->intersect(h, a);
+  }
+  h->n_elements = select_chunks(h, a, 1, h->elements);
+
+  return h->n_elements;
+}
+
+int chunkID_set_difference(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  if (h->ops->difference) {
+    return h->ops->difference(h, a);
+  }
+  h->n_elements = select_chunks(h, a, 0, h->elements);
+
+  return h->n_elements;
+}
+
+int chunkID_set_intersect_size(const struct chunkID_set *h, const struct chunkID_set *a)
+{
+  if (h->ops == a->ops && h->ops->intersect_size) {
+    return h->ops->intersect_size(h, a);
+  }
+
+  return select_chunks(h, a, 1, NULL);
+}
+
+int chunkID_set_difference_size(const struct chunkID_set *h, const struct chunkID_set *a)
+{
+  return h->n_elements - chunkID_set_intersect_size(h, a);
+}
@@ -6,10 +6,19 @@ struct chunkID_set;
 struct cids_ops_iface {
   int (*add_chunk)(struct chunkID_set *h, int chunk_id);
   int (*check)(const struct chunkID_set *h, int chunk_id);
+  /* Optional: update private data before the elements are trimmed/cleared */
+  void (*trim)(struct chunkID_set *h, int size);
+  void (*clear)(struct chunkID_set *h, int size);
+  /* Optional: h = h op a (union_set and intersect_size only if a has the same ops) */
+  int (*union_set)(struct chunkID_set *h, const struct chunkID_set *a);
+  int (*intersect)(struct chunkID_set *h, const struct chunkID_set *a);
+  int (*difference)(struct chunkID_set *h, const struct chunkID_set *a);
+  int (*intersect_size)(const struct chunkID_set *h, const struct chunkID_set *a);
 };
 struct cids_encoding_iface {
   uint8_t *(*encode)(const struct chunkID_set *h, uint8_t *buff, int buff_len, int meta_len);
   const uint8_t *(*decode)(struct chunkID_set *h, const uint8_t *buff, int buff_len, int *meta_len);
+  int (*size)(const struct chunkID_set *h);	/* encoded bytes after the header */
 };
 
 #endif	/* CHUNKIDS_IFACE */
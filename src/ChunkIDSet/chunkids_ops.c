@@ -20,8 +20,10 @@
 
 extern struct cids_encoding_iface prio_encoding;
 extern struct cids_encoding_iface bmap_encoding;
+extern struct cids_encoding_iface ranges_encoding;
 extern struct cids_ops_iface list_ops;
 extern struct cids_ops_iface set_ops;
+extern struct cids_ops_iface bitset_ops;
 
 struct chunkID_set *chunkID_set_init(const char *config)
 {
@@ -35,6 +37,9 @@ struct chunkID_set *chunkID_set_init(const char *config)
     return NULL;
   }
   p->n_elements = 0;
+  p->bits = NULL;
+  p->bits_base = 0;
+  p->bits_words = 0;
   cfg_tags = grapes_config_parse(config);
   if (!cfg_tags) {
     free(p);
@@ -69,6 +74,19 @@ struct chunkID_set *chunkID_set_init(const char *config)
       p->enc = &bmap_encoding;
       p->ops = &set_ops;
       p->type = CIST_BITMAP;
+    } else if (!memcmp(type, "bitset", strlen(type) - 1)) {
+      p->enc = &bmap_encoding;
+      p->ops = &bitset_ops;
+      p->type = CIST_BITMAP;
+    } else if (!memcmp(type, "ranges", strlen(type) - 1)) {
+      p->enc = &ranges_encoding;
+      p->ops = &set_ops;
+      p->type = CIST_RANGES;
+    } else if (!memcmp(type, "auto", strlen(type) - 1)) {
+      /* The encoding is chosen by encodeChunkSignaling() */
+      p->enc = &ranges_encoding;
+      p->ops = &set_ops;
+      p->type = CIST_AUTO;
     } else {
       chunkID_set_free(p);
       free(cfg_tags);
@@ -77,7 +95,7 @@ struct chunkID_set *chunkID_set_init(const char *config)
     }
   }
   free(cfg_tags);
-  assert(p->type == CIST_PRIORITY || p->type == CIST_BITMAP);
+  assert(p->type == CIST_PRIORITY || p->type == CIST_BITMAP || p->type == CIST_RANGES || p->type == CIST_AUTO);
 
   return p;
 }
@@ -109,6 +127,9 @@ int chunkID_set_check(const struct chunkID_set *h, int chunk_id)
 
 void chunkID_set_clear(struct chunkID_set *h, int size)
 {
+  if (h->ops->clear) {
+    h->ops->clear(h, size);
+  }
   h->n_elements = 0;
   h->size = size;
   h->elements = realloc(h->elements, size * sizeof(int));
@@ -127,6 +148,9 @@ void chunkID_set_free(struct chunkID_set *h)
 void chunkID_set_trim(struct chunkID_set *h, int size)
 {
   if (h->n_elements > size) {
+    if (h->ops->trim) {
+      h->ops->trim(h, size);
+    }
     memmove(h->elements, h->elements + h->n_elements - size, sizeof(h->elements[0]) * size);
     h->n_elements = size;
   }
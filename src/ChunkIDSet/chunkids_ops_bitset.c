@@ -0,0 +1,303 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Bitset sets: membership is stored in a window of bits starting from a
+ *  base chunk ID (a multiple of 64), so adding and checking a chunk ID
+ *  cost O(1). The window grows geometrically to cover new chunk IDs, and
+ *  slides forward when the oldest chunk IDs are trimmed away.
+ *  The elements array is kept as well (in insertion order, as in the list
+ *  sets), so that the chunk IDs can be enumerated and encoded as usual.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+
+#include "chunkids_private.h"
+#include "chunkids_iface.h"
+
+#define DEFAULT_SIZE_INCREMENT 32
+
+/* The window covers the chunk IDs from bits_base to bits_base + 64 * bits_words - 1 */
+static inline int64_t window_end(const struct chunkID_set *h)
+{
+  return (int64_t)h->bits_base + 64 * (int64_t)h->bits_words;
+}
+
+static inline int64_t floor64(int64_t id)
+{
+  return id >= 0 ? id / 64 * 64 : -((-id + 63) / 64 * 64);
+}
+
+static inline int bit_test(const struct chunkID_set *h, int chunk_id)
+{
+  int64_t off = (int64_t)chunk_id - h->bits_base;
+
+  if (off < 0 || off >= 64 * (int64_t)h->bits_words) {
+    return 0;
+  }
+
+  return (h->bits[off / 64] >> (off % 64)) & 1;
+}
+
+/* Make sure that the window covers the chunk IDs from lo to hi */
+static int window_cover(struct chunkID_set *h, int lo, int hi)
+{
+  int64_t base, end, new_base, new_end;
+  uint64_t *bits;
+
+  base = floor64(lo);
+  end = floor64(hi) + 64;
+  if (h->bits_words == 0) {
+    new_base = base;
+    new_end = end;
+  } else {
+    if (base >= h->bits_base && end <= window_end(h)) {
+      return 0;
+    }
+    new_base = base < h->bits_base ? base : h->bits_base;
+    new_end = end > window_end(h) ? end : window_end(h);
+    /* Grow at least by a factor 2, in the direction the window is moving */
+    if (new_end - new_base < 128 * (int64_t)h->bits_words) {
+      if (new_end > window_end(h)) {
+        new_end = new_base + 128 * (int64_t)h->bits_words;
+      } else {
+        new_base = new_end - 128 * (int64_t)h->bits_words;
+      }
+    }
+    if (new_base < INT_MIN) {
+      new_base = INT_MIN;
+    }
+  }
+  if ((new_end - new_base) / 64 > INT_MAX / sizeof(uint64_t)) {
+    return -1;
+  }
+
+  bits = calloc((new_end - new_base) / 64, sizeof(uint64_t));
+  if (bits == NULL) {
+    return -1;
+  }
+  if (h->bits_words) {
+    memcpy(bits + (h->bits_base - new_base) / 64, h->bits, h->bits_words * sizeof(uint64_t));
+  }
+  free(h->bits);
+  h->bits = bits;
+  h->bits_base = new_base;
+  h->bits_words = (new_end - new_base) / 64;
+
+  return 0;
+}
+
+static int elements_reserve(struct chunkID_set *h, int n)
+{
+  uint32_t size;
+  int *res;
+
+  if (h->n_elements + n <= h->size) {
+    return 0;
+  }
+  /* Geometric growth, so that adding a chunk ID costs O(1) */
+  size = h->size ? h->size * 2 : DEFAULT_SIZE_INCREMENT;
+  if (size < h->n_elements + n) {
+    size = h->n_elements + n;
+  }
+  res = realloc(h->elements, size * sizeof(int));
+  if (res == NULL) {
+    return -1;
+  }
+  h->size = size;
+  h->elements = res;
+
+  return 0;
+}
+
+/* Drop the elements which are not in the bitset anymore, keeping their order */
+static void elements_filter(struct chunkID_set *h)
+{
+  int i, n;
+
+  for (i = 0, n = 0; i < h->n_elements; i++) {
+    if (bit_test(h, h->elements[i])) {
+      h->elements[n++] = h->elements[i];
+    }
+  }
+  h->n_elements = n;
+}
+
+/* Keep the elements of h which are (keep = 1) or are not (keep = 0) in a, of a different type */
+static void elements_select(struct chunkID_set *h, const struct chunkID_set *a, int keep)
+{
+  int i, n;
+
+  for (i = 0, n = 0; i < h->n_elements; i++) {
+    int c = h->elements[i];
+
+    if ((a->ops->check(a, c) >= 0) == keep) {
+      h->elements[n++] = c;
+    } else {
+      int64_t off = (int64_t)c - h->bits_base;
+
+      h->bits[off / 64] &= ~((uint64_t)1 << (off % 64));
+    }
+  }
+  h->n_elements = n;
+}
+
+static int chunkID_set_check_bitset(const struct chunkID_set *h, int chunk_id)
+{
+  /* The position in the elements array is not tracked */
+  return bit_test(h, chunk_id) ? 0 : -1;
+}
+
+static int chunkID_set_add_chunk_bitset(struct chunkID_set *h, int chunk_id)
+{
+  int64_t off;
+
+  if (bit_test(h, chunk_id)) {
+    return 0;
+  }
+  if (window_cover(h, chunk_id, chunk_id) < 0 || elements_reserve(h, 1) < 0) {
+    return -1;
+  }
+  off = (int64_t)chunk_id - h->bits_base;
+  h->bits[off / 64] |= (uint64_t)1 << (off % 64);
+  h->elements[h->n_elements++] = chunk_id;
+
+  return h->n_elements;
+}
+
+static void chunkID_set_trim_bitset(struct chunkID_set *h, int size)
+{
+  int i, first;
+
+  for (i = 0; i < h->n_elements - size; i++) {
+    int64_t off = (int64_t)h->elements[i] - h->bits_base;
+
+    h->bits[off / 64] &= ~((uint64_t)1 << (off % 64));
+  }
+  /* Slide the window forward, so that it does not grow with the stream */
+  for (first = 0; first < h->bits_words && h->bits[first] == 0; first++);
+  if (first == h->bits_words) {
+    memset(h->bits, 0, h->bits_words * sizeof(uint64_t));
+  } else if (first) {
+    memmove(h->bits, h->bits + first, (h->bits_words - first) * sizeof(uint64_t));
+    memset(h->bits + h->bits_words - first, 0, first * sizeof(uint64_t));
+    h->bits_base += 64 * first;
+  }
+}
+
+static void chunkID_set_clear_bitset(struct chunkID_set *h, int size)
+{
+  if (size && h->bits_words) {
+    memset(h->bits, 0, h->bits_words * sizeof(uint64_t));
+  } else {
+    free(h->bits);
+    h->bits = NULL;
+    h->bits_words = 0;
+  }
+}
+
+static int chunkID_set_union_bitset(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  int i, first, last, new_chunks;
+  uint64_t *w;
+
+  if (a->n_elements == 0) {
+    return h->n_elements;
+  }
+  /* Only the part of the window of a containing its chunk IDs is needed */
+  for (first = 0; a->bits[first] == 0; first++);
+  for (last = a->bits_words - 1; a->bits[last] == 0; last--);
+  if (window_cover(h, a->bits_base + 64 * first, a->bits_base + 64 * last + 63) < 0) {
+    return -1;
+  }
+  w = h->bits + ((int64_t)a->bits_base - h->bits_base) / 64;
+  new_chunks = 0;
+  for (i = first; i <= last; i++) {
+    new_chunks += __builtin_popcountll(a->bits[i] & ~w[i]);
+  }
+  if (elements_reserve(h, new_chunks) < 0) {
+    return -1;
+  }
+
+  /* The new chunk IDs are added in increasing order */
+  for (i = first; i <= last; i++) {
+    uint64_t added = a->bits[i] & ~w[i];
+
+    w[i] |= a->bits[i];
+    while (added) {
+      h->elements[h->n_elements++] = a->bits_base + 64 * i + __builtin_ctzll(added);
+      added &= added - 1;
+    }
+  }
+
+  return h->n_elements;
+}
+
+static int chunkID_set_intersect_bitset(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  int i;
+
+  if (a->ops != h->ops) {
+    elements_select(h, a, 1);
+
+    return h->n_elements;
+  }
+  for (i = 0; i < h->bits_words; i++) {
+    int64_t j = ((int64_t)h->bits_base - a->bits_base) / 64 + i;
+
+    h->bits[i] &= (j >= 0 && j < a->bits_words) ? a->bits[j] : 0;
+  }
+  elements_filter(h);
+
+  return h->n_elements;
+}
+
+static int chunkID_set_difference_bitset(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  int i;
+
+  if (a->ops != h->ops) {
+    elements_select(h, a, 0);
+
+    return h->n_elements;
+  }
+  for (i = 0; i < h->bits_words; i++) {
+    int64_t j = ((int64_t)h->bits_base - a->bits_base) / 64 + i;
+
+    if (j >= 0 && j < a->bits_words) {
+      h->bits[i] &= ~a->bits[j];
+    }
+  }
+  elements_filter(h);
+
+  return h->n_elements;
+}
+
+static int chunkID_set_intersect_size_bitset(const struct chunkID_set *h, const struct chunkID_set *a)
+{
+  int i, n;
+
+  for (i = 0, n = 0; i < h->bits_words; i++) {
+    int64_t j = ((int64_t)h->bits_base - a->bits_base) / 64 + i;
+
+    if (j >= 0 && j < a->bits_words) {
+      n += __builtin_popcountll(h->bits[i] & a->bits[j]);
+    }
+  }
+
+  return n;
+}
+
+struct cids_ops_iface bitset_ops = {
+  .add_chunk = chunkID_set_add_chunk_bitset,
+  .check = chunkID_set_check_bitset,
+  .trim = chunkID_set_trim_bitset,
+  .clear = chunkID_set_clear_bitset,
+  .union_set = chunkID_set_union_bitset,
+  .intersect = chunkID_set_intersect_bitset,
+  .difference = chunkID_set_difference_bitset,
+  .intersect_size = chunkID_set_intersect_size_bitset,
+};
@@ -14,9 +14,21 @@ static int int_cmp(const void *pa, const void *pb)
   return (*(const int *)pa - *(const int *)pb);
 }
 
+static int int_rcmp(const void *pa, const void *pb)
+{
+  return (*(const int *)pb - *(const int *)pa);
+}
+
+/* Decoded bitmaps are sorted in decreasing order */
+static int is_descending(const struct chunkID_set *h)
+{
+  return h->n_elements > 1 && h->elements[0] > h->elements[h->n_elements - 1];
+}
+
 static int check_insert_pos(const struct chunkID_set *h, int id)
 {
   int a, b, c, r;
+  int (*cmp)(const void *, const void *) = is_descending(h) ? int_rcmp : int_cmp;
 
   if (! h->n_elements) {
     return 0;
@@ -25,7 +37,7 @@ static int check_insert_pos(const struct chunkID_set *h, int id)
   a = 0;
   b = c = h->n_elements - 1;
 
-  while ((r = int_cmp(&id, &h->elements[b])) != 0) {
+  while ((r = cmp(&id, &h->elements[b])) != 0) {
     if (r > 0) {
       if (b == c) {
         return b + 1;
@@ -78,7 +90,10 @@ static int chunkID_set_check_set(const struct chunkID_set *h, int chunk_id)
 {
   int *p;
 
-  p = bsearch(&chunk_id, h->elements, (size_t) h->n_elements, sizeof(h->elements[0]), int_cmp);
+  if (h->n_elements == 0) {
+    return -1;
+  }
+  p = bsearch(&chunk_id, h->elements, (size_t) h->n_elements, sizeof(h->elements[0]), is_descending(h) ? int_rcmp : int_cmp);
   return p ? p - h->elements : -1;
 }
 
@@ -3,6 +3,8 @@
 
 #define CIST_BITMAP 1
 #define CIST_PRIORITY 2
+#define CIST_RANGES 3
+#define CIST_AUTO 4	/* encoded as the smallest of the above (never on the wire) */
 
 struct chunkID_set {
   uint32_t type;
@@ -12,6 +14,9 @@ struct chunkID_set {
   struct cids_ops_iface *ops;
   struct cids_encoding_iface *enc;
   int flow_id;
+  uint64_t *bits;	/* bitset sets: bit i is chunk bits_base + i */
+  int bits_base;
+  uint32_t bits_words;
 };
 
 #endif /* CHUNKID_SET_PRIVATE */
@@ -6,6 +6,9 @@
  */
 #include <stdlib.h>
 #include <stdint.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 #include "int_coding.h"
 #include "chunk.h"
@@ -32,6 +35,52 @@ int parseChunkMsg(const uint8_t *buff, int buff_len, struct chunk *c, uint16_t *
   return 1;
 }
 
+int parseChunkMsgAdopt(uint8_t *buff, int buff_len, struct chunk *c, uint16_t *transid)
+{
+  int res;
+
+  if (c == NULL) {
+    return -1;
+  }
+
+  res = decodeChunkAdopt(c, buff + sizeof(*transid), buff_len - sizeof(*transid));
+  if (res < 0) {
+    return -1;
+  }
+
+  *transid = int16_rcpy(buff);
+
+  return 1;
+}
+
+/*
+ * Prepare the message header (type, transaction ID and chunk header) and
+ * the iovec describing the whole message, pointing to the chunk payload
+ */
+static int chunk_msg_iov(struct iovec *iov, uint8_t *hdr, const struct chunk *c, uint16_t transid)
+{
+  int n;
+
+  hdr[0] = MSG_TYPE_CHUNK;
+  int16_cpy(hdr + 1, transid);
+  if (encodeChunkHeader(c, hdr + 1 + sizeof(transid), CHUNK_HEADER_SIZE) < 0) {
+    return -1;
+  }
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = 1 + sizeof(transid) + CHUNK_HEADER_SIZE;
+  n = 1;
+  if (c->size > 0) {
+    iov[n].iov_base = c->data;
+    iov[n++].iov_len = c->size;
+  }
+  if (c->attributes_size > 0) {
+    iov[n].iov_base = c->attributes;
+    iov[n++].iov_len = c->attributes_size;
+  }
+
+  return n;
+}
+
 /**
  * Send a Chunk to a target Peer
  *
@@ -41,31 +90,33 @@ int parseChunkMsg(const uint8_t *buff, int buff_len, struct chunk *c, uint16_t *
  * @param[in] c Chunk to send
  * @return 0 on success, <0 on error
  */
-//TO CHECK AND CORRECT
-//XXX Send data is in char while our buffer is in uint8
 int sendChunk(const struct nodeID * localID, const struct nodeID *to, const struct chunk *c, uint16_t transid)
 {
-  int buff_len;
-  uint8_t *buff;
-  int res;
+  uint8_t hdr[1 + sizeof(transid) + CHUNK_HEADER_SIZE];
+  struct iovec iov[3];
+  int n;
 
-  buff_len  = CHUNK_HEADER_SIZE + sizeof(transid) + c->size + c->attributes_size;
-  buff = malloc(buff_len + 1);
-  if (buff == NULL) {
-      return -1;
+  n = chunk_msg_iov(iov, hdr, c, transid);
+  if (n < 0) {
+    return -2;
   }
-  buff[0] = MSG_TYPE_CHUNK;
-  int16_cpy(buff + 1, transid);
-  res = encodeChunk(c, buff + 1 + sizeof(transid), buff_len);
-  if (res < 0) {
-    free(buff);
+  send_to_peer_iov(localID, to, iov, n);
 
+  return EXIT_SUCCESS;
+}
+
+int sendChunkToPeers(const struct nodeID *localID, struct nodeID * const *to, int n, const struct chunk *c, uint16_t transid)
+{
+  uint8_t hdr[1 + sizeof(transid) + CHUNK_HEADER_SIZE];
+  struct iovec iov[3];
+  int iovcnt;
+
+  iovcnt = chunk_msg_iov(iov, hdr, c, transid);
+  if (iovcnt < 0) {
     return -2;
   }
-  send_to_peer(localID, to, buff, buff_len + 1);
-  free(buff);
 
-  return EXIT_SUCCESS;
+  return send_to_peers_iov(localID, to, n, iov, iovcnt);
 }
 
 int chunkDeliveryInit(struct nodeID *myID)
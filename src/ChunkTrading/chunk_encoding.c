@@ -11,15 +11,16 @@
 #include <stdint.h>
 
 #include "chunk.h"
+#include "chunk_pool.h"
 #include "trade_msg_la.h"
 #include "int_coding.h"
 
 
-int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len)
+int encodeChunkHeader(const struct chunk *c, uint8_t *buff, int buff_len)
 {
   uint32_t half_ts;
 
-  if (buff_len < CHUNK_HEADER_SIZE + c->size + c->attributes_size) {
+  if (buff_len < CHUNK_HEADER_SIZE) {
     /* Not enough space... */
     return -1;
   }
@@ -33,6 +34,17 @@ int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len)
   int_cpy(buff + 16, c->attributes_size);
   int_cpy(buff + 20, c->flow_id);
 
+  return CHUNK_HEADER_SIZE;
+}
+
+int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len)
+{
+  if (buff_len < CHUNK_HEADER_SIZE + c->size + c->attributes_size) {
+    /* Not enough space... */
+    return -1;
+  }
+
+  encodeChunkHeader(c, buff, buff_len);
   memcpy(buff + CHUNK_HEADER_SIZE, c->data, c->size);
   if (c->attributes_size) {
     memcpy(buff + CHUNK_HEADER_SIZE + c->size, c->attributes, c->attributes_size);
@@ -41,7 +53,7 @@ int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len)
   return CHUNK_HEADER_SIZE + c->size + c->attributes_size;
 }
 
-int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
+static int decode_header(struct chunk *c, const uint8_t *buff, int buff_len)
 {
   if (buff_len < CHUNK_HEADER_SIZE) {
     return -1;
@@ -53,10 +65,26 @@ int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
   c->size = int_rcpy(buff + 12);
   c->attributes_size = int_rcpy(buff + 16);
   c->flow_id = int_rcpy(buff + 20);
+  c->attributes = NULL;
 
   if (buff_len < c->size + CHUNK_HEADER_SIZE) {
     return -2;
   }
+  if (c->attributes_size > 0 && buff_len < CHUNK_HEADER_SIZE + c->size + c->attributes_size) {
+    return -4;
+  }
+
+  return 0;
+}
+
+int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
+{
+  int res;
+
+  res = decode_header(c, buff, buff_len);
+  if (res < 0) {
+    return res;
+  }
   c->data = malloc(c->size);
   if (c->data == NULL) {
     return -3;
@@ -64,11 +92,11 @@ int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
   memcpy(c->data, buff + CHUNK_HEADER_SIZE, c->size);
 
   if (c->attributes_size > 0) {
-    if (buff_len < c->size + c->attributes_size) {
-      return -4;
-    }
     c->attributes = malloc(c->attributes_size);
     if (c->attributes == NULL) {
+      free(c->data);
+      c->data = NULL;
+
       return -5;
     }
     memcpy(c->attributes, buff + CHUNK_HEADER_SIZE + c->size, c->attributes_size);
@@ -76,3 +104,23 @@ int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
 
   return CHUNK_HEADER_SIZE + c->size + c->attributes_size;
 }
+
+int decodeChunkAdopt(struct chunk *c, uint8_t *buff, int buff_len)
+{
+  int res;
+
+  res = decode_header(c, buff, buff_len);
+  if (res < 0) {
+    return res;
+  }
+  if (chunk_payload_ref(buff) == NULL) {
+    /* Not pool memory: it cannot be shared */
+    return decodeChunk(c, buff, buff_len);
+  }
+  c->data = buff + CHUNK_HEADER_SIZE;
+  if (c->attributes_size > 0) {
+    c->attributes = chunk_payload_ref(buff + CHUNK_HEADER_SIZE + c->size);
+  }
+
+  return CHUNK_HEADER_SIZE + c->size + c->attributes_size;
+}
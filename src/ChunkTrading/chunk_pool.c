@@ -0,0 +1,277 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see lgpl-2.1.txt
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "chunk_pool.h"
+#include "grapes_config.h"
+
+#define DEFAULT_MIN_SIZE 1024
+#define DEFAULT_MAX_SIZE (64 * 1024)
+#define DEFAULT_SLAB_BLOCKS 32
+#define MAX_CLASSES 24
+
+struct slab {
+  uint8_t *base;
+  int shift;		/* log2 of the block size */
+  int blocks;
+  int *refcnt;
+};
+
+struct pool {
+  int min_shift;
+  int classes;
+  int slab_blocks;
+  uint8_t *free_list[MAX_CLASSES];	/* next pointer stored in the free block */
+  struct slab *slabs;	/* sorted by base address */
+  int n_slabs;
+};
+
+static struct pool *pool;
+
+/* The free lists and the reference counters are shared by all the threads */
+#ifndef _WIN32
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+#define POOL_LOCK() pthread_mutex_lock(&pool_lock)
+#define POOL_UNLOCK() pthread_mutex_unlock(&pool_lock)
+#else
+#define POOL_LOCK()
+#define POOL_UNLOCK()
+#endif
+
+static int log2_ceil(int n)
+{
+  int s = 0;
+
+  while ((1 << s) < n) {
+    s++;
+  }
+
+  return s;
+}
+
+int chunk_pool_init(const char *config)
+{
+  struct tag *cfg_tags;
+  int min_size, max_size, slab_blocks, max_shift;
+
+  if (pool) {
+    return -1;
+  }
+  min_size = DEFAULT_MIN_SIZE;
+  max_size = DEFAULT_MAX_SIZE;
+  slab_blocks = DEFAULT_SLAB_BLOCKS;
+  cfg_tags = grapes_config_parse(config);
+  if (cfg_tags) {
+    grapes_config_value_int(cfg_tags, "min_size", &min_size);
+    grapes_config_value_int(cfg_tags, "max_size", &max_size);
+    grapes_config_value_int(cfg_tags, "slab_blocks", &slab_blocks);
+    free(cfg_tags);
+  }
+  if (min_size < (int)sizeof(uint8_t *) || max_size < min_size || slab_blocks <= 0) {
+    return -2;
+  }
+  max_shift = log2_ceil(max_size);
+  if (max_shift >= 30) {
+    return -2;
+  }
+
+  pool = malloc(sizeof(struct pool));
+  if (pool == NULL) {
+    return -3;
+  }
+  memset(pool, 0, sizeof(struct pool));
+  pool->min_shift = log2_ceil(min_size);
+  pool->classes = max_shift - pool->min_shift + 1;
+  if (pool->classes > MAX_CLASSES) {
+    free(pool);
+    pool = NULL;
+
+    return -2;
+  }
+  pool->slab_blocks = slab_blocks;
+
+  return 0;
+}
+
+static struct slab *slab_find(const void *p, int *block)
+{
+  const uint8_t *q = p;
+  int lo, hi;
+
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  lo = 0;
+  hi = pool->n_slabs - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    struct slab *s = &pool->slabs[mid];
+
+    if (q < s->base) {
+      hi = mid - 1;
+    } else if (q >= s->base + ((size_t)s->blocks << s->shift)) {
+      lo = mid + 1;
+    } else {
+      *block = (q - s->base) >> s->shift;
+
+      return s;
+    }
+  }
+
+  return NULL;
+}
+
+static int slab_add(int c)
+{
+  struct slab *s, *new_slabs;
+  int shift = pool->min_shift + c;
+  int i, pos;
+
+  new_slabs = realloc(pool->slabs, (pool->n_slabs + 1) * sizeof(struct slab));
+  if (new_slabs == NULL) {
+    return -1;
+  }
+  pool->slabs = new_slabs;
+
+  s = &pool->slabs[pool->n_slabs];
+  s->base = malloc((size_t)pool->slab_blocks << shift);
+  s->refcnt = calloc(pool->slab_blocks, sizeof(int));
+  if (s->base == NULL || s->refcnt == NULL) {
+    free(s->base);
+    free(s->refcnt);
+
+    return -1;
+  }
+  s->shift = shift;
+  s->blocks = pool->slab_blocks;
+  for (i = s->blocks - 1; i >= 0; i--) {
+    uint8_t *b = s->base + ((size_t)i << shift);
+
+    memcpy(b, &pool->free_list[c], sizeof(uint8_t *));
+    pool->free_list[c] = b;
+  }
+
+  /* Keep the slabs sorted, so that slab_find() can bisect */
+  for (pos = pool->n_slabs; pos > 0 && pool->slabs[pos - 1].base > s->base; pos--);
+  if (pos != pool->n_slabs) {
+    struct slab tmp = *s;
+
+    memmove(&pool->slabs[pos + 1], &pool->slabs[pos], (pool->n_slabs - pos) * sizeof(struct slab));
+    pool->slabs[pos] = tmp;
+  }
+  pool->n_slabs++;
+
+  return 0;
+}
+
+uint8_t *chunk_payload_alloc(int size)
+{
+  struct slab *s;
+  uint8_t *b;
+  int c, i;
+
+  if (size <= 0) {
+    size = 1;
+  }
+  if (pool == NULL) {
+    return malloc(size);
+  }
+  c = log2_ceil(size) - pool->min_shift;
+  if (c < 0) {
+    c = 0;
+  }
+  if (c >= pool->classes) {
+    return malloc(size);
+  }
+
+  POOL_LOCK();
+  if (pool->free_list[c] == NULL && slab_add(c) < 0) {
+    POOL_UNLOCK();
+
+    return NULL;
+  }
+  b = pool->free_list[c];
+  memcpy(&pool->free_list[c], b, sizeof(uint8_t *));
+  s = slab_find(b, &i);
+  s->refcnt[i] = 1;
+  POOL_UNLOCK();
+
+  return b;
+}
+
+void *chunk_payload_ref(void *p)
+{
+  struct slab *s;
+  int i;
+
+  POOL_LOCK();
+  s = slab_find(p, &i);
+  if (s) {
+    s->refcnt[i]++;
+  }
+  POOL_UNLOCK();
+
+  return s ? p : NULL;
+}
+
+void chunk_payload_release(void *p)
+{
+  struct slab *s;
+  int i;
+
+  if (p == NULL) {
+    return;
+  }
+  POOL_LOCK();
+  s = slab_find(p, &i);
+  if (s && --s->refcnt[i] == 0) {
+    uint8_t *b = s->base + ((size_t)i << s->shift);
+    int c = s->shift - pool->min_shift;
+
+    memcpy(b, &pool->free_list[c], sizeof(uint8_t *));
+    pool->free_list[c] = b;
+  }
+  POOL_UNLOCK();
+  if (s == NULL) {
+    free(p);
+  }
+}
+
+int chunk_pool_destroy(void)
+{
+  int i, j;
+
+  if (pool == NULL) {
+    return 0;
+  }
+  /*
+   * A block still in use would later be released with free(), possibly
+   * through a pointer inside it (see decodeChunkAdopt()): keep the pool
+   */
+  for (i = 0; i < pool->n_slabs; i++) {
+    for (j = 0; j < pool->slabs[i].blocks; j++) {
+      if (pool->slabs[i].refcnt[j]) {
+        return -1;
+      }
+    }
+  }
+  for (i = 0; i < pool->n_slabs; i++) {
+    free(pool->slabs[i].base);
+    free(pool->slabs[i].refcnt);
+  }
+  free(pool->slabs);
+  free(pool);
+  pool = NULL;
+
+  return 0;
+}
@@ -22,6 +22,7 @@
 #include "trade_sig_la.h"
 #include "trade_sig_ha.h"
 #include "int_coding.h"
+#include "grapes_config.h"
 
 //Type of signaling message
 //Request a ChunkIDSet
@@ -38,10 +39,15 @@
 #define MSG_SIG_ACK 11
 //Request the BufferMap
 #define MSG_SIG_BMREQ 12
+//Receive the changes to the last full BufferMap
+#define MSG_SIG_BMDELTA 13
 
 #define SIG_META_LEN 1024
 #define SIG_BUF_LEN 2048
 
+#define DEFAULT_BMAP_REFRESH 10
+#define DEFAULT_BMAP_PEERS 64
+
 struct sig_nal {
   uint8_t type;//type of signal.
   uint8_t max_deliver;//Max number of chunks to deliver.
@@ -51,11 +57,208 @@ struct sig_nal {
 } __attribute__((packed));
 
 
+/*
+ * Delta buffer maps (see chunkSignalingConfig()). In delta mode, full
+ * buffer maps are sent as usual, and the following buffer maps to the
+ * same peer only carry the chunks added to and removed from the last full
+ * one, until the next full map (sent after bmap_refresh deltas, or when it
+ * is smaller than the delta). Deltas always refer to the last full map, so
+ * losing one of them does not affect the following ones; a delta carries
+ * a hash of the full map it refers to, so that a receiver which lost that
+ * full map notices it.
+ * Both sides keep the last full map per peer: the sender indexes it by
+ * destination, the receiver by owner
+ */
+struct bmap_state {
+  struct nodeID *peer;		/* NULL if the entry is free */
+  uint32_t hash;		/* of chunks */
+  int *chunks;			/* sorted */
+  int n_chunks;
+  int deltas;			/* sent since the full map */
+  uint64_t used;
+};
+
+static int bmap_delta;
+static int bmap_refresh = DEFAULT_BMAP_REFRESH;
+static int bmap_peers = DEFAULT_BMAP_PEERS;
+static struct bmap_state *sent_maps, *received_maps;
+static uint64_t bmap_clock;
+
+static int int_cmp(const void *a, const void *b)
+{
+  int x = *(const int *)a, y = *(const int *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* The chunk IDs of s, sorted */
+static int *chunks_sort(const struct chunkID_set *s, int *n)
+{
+  int *chunks, i;
+
+  *n = s ? chunkID_set_size(s) : 0;
+  chunks = malloc((*n ? *n : 1) * sizeof(int));
+  if (chunks == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < *n; i++) {
+    chunks[i] = chunkID_set_get_chunk(s, i);
+  }
+  qsort(chunks, *n, sizeof(int), int_cmp);
+
+  return chunks;
+}
+
+/* FNV-1a hash of a sorted array of chunk IDs */
+static uint32_t chunks_hash(const int *chunks, int n)
+{
+  uint32_t h = 2166136261U;
+  int i, k;
+
+  for (i = 0; i < n; i++) {
+    for (k = 0; k < 32; k += 8) {
+      h = (h ^ (((uint32_t)chunks[i] >> k) & 0xff)) * 16777619U;
+    }
+  }
+
+  return h;
+}
+
+static void bmap_state_clear(struct bmap_state *st)
+{
+  nodeid_free(st->peer);
+  free(st->chunks);
+  memset(st, 0, sizeof(struct bmap_state));
+}
+
+/* Find the entry of peer, or allocate one (evicting the least recently used) if create */
+static struct bmap_state *bmap_state_get(struct bmap_state **table, const struct nodeID *peer, int create)
+{
+  struct bmap_state *lru;
+  int i;
+
+  if (*table == NULL) {
+    if (!create) {
+      return NULL;
+    }
+    *table = calloc(bmap_peers, sizeof(struct bmap_state));
+    if (*table == NULL) {
+      return NULL;
+    }
+  }
+  lru = &(*table)[0];
+  for (i = 0; i < bmap_peers; i++) {
+    struct bmap_state *st = &(*table)[i];
+
+    if (st->peer && nodeid_equal(st->peer, peer)) {
+      st->used = ++bmap_clock;
+
+      return st;
+    }
+    if (lru->peer && (st->peer == NULL || st->used < lru->used)) {
+      lru = st;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  if (lru->peer) {
+    bmap_state_clear(lru);
+  }
+  lru->peer = nodeid_dup(peer);
+  lru->used = ++bmap_clock;
+
+  return lru;
+}
+
+static void bmap_state_set(struct bmap_state *st, int *chunks, int n)
+{
+  free(st->chunks);
+  st->hash = chunks_hash(chunks, n);
+  st->chunks = chunks;
+  st->n_chunks = n;
+  st->deltas = 0;
+}
+
 int chunkSignalingInit(struct nodeID *myID)
 {
   return 1;
 }
 
+int chunkSignalingConfig(const char *config)
+{
+  struct tag *cfg_tags;
+
+  cfg_tags = grapes_config_parse(config);
+  if (cfg_tags == NULL) {
+    return -1;
+  }
+  grapes_config_value_int(cfg_tags, "bmap_delta", &bmap_delta);
+  grapes_config_value_int(cfg_tags, "bmap_refresh", &bmap_refresh);
+  if (sent_maps == NULL && received_maps == NULL) {
+    grapes_config_value_int(cfg_tags, "bmap_peers", &bmap_peers);
+  }
+  free(cfg_tags);
+  if (bmap_peers <= 0) {
+    bmap_peers = DEFAULT_BMAP_PEERS;
+
+    return -1;
+  }
+
+  return 1;
+}
+
+/*
+ * Rebuild a buffer map from the last full map received from its owner and
+ * a delta message (the added chunks, and the hash of the full map followed
+ * by the removed chunks in extra)
+ */
+static struct chunkID_set *bmap_delta_apply(const struct nodeID *owner, const struct chunkID_set *added, const uint8_t *extra, int extra_len)
+{
+  struct bmap_state *st;
+  struct chunkID_set *removed, *res;
+  int *rm, *add, n_rm, n_add, i, j, k, meta_len;
+  void *meta;
+  char cfg[32];
+
+  st = owner && extra_len >= 4 ? bmap_state_get(&received_maps, owner, 0) : NULL;
+  if (st == NULL || st->chunks == NULL || st->hash != int_rcpy(extra)) {
+    fprintf(stderr, "Missing the full buffer map for a delta: request it\n");
+
+    return NULL;
+  }
+  removed = decodeChunkSignaling(&meta, &meta_len, extra + 4, extra_len - 4);
+  free(meta);
+  if (removed == NULL) {
+    return NULL;
+  }
+  rm = chunks_sort(removed, &n_rm);
+  add = chunks_sort(added, &n_add);
+  chunkID_set_free(removed);
+  sprintf(cfg, "type=auto,size=%d", st->n_chunks + n_add);
+  res = rm && add ? chunkID_set_init(cfg) : NULL;
+  if (res) {
+    /* Merge the sorted arrays, so that the chunks are added in order */
+    for (i = j = k = 0; i < st->n_chunks || k < n_add;) {
+      if (k == n_add || (i < st->n_chunks && st->chunks[i] < add[k])) {
+        while (j < n_rm && rm[j] < st->chunks[i]) {
+          j++;
+        }
+        if (j == n_rm || rm[j] != st->chunks[i]) {
+          chunkID_set_add_chunk(res, st->chunks[i]);
+        }
+        i++;
+      } else {
+        chunkID_set_add_chunk(res, add[k++]);
+      }
+    }
+  }
+  free(rm);
+  free(add);
+
+  return res;
+}
+
 int parseSignaling(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
                    struct chunkID_set **cset, int *max_deliver, uint16_t *trans_id,
                    enum signaling_type *sig_type)
@@ -66,7 +269,8 @@ int parseSignaling(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
   *cset = decodeChunkSignaling(&meta, &meta_len, buff, buff_len);
   if (meta_len) {
     struct sig_nal *signal = meta;
-    int dummy;
+    const uint8_t *extra;
+    int owner_len, extra_len;
 
     switch (signal->type) {
       case MSG_SIG_OFF:
@@ -90,13 +294,70 @@ int parseSignaling(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
       case MSG_SIG_BMREQ:
         *sig_type = sig_request_buffermap;
         break;
+      case MSG_SIG_BMDELTA:
+        *sig_type = sig_send_buffermap;
+        break;
       default:
         fprintf(stderr, "Error invalid signaling message: type %d\n", signal->type);
+        free(meta);
+        if (*cset) {
+          chunkID_set_free(*cset);
+          *cset = NULL;
+        }
         return -1;
     }
     *max_deliver = signal->max_deliver;
     *trans_id = signal->trans_id;
-    *owner_id = (meta_len > sizeof(struct sig_nal) - 1 ? nodeid_undump(&(signal->third_peer), &dummy) : NULL);
+    *owner_id = (meta_len > sizeof(struct sig_nal) - 1 ? nodeid_undump(&(signal->third_peer), &owner_len) : NULL);
+    /* Delta buffer maps information follows the owner */
+    extra = &signal->third_peer + (*owner_id ? owner_len : 0);
+    extra_len = (uint8_t *)meta + meta_len - extra;
+    if (signal->type == MSG_SIG_BMOFF && bmap_delta && *owner_id && *cset) {
+      struct bmap_state *st;
+      int *chunks, n;
+
+      /* A full buffer map, which the next deltas will refer to */
+      st = bmap_state_get(&received_maps, *owner_id, 1);
+      chunks = chunks_sort(*cset, &n);
+      if (st && chunks) {
+        bmap_state_set(st, chunks, n);
+      } else {
+        free(chunks);
+      }
+    } else if (signal->type == MSG_SIG_BMDELTA) {
+      struct chunkID_set *added = *cset;
+
+      *cset = bmap_delta_apply(*owner_id, added, extra, extra_len);
+      if (added) {
+        chunkID_set_free(added);
+      }
+      if (*cset == NULL) {
+        free(meta);
+        if (*owner_id) {
+          nodeid_free(*owner_id);
+          *owner_id = NULL;
+        }
+
+        return -1;
+      }
+    } else if (signal->type == MSG_SIG_BMREQ && extra_len > 0) {
+      struct nodeID *from;
+      int from_len;
+
+      /*
+       * The requesting peer (whose address follows the owner) lost our
+       * full buffer map: the next one sent to it will be full
+       */
+      from = nodeid_undump(extra, &from_len);
+      if (from) {
+        struct bmap_state *st = bmap_state_get(&sent_maps, from, 0);
+
+        if (st) {
+          bmap_state_clear(st);
+        }
+        nodeid_free(from);
+      }
+    }
     free(meta);
   } else {
     return -1;
@@ -105,13 +366,12 @@ int parseSignaling(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
   return 1;
 }
 
-static int sendSignaling(const struct nodeID *localID, int type, const struct nodeID *to_id,
-                         const struct nodeID *owner_id,
-                         const struct chunkID_set *cset, int max_deliver,
-                         uint16_t trans_id)
+/* Encode a signaling message in buff (SIG_BUF_LEN bytes); extra is appended to the metadata */
+static int buildSignaling(uint8_t *buff, int type, const struct nodeID *owner_id,
+                          const struct chunkID_set *cset, int max_deliver,
+                          uint16_t trans_id, const uint8_t *extra, int extra_len)
 {
   int meta_len, msg_len;
-  uint8_t *buff;
   struct sig_nal *sigmex;
 
   sigmex = malloc(SIG_META_LEN);
@@ -128,17 +388,38 @@ static int sendSignaling(const struct nodeID *localID, int type, const struct no
   if (owner_id) {
     meta_len += nodeid_dump(&sigmex->third_peer, owner_id, SIG_META_LEN - meta_len);
   }
-  buff = malloc(SIG_BUF_LEN);
-  if (!buff) {
-    fprintf(stderr, "Error allocating buffer\n");
+  if (meta_len + extra_len > SIG_META_LEN) {
     free(sigmex);
 
     return -1;
   }
+  if (extra_len) {
+    memcpy((uint8_t *)sigmex + meta_len, extra, extra_len);
+    meta_len += extra_len;
+  }
 
   buff[0] = MSG_TYPE_SIGNALLING;
   msg_len = 1 + encodeChunkSignaling(cset, sigmex, meta_len, buff+1, SIG_BUF_LEN-1);
   free(sigmex);
+
+  return msg_len;
+}
+
+static int sendSignalingExtra(const struct nodeID *localID, int type, const struct nodeID *to_id,
+                              const struct nodeID *owner_id,
+                              const struct chunkID_set *cset, int max_deliver,
+                              uint16_t trans_id, const uint8_t *extra, int extra_len)
+{
+  int msg_len;
+  uint8_t *buff;
+
+  buff = malloc(SIG_BUF_LEN);
+  if (!buff) {
+    fprintf(stderr, "Error allocating buffer\n");
+
+    return -1;
+  }
+  msg_len = buildSignaling(buff, type, owner_id, cset, max_deliver, trans_id, extra, extra_len);
   if (msg_len <= 0) {
     fprintf(stderr, "Error in encoding chunk set for sending a buffermap\n");
     free(buff);
@@ -152,6 +433,84 @@ static int sendSignaling(const struct nodeID *localID, int type, const struct no
   return 1;
 }
 
+static int sendSignaling(const struct nodeID *localID, int type, const struct nodeID *to_id,
+                         const struct nodeID *owner_id,
+                         const struct chunkID_set *cset, int max_deliver,
+                         uint16_t trans_id)
+{
+  return sendSignalingExtra(localID, type, to_id, owner_id, cset, max_deliver, trans_id, NULL, 0);
+}
+
+/*
+ * Send our buffer map as a delta from the last full map sent to the peer,
+ * or as a new full map if there is none, if it is time to refresh it, or
+ * if the full map is smaller than the delta
+ */
+static int sendBufferMapDelta(const struct nodeID *localID, const struct nodeID *to,
+                              struct chunkID_set *bmap, int cb_size, uint16_t trans_id)
+{
+  struct bmap_state *st;
+  struct chunkID_set *added, *removed;
+  uint8_t *full, *delta, extra[SIG_META_LEN];
+  int *chunks, n, i, j, full_len, delta_len, extra_len;
+
+  st = bmap_state_get(&sent_maps, to, 1);
+  chunks = chunks_sort(bmap, &n);
+  full = malloc(SIG_BUF_LEN);
+  delta = malloc(SIG_BUF_LEN);
+  added = chunkID_set_init("type=auto");
+  removed = chunkID_set_init("type=auto");
+  if (st == NULL || chunks == NULL || full == NULL || delta == NULL || added == NULL || removed == NULL) {
+    fprintf(stderr, "Error allocating buffer\n");
+    free(chunks);
+    free(full);
+    free(delta);
+    if (added) chunkID_set_free(added);
+    if (removed) chunkID_set_free(removed);
+
+    return -1;
+  }
+
+  full_len = buildSignaling(full, MSG_SIG_BMOFF, localID, bmap, cb_size, trans_id, NULL, 0);
+
+  delta_len = -1;
+  if (st->chunks && st->deltas < bmap_refresh) {
+    for (i = j = 0; i < n || j < st->n_chunks;) {
+      if (j == st->n_chunks || (i < n && chunks[i] < st->chunks[j])) {
+        chunkID_set_add_chunk(added, chunks[i++]);
+      } else if (i == n || st->chunks[j] < chunks[i]) {
+        chunkID_set_add_chunk(removed, st->chunks[j++]);
+      } else {
+        i++;
+        j++;
+      }
+    }
+    int_cpy(extra, st->hash);
+    extra_len = encodeChunkSignaling(removed, NULL, 0, extra + 4, sizeof(extra) - 4);
+    if (extra_len > 0) {
+      delta_len = buildSignaling(delta, MSG_SIG_BMDELTA, localID, added, cb_size, trans_id, extra, extra_len + 4);
+    }
+  }
+  chunkID_set_free(added);
+  chunkID_set_free(removed);
+
+  if (delta_len > 0 && (full_len <= 0 || delta_len < full_len)) {
+    st->deltas++;
+    send_to_peer(localID, to, delta, delta_len);
+    free(chunks);
+  } else if (full_len > 0) {
+    bmap_state_set(st, chunks, n);
+    send_to_peer(localID, to, full, full_len);
+  } else {
+    fprintf(stderr, "Error in encoding chunk set for sending a buffermap\n");
+    free(chunks);
+  }
+  free(full);
+  free(delta);
+
+  return full_len > 0 || delta_len > 0 ? 1 : -1;
+}
+
 int requestChunks(const struct nodeID *localID, const struct nodeID *to, const ChunkIDSet *cset,
                   int max_deliver, uint16_t trans_id)
 {
@@ -177,6 +536,10 @@ int acceptChunks(const struct nodeID *localID, const struct nodeID *to, struct c
 int sendBufferMap(const struct nodeID *localID, const struct nodeID *to, const struct nodeID *owner,
                   struct chunkID_set *bmap, int cb_size, uint16_t trans_id)
 {
+  if (bmap_delta && bmap && (owner == NULL || nodeid_equal(owner, localID))) {
+    return sendBufferMapDelta(localID, to, bmap, cb_size, trans_id);
+  }
+
   return sendSignaling(localID, MSG_SIG_BMOFF, to, (!owner ? localID : owner), bmap,
                        cb_size, trans_id);
 }
@@ -189,6 +552,15 @@ int sendAck(const struct nodeID *localID, const struct nodeID *to, struct chunkI
 int requestBufferMap(const struct nodeID *localID, const struct nodeID *to, const struct nodeID *owner,
                      uint16_t trans_id)
 {
-  return sendSignaling(localID, MSG_SIG_BMREQ, to, (!owner?localID:owner), NULL,
-                       0, trans_id);
+  uint8_t from[SIG_META_LEN / 2];
+  int from_len;
+
+  /* Our address, so that a delta sender knows who lost its full buffer map */
+  from_len = nodeid_dump(from, localID, sizeof(from));
+  if (from_len < 0) {
+    from_len = 0;
+  }
+
+  return sendSignalingExtra(localID, MSG_SIG_BMREQ, to, (!owner?localID:owner), NULL,
+                            0, trans_id, from, from_len);
 }
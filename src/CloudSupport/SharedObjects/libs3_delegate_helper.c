@@ -47,6 +47,7 @@ struct delegate_iface {
   int (*is_cloud_node)(void *context, struct nodeID* node);
   int (*wait4cloud)(void *context, struct timeval *tout);
   int (*recv_from_cloud)(void *context, uint8_t *buffer_ptr, int buffer_size);
+  int (*get_cloud_fd)(void *context);
 };
 
 /***********************************************************************
@@ -707,6 +708,15 @@ int recv_from_cloud(void *context, uint8_t *buffer_ptr, int buffer_size)
   return toread;
 }
 
+int get_cloud_fd(void *context)
+{
+  struct libs3_cloud_context *ctx;
+
+  ctx = (struct libs3_cloud_context *) context;
+
+  return req_handler_get_fd(ctx->req_handler);
+}
+
 struct delegate_iface delegate_impl = {
   .cloud_helper_init = &cloud_helper_init,
   .get_from_cloud = &get_from_cloud,
@@ -716,5 +726,6 @@ struct delegate_iface delegate_impl = {
   .timestamp_cloud = &timestamp_cloud,
   .is_cloud_node = &is_cloud_node,
   .wait4cloud = &wait4cloud,
-  .recv_from_cloud = &recv_from_cloud
+  .recv_from_cloud = &recv_from_cloud,
+  .get_cloud_fd = &get_cloud_fd
 };
@@ -173,6 +173,13 @@ int wait4cloud(struct cloud_helper_context *context, struct timeval *tout)
   return context->ch->wait4cloud(context->ch_context, tout);
 }
 
+int get_cloud_fd(struct cloud_helper_context *context)
+{
+  if (!context->ch->get_cloud_fd) return -1;
+
+  return context->ch->get_cloud_fd(context->ch_context);
+}
+
 int recv_from_cloud(struct cloud_helper_context *context, uint8_t *buffer_ptr,
                     int buffer_size)
 {
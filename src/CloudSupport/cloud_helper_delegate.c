@@ -36,6 +36,8 @@ struct delegate_iface {
   int (*wait4cloud)(void *context, struct timeval *tout);
 
   int (*recv_from_cloud)(void *context, uint8_t *buffer_ptr, int buffer_size);
+
+  int (*get_cloud_fd)(void *context);
 };
 
 struct cloud_helper_impl_context {
@@ -140,6 +142,13 @@ delegate_cloud_recv_from_cloud(struct cloud_helper_impl_context *context,
                                             buffer_ptr, buffer_size);
 }
 
+static int delegate_cloud_get_cloud_fd(struct cloud_helper_impl_context *context)
+{
+  if (!context->delegate->get_cloud_fd) return -1;
+
+  return context->delegate->get_cloud_fd(context->delegate_context);
+}
+
 struct cloud_helper_iface delegate = {
   .cloud_helper_init = delegate_cloud_init,
   .get_from_cloud = delegate_cloud_get_from_cloud,
@@ -150,4 +159,5 @@ struct cloud_helper_iface delegate = {
   .is_cloud_node = delegate_is_cloud_node,
   .wait4cloud = delegate_cloud_wait4cloud,
   .recv_from_cloud = delegate_cloud_recv_from_cloud,
+  .get_cloud_fd = delegate_cloud_get_cloud_fd,
 };
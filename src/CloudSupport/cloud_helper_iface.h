@@ -32,6 +32,9 @@ struct cloud_helper_iface {
 
   int (*recv_from_cloud)(struct cloud_helper_impl_context *context,
                          uint8_t *buffer_ptr, int buffer_size);
+
+  /* optional, can be NULL */
+  int (*get_cloud_fd)(struct cloud_helper_impl_context *context);
 };
 
 #endif
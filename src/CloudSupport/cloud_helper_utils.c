@@ -64,6 +64,48 @@ static void* wait4cloud_wrapper(void *ctx)
 }
 
 
+/* Wait on the cloud completion fd together with the network, without threads */
+static int wait4any_fd(struct nodeID *n, struct cloud_helper_context *cloud, int cloud_fd, struct timeval *tout, int *user_fds, int *data_source)
+{
+  int small_fds[16], *fds;
+  int i, nfds, res;
+
+  nfds = 0;
+  if (user_fds) {
+    for (; user_fds[nfds] != -1; nfds++);
+  }
+  fds = nfds + 2 > 16 ? malloc((nfds + 2) * sizeof(int)) : small_fds;
+  if (fds == NULL) return -1;
+  for (i = 0; i < nfds; i++) {
+    fds[i] = user_fds[i];
+  }
+  fds[nfds] = cloud_fd;
+  fds[nfds + 1] = -1;
+
+  *data_source = DATA_SOURCE_NONE;
+  res = wait4data(n, tout, fds);
+  if (res == 1) {
+    *data_source = DATA_SOURCE_NET;
+  } else if (res == 2) {
+    for (i = 0; i < nfds; i++) {
+      user_fds[i] = fds[i];
+    }
+    res = 0;
+    if (fds[nfds] != -2) {
+      struct timeval zero = {0, 0};
+
+      res = wait4cloud(cloud, &zero);
+      if (res == 1 || res == -1) {
+        *data_source = DATA_SOURCE_CLOUD;
+        res = 1;
+      }
+    }
+  }
+  if (fds != small_fds) free(fds);
+
+  return res < 0 ? -1 : res;
+}
+
 int wait4any_threaded(struct nodeID *n, struct cloud_helper_context *cloud, struct timeval *tout, int *user_fds, int *data_source)
 {
   pthread_attr_t attr;
@@ -75,6 +117,12 @@ int wait4any_threaded(struct nodeID *n, struct cloud_helper_context *cloud, stru
 
   int err;
   int result;
+  int cloud_fd;
+
+  cloud_fd = get_cloud_fd(cloud);
+  if (cloud_fd >= 0) {
+    return wait4any_fd(n, cloud, cloud_fd, tout, user_fds, data_source);
+  }
 
   wait4ctx = malloc(sizeof(struct wait4context));
   if (wait4ctx == NULL) return -1;
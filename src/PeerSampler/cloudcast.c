@@ -350,7 +350,7 @@ cloudcast_parse_data(struct peersampler_context *context, const uint8_t *buff,
                      int len)
 {
   int err = 0;
-  cache_check(context->local_cache);
+  cache_debug_check(context->local_cache);
 
   /* If we got data, perform the appropriate passive thread operation */
   if (len) {
@@ -400,7 +400,7 @@ cloudcast_parse_data(struct peersampler_context *context, const uint8_t *buff,
   if (time_to_send(context)) {
     err = cloudcast_active_thread(context);
   }
-  cache_check(context->local_cache);
+  cache_debug_check(context->local_cache);
 
   return err;
 }
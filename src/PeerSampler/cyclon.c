@@ -30,6 +30,7 @@ struct peersampler_context{
   int cache_size;
   int sent_entries;
   struct peer_cache *local_cache;
+  struct peer_cache *remote_cache;	/* reused for parsing received caches */
   bool bootstrap;
   int bootstrap_period;
   int bootstrap_cycles;
@@ -141,7 +142,7 @@ static int cyclon_add_neighbour(struct peersampler_context *context, struct node
 
 static int cyclon_parse_data(struct peersampler_context *context, const uint8_t *buff, int len)
 {
-  cache_check(context->local_cache);
+  cache_debug_check(context->local_cache);
   if (len) {
     const struct topo_header *h = (const struct topo_header *)buff;
     struct peer_cache *remote_cache;
@@ -159,16 +160,16 @@ static int cyclon_parse_data(struct peersampler_context *context, const uint8_t
       }
     }
 
-    remote_cache = entries_undump(buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
+    remote_cache = entries_undump_reuse(context->remote_cache, buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
+    context->remote_cache = remote_cache;
     if (h->type == CYCLON_QUERY) {
       sent_cache = rand_cache(context->local_cache, context->sent_entries);
       cyclon_reply(context->pc, remote_cache, sent_cache);
       nodeid_free(context->dst);
       context->dst = NULL;
     }
-    cache_check(context->local_cache);
+    cache_debug_check(context->local_cache);
     cache_add_cache(context->local_cache, remote_cache);
-    cache_free(remote_cache);
     if (sent_cache) {
       cache_add_cache(context->local_cache, sent_cache);
       cache_free(sent_cache);
@@ -198,7 +199,7 @@ static int cyclon_parse_data(struct peersampler_context *context, const uint8_t
     context->flying_cache = rand_cache(context->local_cache, context->sent_entries - 1);
     return cyclon_query(context->pc, context->flying_cache, context->dst);
   }
-  cache_check(context->local_cache);
+  cache_debug_check(context->local_cache);
 
   return 0;
 }
@@ -271,6 +272,8 @@ void cyclon_destroy(struct peersampler_context **context)
 			cache_free((*context)->local_cache);
 		if((*context)->flying_cache)
 			cache_free((*context)->flying_cache);
+		if((*context)->remote_cache)
+			cache_free((*context)->remote_cache);
 		free(*context);
 		*context = NULL;
 	}
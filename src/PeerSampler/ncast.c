@@ -32,6 +32,7 @@ struct peersampler_context{
   int cache_size;
   int cache_size_threshold;
   struct peer_cache *local_cache;
+  struct peer_cache *remote_cache;	/* reused for parsing received caches */
   bool bootstrap;
   struct nodeID *bootstrap_node;
   int bootstrap_period;
@@ -187,7 +188,8 @@ static int ncast_parse_data(struct peersampler_context *context, const uint8_t *
       ncast_proto_myentry_update(context->tc, NULL , - context->first_ts, NULL, 0);  // reset the timestamp of our own ID, we are in normal cycle, we will not disturb the algorithm
     }
 
-    remote_cache = entries_undump(buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
+    remote_cache = entries_undump_reuse(context->remote_cache, buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
+    context->remote_cache = remote_cache;
     if (h->type == NCAST_QUERY) {
       context->reply_tokens--;	//sending a reply to someone who presumably receives it
       cache_randomize(context->local_cache);
@@ -198,7 +200,6 @@ static int ncast_parse_data(struct peersampler_context *context, const uint8_t *
     cache_randomize(context->local_cache);
     cache_randomize(remote_cache);
     new = merge_caches(context->local_cache, remote_cache, context->cache_size, &dummy);
-    cache_free(remote_cache);
     if (new != NULL) {
       cache_free(context->local_cache);
       context->local_cache = new;
@@ -286,6 +287,8 @@ void ncast_destroy(struct peersampler_context **context)
 			free((*context)->r);
 		if((*context)->local_cache)
 			cache_free((*context)->local_cache);
+		if((*context)->remote_cache)
+			cache_free((*context)->remote_cache);
 		if((*context)->tc)
 			ncast_proto_destroy(&((*context)->tc));
 		if((*context)->bootstrap_node)
@@ -10,6 +10,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <limits.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #include "peerset_private.h"
 #include "peer.h"
@@ -19,6 +22,8 @@
 #include "grapes_config.h"
 
 #define DEFAULT_SIZE_INCREMENT 32
+#define PEER_SLAB_SIZE 64
+#define MIN_INDEX_SIZE 16
 
 void peer_init_data(struct peer *p)
 {
@@ -40,6 +45,205 @@ void peer_deinit_data(struct peer *p)
 peer_deinit_f peer_deinit = peer_deinit_data;
 peer_init_f peer_init = peer_init_data;
 
+/*
+ * Peer structures are allocated in slabs of PEER_SLAB_SIZE elements,
+ * shared by all the peer sets (so that peers can be moved from a set to
+ * another one with peerset_pop_peer() and peerset_push_peer()). The slabs
+ * are never released, so a peer never outlives its slab. Peers allocated
+ * by the user and inserted with peerset_push_peer() are recognised and
+ * released with free().
+ */
+static struct peer **peer_slabs;	/* sorted by address */
+static int peer_slabs_n;
+static struct peer *peer_free_list;	/* linked through the id field */
+
+/* The slabs and the free list are shared by all the threads */
+#ifndef _WIN32
+static pthread_mutex_t peer_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+#define SLAB_LOCK() pthread_mutex_lock(&peer_slab_lock)
+#define SLAB_UNLOCK() pthread_mutex_unlock(&peer_slab_lock)
+#else
+#define SLAB_LOCK()
+#define SLAB_UNLOCK()
+#endif
+
+static int peer_slab_find(const struct peer *p)
+{
+  int a, b;
+
+  a = 0;
+  b = peer_slabs_n - 1;
+  while (a <= b) {
+    int c = (a + b) / 2;
+
+    if (p < peer_slabs[c]) {
+      b = c - 1;
+    } else if (p >= peer_slabs[c] + PEER_SLAB_SIZE) {
+      a = c + 1;
+    } else {
+      return c;
+    }
+  }
+
+  return -1;
+}
+
+/* Called with the lock held */
+static int peer_slab_add(void)
+{
+  struct peer **res;
+  struct peer *slab;
+  int i;
+
+  res = realloc(peer_slabs, (peer_slabs_n + 1) * sizeof(struct peer *));
+  if (res == NULL) {
+    return -1;
+  }
+  peer_slabs = res;
+  slab = malloc(PEER_SLAB_SIZE * sizeof(struct peer));
+  if (slab == NULL) {
+    return -1;
+  }
+  for (i = peer_slabs_n; i > 0 && peer_slabs[i - 1] > slab; i--) {
+    peer_slabs[i] = peer_slabs[i - 1];
+  }
+  peer_slabs[i] = slab;
+  peer_slabs_n++;
+  for (i = PEER_SLAB_SIZE - 1; i >= 0; i--) {
+    slab[i].id = (struct nodeID *)peer_free_list;
+    peer_free_list = &slab[i];
+  }
+
+  return 0;
+}
+
+static struct peer *peer_alloc(void)
+{
+  struct peer *p = NULL;
+
+  SLAB_LOCK();
+  if (peer_free_list || peer_slab_add() == 0) {
+    p = peer_free_list;
+    peer_free_list = (struct peer *)p->id;
+  }
+  SLAB_UNLOCK();
+
+  return p;
+}
+
+static void peer_release(struct peer *p)
+{
+  SLAB_LOCK();
+  if (peer_slab_find(p) < 0) {
+    SLAB_UNLOCK();
+    free(p);
+
+    return;
+  }
+  p->id = (struct nodeID *)peer_free_list;
+  peer_free_list = p;
+  SLAB_UNLOCK();
+}
+
+void peerset_peer_free(struct peer *p)
+{
+  if (p == NULL) {
+    return;
+  }
+  nodeid_free(p->id);
+  if (peer_deinit)
+    peer_deinit(p);
+  peer_release(p);
+}
+
+/*
+ * The hash index maps nodeIDs to positions in the (ordered) elements
+ * array; it uses linear probing, and is kept at most half full.
+ */
+static int index_slot(const struct peerset *h, const struct nodeID *id)
+{
+  unsigned int mask = h->index_size - 1;
+  unsigned int i = nodeid_hash(id) & mask;
+
+  while (h->index[i] >= 0 && !nodeid_equal(h->elements[h->index[i]]->id, id)) {
+    i = (i + 1) & mask;
+  }
+
+  return i;
+}
+
+static int index_rebuild(struct peerset *h, int size)
+{
+  int *res;
+  int i;
+
+  res = realloc(h->index, size * sizeof(int));
+  if (res == NULL) {
+    return -1;
+  }
+  h->index = res;
+  h->index_size = size;
+  for (i = 0; i < size; i++) {
+    h->index[i] = -1;
+  }
+  for (i = 0; i < h->n_elements; i++) {
+    h->index[index_slot(h, h->elements[i]->id)] = i;
+  }
+
+  return 0;
+}
+
+/* Positions >= pos moved by delta in the elements array */
+static void index_shift(struct peerset *h, int pos, int delta)
+{
+  int i;
+
+  for (i = 0; i < h->index_size; i++) {
+    if (h->index[i] >= pos) {
+      h->index[i] += delta;
+    }
+  }
+}
+
+/* Called after inserting elements[pos] */
+static int index_insert(struct peerset *h, int pos)
+{
+  if (2 * h->n_elements > h->index_size) {
+    int size = h->index_size ? h->index_size : MIN_INDEX_SIZE;
+
+    while (2 * h->n_elements > size) {
+      size *= 2;
+    }
+
+    return index_rebuild(h, size);
+  }
+  index_shift(h, pos, 1);
+  h->index[index_slot(h, h->elements[pos]->id)] = pos;
+
+  return 0;
+}
+
+/* Called before removing elements[pos] */
+static void index_remove(struct peerset *h, int pos)
+{
+  unsigned int mask = h->index_size - 1;
+  unsigned int i, j;
+
+  i = index_slot(h, h->elements[pos]->id);
+  h->index[i] = -1;
+  /* Backward shift deletion: move back the entries that can be moved */
+  for (j = (i + 1) & mask; h->index[j] >= 0; j = (j + 1) & mask) {
+    unsigned int home = nodeid_hash(h->elements[h->index[j]]->id) & mask;
+
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      h->index[i] = h->index[j];
+      h->index[j] = -1;
+      i = j;
+    }
+  }
+  index_shift(h, pos + 1, -1);
+}
+
 static int nodeid_peer_cmp(const void *id, const void *p)
 {
   const struct peer *peer = *(struct peer *const *)p;
@@ -96,6 +300,8 @@ struct peerset *peerset_init(const char *config)
     return NULL;
   }
   p->n_elements = 0;
+  p->index = NULL;
+  p->index_size = 0;
   cfg_tags = grapes_config_parse(config);
   if (!cfg_tags) {
     free(p);
@@ -118,6 +324,7 @@ struct peerset *peerset_init(const char *config)
 void peerset_destroy(struct peerset **h)
 {
 	peerset_clear(*h,0);
+	free((*h)->index);
 	free(*h);
 	*h = NULL;
 }
@@ -144,7 +351,12 @@ int peerset_push_peer(struct peerset *h, struct peer *e)
 
   memmove(&h->elements[pos + 1], &h->elements[pos] , ((h->n_elements++) - pos) * sizeof(struct peer *));
 
-  h->elements[pos] = e;;
+  h->elements[pos] = e;
+  if (index_insert(h, pos) < 0) {
+    memmove(&h->elements[pos], &h->elements[pos + 1], ((h->n_elements--) - (pos + 1)) * sizeof(struct peer *));
+
+    return -1;
+  }
 
   return h->n_elements;
 }
@@ -170,14 +382,23 @@ int peerset_add_peer(struct peerset *h,const  struct nodeID *id)
     h->elements = res;
   }
 
-  memmove(&h->elements[pos + 1], &h->elements[pos] , ((h->n_elements++) - pos) * sizeof(struct peer *));
-
-  e = malloc(sizeof(struct peer));
-  h->elements[pos] = e;
+  e = peer_alloc();
+  if (e == NULL) {
+    return -1;
+  }
   gettimeofday(&e->creation_timestamp, NULL);
   e->id = nodeid_dup(id);
   peer_init(e);
 
+  memmove(&h->elements[pos + 1], &h->elements[pos] , ((h->n_elements++) - pos) * sizeof(struct peer *));
+  h->elements[pos] = e;
+  if (index_insert(h, pos) < 0) {
+    memmove(&h->elements[pos], &h->elements[pos + 1], ((h->n_elements--) - (pos + 1)) * sizeof(struct peer *));
+    peerset_peer_free(e);
+
+    return -1;
+  }
+
   return h->n_elements;
 }
 
@@ -210,6 +431,7 @@ struct peer *peerset_pop_peer(struct peerset *h, const struct nodeID *id){
   int i = peerset_check(h,id);
   if (i >= 0) {
     struct peer *e = h->elements[i];
+    index_remove(h, i);
     memmove(&h->elements[i], &h->elements[i+1], ((h->n_elements--) - (i+1)) * sizeof(struct peer *));
 
     return e;
@@ -221,11 +443,9 @@ int peerset_remove_peer(struct peerset *h, const struct nodeID *id){
   int i = peerset_check(h,id);
   if (i >= 0) {
     struct peer *e = h->elements[i];
-    nodeid_free(e->id);
-    if (peer_deinit)
-	    peer_deinit(e);
+    index_remove(h, i);
     memmove(&h->elements[i], &h->elements[i+1], ((h->n_elements--) - (i+1)) * sizeof(struct peer *));
-    free(e);
+    peerset_peer_free(e);
 
     return i;
   }
@@ -234,11 +454,11 @@ int peerset_remove_peer(struct peerset *h, const struct nodeID *id){
 
 int peerset_check(const struct peerset *h, const struct nodeID *id)
 {
-  struct peer **p;
-
-  p = bsearch(id, h->elements, (size_t) h->n_elements, sizeof(h->elements[0]), nodeid_peer_cmp);
+  if (id == NULL || h->n_elements == 0) {
+    return -1;
+  }
 
-  return p ? p - h->elements : -1;
+  return h->index[index_slot(h, id)];
 }
 
 void peerset_clear(struct peerset *h, int size)
@@ -246,11 +466,10 @@ void peerset_clear(struct peerset *h, int size)
   int i;
 
   for (i = 0; i < h->n_elements; i++) {
-    struct peer *e = h->elements[i];
-    nodeid_free(e->id);
-    if (peer_deinit)
-	    peer_deinit(e);
-    free(e);
+    peerset_peer_free(h->elements[i]);
+  }
+  for (i = 0; i < h->index_size; i++) {
+    h->index[i] = -1;
   }
 
   h->n_elements = 0;
@@ -5,6 +5,8 @@ struct peerset {
   int size;  //  
   int n_elements; // Number of ids in this array of chunks ids
   struct peer **elements;  // id number
+  int *index;      // open addressing hash table of positions in elements, -1 if empty
+  int index_size;  // number of slots in index (power of 2, or 0)
 };
 
 #endif /* PEERSET_PRIVATE */
@@ -6,6 +6,8 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
 #include "scheduler_la.h"
 
 #include<stdio.h>
@@ -13,117 +15,238 @@
 #define MAX(A,B)    ((A)>(B) ? (A) : (B))
 #define MIN(A,B)    ((A)<(B) ? (A) : (B))
 
+static uint64_t rng_state;
+
+/* splitmix64, for spreading the seed over the whole state */
+static uint64_t seed_mix(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+  return x ^ (x >> 31);
+}
+
+void schedSeed(unsigned int seed)
+{
+  rng_state = seed_mix(seed);
+  if (rng_state == 0) {
+    rng_state = 1;
+  }
+}
+
+/* xorshift64*; if no seed has been set, the state is taken from rand() */
+static uint64_t sched_rand(void)
+{
+  if (rng_state == 0) {
+    schedSeed(rand());
+  }
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+
+  return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* Uniformly distributed in (0, 1] */
+static double sched_rand_unit(void)
+{
+  return ((sched_rand() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
 struct iw {
-  int index;
+  size_t index;
+  int zero;	/* weighted selection: 1 if the weight is not positive */
+  int tie;	/* random key, for breaking ties uniformly */
   double weight;
 };
 
-static int cmp_iw_reverse(const void *a, const void *b)
+/* 1 if a should be selected before b */
+static inline int iw_better(const struct iw *a, const struct iw *b)
 {
-  const struct iw *a1 = (const struct iw *) a;
-  const struct iw *b1 = (const struct iw *) b;
-  return a1->weight==b1->weight ? 0 : (a1->weight<b1->weight ? 1 : -1);
+  if (a->zero != b->zero) {
+    return a->zero < b->zero;
+  }
+  if (a->weight != b->weight) {
+    return a->weight > b->weight;
+  }
+  if (a->tie != b->tie) {
+    return a->tie < b->tie;
+  }
+
+  return a->index < b->index;
 }
 
-/**
-  * Select best N of K based using a given evaluator function
-  */
-void selectBests(size_t size,unsigned char *base, size_t nmemb, double(*evaluate)(void *),unsigned char *bests,size_t *bests_len){
-  struct iw iws[nmemb];
-  int i;
+/* Restore the heap property (worst element at the root) below position i */
+static void heap_sift_down(struct iw *heap, size_t len, size_t i)
+{
+  struct iw x = heap[i];
 
-  // calculate weights
-  for (i=0; i<nmemb; i++){
-     iws[i].index = i;
-     iws[i].weight = evaluate(base + size*i);
+  for (;;) {
+    size_t c = 2 * i + 1;
+
+    if (c >= len) {
+      break;
+    }
+    if (c + 1 < len && iw_better(&heap[c], &heap[c + 1])) {
+      c++;
+    }
+    if (!iw_better(&x, &heap[c])) {
+      break;
+    }
+    heap[i] = heap[c];
+    i = c;
   }
+  heap[i] = x;
+}
 
-  // sort in descending order
-  qsort(iws, nmemb, sizeof(struct iw), cmp_iw_reverse);
+static void heap_sift_up(struct iw *heap, size_t i)
+{
+  struct iw x = heap[i];
 
-  // ensure uniform random tie
-  for (i=0; i<nmemb; i++){
-    int j, k;
-    for (j=i; j<nmemb && iws[i].weight == iws[j].weight; j++);
-    for (k=i; k<j; k++){
-      struct iw iwt = iws[k];
-      int r = i + (rand() % (j-i));
-      iws[k] = iws[r];
-      iws[r] = iwt;
+  while (i > 0) {
+    size_t p = (i - 1) / 2;
+
+    if (!iw_better(&heap[p], &x)) {
+      break;
     }
+    heap[i] = heap[p];
+    i = p;
   }
+  heap[i] = x;
+}
 
-  *bests_len = MIN(*bests_len, nmemb);
+#define TOPK_INLINE 16
 
-  // copy bests in their place
-  for (i=0; i<*bests_len; i++){
-     memcpy(bests + size*i, base + size*iws[i].index, size);
+/*
+ * Streaming selection of the best k candidates: candidates are offered one
+ * at a time, and only the best k seen so far are stored (in a heap having
+ * the worst of them at the root), so memory grows with the number of
+ * selections and not with the number of candidates.
+ *
+ * With SCHED_BEST, ties are broken by a random key, so that all the
+ * candidates with the same weight have the same probability of being
+ * selected. With SCHED_WEIGHTED, each candidate with weight w > 0 gets the
+ * key log(u) / w (u uniform in (0, 1]) and the k largest keys are selected
+ * (Efraimidis-Spirakis weighted sampling without replacement); candidates
+ * with weight 0 are selected only if all the weights are 0.
+ */
+struct topk {
+  SchedOrdering ordering;
+  size_t k;
+  size_t len;
+  size_t positives;
+  struct iw *heap;
+  struct iw inline_heap[TOPK_INLINE];
+};
+
+static int topk_init(struct topk *t, SchedOrdering ordering, size_t k)
+{
+  t->ordering = ordering;
+  t->k = k;
+  t->len = 0;
+  t->positives = 0;
+  t->heap = t->inline_heap;
+  if (k > TOPK_INLINE) {
+    t->heap = malloc(k * sizeof(struct iw));
+    if (t->heap == NULL) {
+      t->k = 0;
+
+      return -1;
+    }
   }
-  
+
+  return 0;
 }
 
-/**
-  * Select N of K with weigthed random choice, without replacement (multiple selection), based on a given evaluator function
-  */
-void selectWeighted(size_t size,unsigned char *base, size_t nmemb, double(*weight)(void *),unsigned char *selected,size_t *selected_len){
-  int i,j,k;
-  double weights[nmemb];
-  double w_sum=0;
-  double selected_index[nmemb];
-  int s=0;
-  int s_max = MIN (*selected_len, nmemb);
-  int zeros = 0;
-
-  // calculate weights
-  for (i=0; i<nmemb; i++){
-     weights[i] = weight(base + size*i);
-     // weights should not be negative
-     weights[i] = MAX (weights[i], 0);
-     if (weights[i] == 0) zeros += 1;
-     w_sum += weights[i];
+static void topk_offer(struct topk *t, size_t index, double weight)
+{
+  struct iw c;
+
+  c.index = index;
+  c.zero = 0;
+  c.weight = weight;
+  if (t->ordering == SCHED_WEIGHTED) {
+    // weights should not be negative
+    if (weight > 0) {
+      c.weight = log(sched_rand_unit()) / weight;
+      t->positives++;
+    } else {
+      c.weight = log(sched_rand_unit());
+      c.zero = 1;
+    }
+  }
+  c.tie = sched_rand() >> 33;
+
+  if (t->len < t->k) {
+    t->heap[t->len] = c;
+    heap_sift_up(t->heap, t->len++);
+  } else if (t->k > 0 && iw_better(&c, &t->heap[0])) {
+    t->heap[0] = c;
+    heap_sift_down(t->heap, t->len, 0);
+  }
+}
+
+/* Sort the selected candidates, best first, and return their number */
+static size_t topk_finish(struct topk *t)
+{
+  size_t len = t->len;
+
+  while (len > 1) {
+    struct iw worst = t->heap[0];
+
+    t->heap[0] = t->heap[--len];
+    heap_sift_down(t->heap, len, 0);
+    t->heap[len] = worst;
   }
 
   // all weights shuold not be zero, but if if happens, do something
-  if (w_sum == 0) {
-    for (i=0; i<nmemb; i++){
-      weights[i] = 1;
-      w_sum += weights[i];
-    }
-  } else { //exclude 0 weight from selection
-    s_max = MIN (s_max, nmemb - zeros);
+  if (t->ordering == SCHED_WEIGHTED && t->positives > 0) {
+    return MIN(t->len, t->positives);
   }
 
-  while (s < s_max) {
-    // select one randomly
-    double t = w_sum * (rand() / (RAND_MAX + 1.0));
-    //search for it in the CDF
-    double cdf = 0;
-    for (j=0; j<nmemb; j++){
-      cdf += weights[j];
-      //printf("(%f <? %f\n",t,cdf);
-      if (t < cdf) {
-        int already_selected=0;
-        for (k=0; k<s; k++) {
-          if (selected_index[k] == j)  already_selected=1;
-        }
-        if (!already_selected){ 
-          //printf("selected %d(%f) for %d\n",j,weights[j],k);
-          memcpy(selected + size*s, base + size*j, size);
-          selected_index[s++]=j;
-        }
-        break;
-      }
-    }
+  return t->len;
+}
+
+static void topk_free(struct topk *t)
+{
+  if (t->heap != t->inline_heap) {
+    free(t->heap);
   }
-  *selected_len=s;
 }
 
 /**
   * Select best N of K with the given ordering method
+  *
+  * O(K log N) time, and O(N) memory.
   */
 void selectWithOrdering(SchedOrdering ordering, size_t size, unsigned char *base, size_t nmemb, double(*evaluate)(void *), unsigned char *selected,size_t *selected_len){
-  if (ordering == SCHED_WEIGHTED) selectWeighted(size, base, nmemb, evaluate, selected, selected_len);
-  else selectBests(size, base, nmemb, evaluate, selected, selected_len);
+  struct topk t;
+  size_t i;
+
+  topk_init(&t, ordering, MIN(*selected_len, nmemb));
+  for (i=0; i<nmemb; i++){
+    topk_offer(&t, i, evaluate(base + size*i));
+  }
+  *selected_len = topk_finish(&t);
+  for (i=0; i<*selected_len; i++){
+    memcpy(selected + size*i, base + size*t.heap[i].index, size);
+  }
+  topk_free(&t);
+}
+
+/**
+  * Select best N of K based using a given evaluator function
+  */
+void selectBests(size_t size,unsigned char *base, size_t nmemb, double(*evaluate)(void *),unsigned char *bests,size_t *bests_len){
+  selectWithOrdering(SCHED_BEST, size, base, nmemb, evaluate, bests, bests_len);
+}
+
+/**
+  * Select N of K with weigthed random choice, without replacement (multiple selection), based on a given evaluator function
+  */
+void selectWeighted(size_t size,unsigned char *base, size_t nmemb, double(*weight)(void *),unsigned char *selected,size_t *selected_len){
+  selectWithOrdering(SCHED_WEIGHTED, size, base, nmemb, weight, selected, selected_len);
 }
 
 /**
@@ -210,27 +333,47 @@ void selectPeersForChunks(SchedOrdering ordering, schedPeerID *peers, size_t pee
                      schedPeerID *selected, size_t *selected_len,	//out, inout
                      filterFunction filter,
                      peerEvaluateFunction evaluate){
+  struct topk t;
+  size_t p, c, i;
 
-  size_t filtered_len=peers_len;
-  schedPeerID filtered[filtered_len];
-
-  filterPeers2(peers, peers_len, chunks,chunks_len, filtered, &filtered_len, filter);
-	//fprintf(stderr,"[DEBUG] Filtered peers for offer: %d\n",filtered_len);
-
-  selectPeers(ordering, filtered, filtered_len, evaluate, selected, selected_len);
+  // filter and evaluate the peers as they come, without copying them
+  topk_init(&t, ordering, MIN(*selected_len, peers_len));
+  for (p=0; p<peers_len; p++){
+    for (c=0; c<chunks_len; c++){
+      if (!filter || filter(peers[p],chunks[c])) {
+        topk_offer(&t, p, evaluate(&peers[p]));
+        break;
+      }
+    }
+  }
+  *selected_len = topk_finish(&t);
+  for (i=0; i<*selected_len; i++){
+    selected[i] = peers[t.heap[i].index];
+  }
+  topk_free(&t);
 }
 
 void selectChunksForPeers(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      schedChunkID *selected, size_t *selected_len,	//out, inout
                      filterFunction filter,
                      chunkEvaluateFunction evaluate){
+  struct topk t;
+  size_t p, c, i;
 
-  size_t filtered_len=chunks_len;
-  schedChunkID filtered[filtered_len];
-
-  filterChunks2(peers, peers_len, chunks,chunks_len, filtered, &filtered_len, filter);
-
-  selectChunks(ordering, filtered, filtered_len, evaluate, selected, selected_len);
+  topk_init(&t, ordering, MIN(*selected_len, chunks_len));
+  for (c=0; c<chunks_len; c++){
+    for (p=0; p<peers_len; p++){
+      if (!filter || filter(peers[p],chunks[c])) {
+        topk_offer(&t, c, evaluate(&chunks[c]));
+        break;
+      }
+    }
+  }
+  *selected_len = topk_finish(&t);
+  for (i=0; i<*selected_len; i++){
+    selected[i] = chunks[t.heap[i].index];
+  }
+  topk_free(&t);
 }
 
 
@@ -306,16 +449,38 @@ void schedSelectChunkFirst(SchedOrdering ordering, schedPeerID *peers, size_t pe
   toPairsChunkFirst(p,p_len,c,c_len,selected,selected_len);
 }
 
+/**
+  * Pairs are generated, filtered and evaluated one at a time (in chunk first
+  * order, as toPairs() does), and only the selected ones are stored: memory
+  * does not depend on peers_len * chunks_len
+  */
 void schedSelectHybrid(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      struct PeerChunk *selected, size_t *selected_len,	//out, inout
                      filterFunction filter,
                      pairEvaluateFunction pairevaluate)
 {
-  size_t pairs_len=peers_len*chunks_len;
-  struct PeerChunk pairs[pairs_len];
-  toPairs(peers,peers_len,chunks,chunks_len,pairs,&pairs_len);
-  filterPairs(pairs,&pairs_len,filter);
-  selectPairs(ordering,pairs,pairs_len,pairevaluate,selected,selected_len);
+  struct topk t;
+  size_t p, c, i;
+
+  topk_init(&t, ordering, MIN(*selected_len, peers_len*chunks_len));
+  for (c=0; c<chunks_len; c++){
+    for (p=0; p<peers_len; p++){
+      struct PeerChunk pair;
+
+      if (filter && !filter(peers[p],chunks[c])) {
+        continue;
+      }
+      pair.peer = peers[p];
+      pair.chunk = chunks[c];
+      topk_offer(&t, c*peers_len + p, pairevaluate(&pair));
+    }
+  }
+  *selected_len = topk_finish(&t);
+  for (i=0; i<*selected_len; i++){
+    selected[i].peer = peers[t.heap[i].index % peers_len];
+    selected[i].chunk = chunks[t.heap[i].index / peers_len];
+  }
+  topk_free(&t);
 }
 
 
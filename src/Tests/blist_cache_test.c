@@ -0,0 +1,355 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Automated test of the ranked operations on the blacklist cache:
+ *  blist_cache_rank_top() must give the first n entries of
+ *  blist_cache_rank(), and blist_cache_merge_ranked() must give the same
+ *  cache as blist_cache_union() followed by blist_cache_rank(), also when
+ *  the second cache carries newer metadata for some of the peers. Both
+ *  are also checked without a ranking function (timestamp order), and
+ *  blist_cache_rank_top() must keep the blacklist.
+ *    ./blist_cache_test [-s <seed>] [-n <number of peers>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "net_helper.h"
+#include "../Cache/blist_cache.h"
+
+#define FIRST_PORT 6666
+
+static unsigned int seed = 1;
+static int n = 100;
+
+static struct nodeID **ids;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "s:n:")) != -1) {
+    switch(o) {
+      case 's':
+        seed = atoi(optarg);
+        break;
+      case 'n':
+        n = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+/* Closest to the target first, as in the Topology Manager */
+static int rank(const void *target, const void *p1, const void *p2)
+{
+  int32_t t = *(const int32_t *)target, a = *(const int32_t *)p1, b = *(const int32_t *)p2;
+
+  return abs(t - a) == abs(t - b) ? 0 : abs(t - a) < abs(t - b) ? 1 : 2;
+}
+
+/* A cache with the peers from first to first + len - 1, with the given metadata */
+static struct peer_cache *cache_build(int first, int len, const int32_t *meta)
+{
+  struct peer_cache *c;
+  int i;
+
+  c = blist_cache_init(len, sizeof(int32_t), 0);
+  for (i = 0; i < len; i++) {
+    blist_cache_add(c, ids[first + i], &meta[first + i], sizeof(int32_t));
+  }
+
+  return c;
+}
+
+/*
+ * A cache with the peers from first to first + len - 1, where peer
+ * first + i has timestamp offset + 2 * i (new peers are added with
+ * timestamp 1, and every update increases all the timestamps)
+ */
+static struct peer_cache *cache_build_aged(int first, int len, int offset, const int32_t *meta)
+{
+  struct peer_cache *c;
+  int i, j;
+
+  c = blist_cache_init(len, sizeof(int32_t), 0);
+  for (i = len - 1; i >= 0; i--) {
+    blist_cache_add(c, ids[first + i], &meta[first + i], sizeof(int32_t));
+    for (j = 0; j < (i ? 2 : offset - 1); j++) {
+      blist_cache_update(c);
+    }
+  }
+
+  return c;
+}
+
+static int cache_size(const struct peer_cache *c)
+{
+  int i;
+
+  for (i = 0; blist_nodeid(c, i); i++);
+
+  return i;
+}
+
+static int32_t cache_meta(const struct peer_cache *c, int i)
+{
+  const int32_t *meta;
+  int size;
+
+  meta = blist_get_metadata(c, &size);
+
+  return meta[i];
+}
+
+/*
+ * The first len entries of c1 and c2 are at the same distance from the
+ * target, and (as peers with the same distance can be in any order) every
+ * peer of c1 is in c2 with the same metadata
+ */
+static int cache_compare(const struct peer_cache *c1, const struct peer_cache *c2, int len, int32_t target)
+{
+  int i, j;
+
+  for (i = 0; i < len; i++) {
+    if (abs(target - cache_meta(c1, i)) != abs(target - cache_meta(c2, i))) {
+      fprintf(stderr, "Entry %d: distance %d instead of %d\n", i, abs(target - cache_meta(c1, i)), abs(target - cache_meta(c2, i)));
+
+      return -1;
+    }
+    for (j = 0; j < len && !nodeid_equal(blist_nodeid(c1, i), blist_nodeid(c2, j)); j++);
+    if (j == len || cache_meta(c1, i) != cache_meta(c2, j)) {
+      fprintf(stderr, "Entry %d: peer missing or with wrong metadata\n", i);
+
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* The first len entries of c1 and c2 are the same peers, in the same order */
+static int cache_compare_ids(const struct peer_cache *c1, const struct peer_cache *c2, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++) {
+    if (!nodeid_equal(blist_nodeid(c1, i), blist_nodeid(c2, i))) {
+      fprintf(stderr, "Entry %d: wrong peer\n", i);
+
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int check_rank_top(const int32_t *meta)
+{
+  struct peer_cache *c, *ranked, *top;
+  int tops[] = {1, 5, n / 2, n - 1, n, 0};
+  struct nodeID *target = ids[n / 3];
+  int32_t tmeta = meta[n / 3];
+  int i, res = 0;
+
+  c = cache_build(0, n, meta);
+  ranked = blist_cache_rank(c, rank, target, &tmeta);
+  for (i = 0; i < sizeof(tops) / sizeof(tops[0]); i++) {
+    int expected = tops[i] > 0 && tops[i] < n - 1 ? tops[i] : n - 1;
+
+    top = blist_cache_rank_top(c, rank, target, &tmeta, tops[i]);
+    if (cache_size(top) != expected) {
+      fprintf(stderr, "Top %d: %d entries instead of %d\n", tops[i], cache_size(top), expected);
+      res = -1;
+    } else if (cache_compare(top, ranked, expected, tmeta) < 0) {
+      fprintf(stderr, "Top %d: wrong entries\n", tops[i]);
+      res = -1;
+    }
+    blist_cache_free(top);
+  }
+  blist_cache_free(ranked);
+  blist_cache_free(c);
+
+  return res;
+}
+
+/* c1 has the first 2/3 of the peers, and c2 the last 2/3, with newer metadata for some of them */
+static int check_merge_ranked(const int32_t *meta, const int32_t *newmeta)
+{
+  struct peer_cache *c1, *c2, *ranked, *u, *expected;
+  int32_t tmeta = meta[0];
+  int len = 2 * n / 3, size, res = 0;
+
+  c1 = cache_build(0, len, meta);
+  c2 = cache_build(n - len, len, newmeta);
+  blist_cache_update(c1);
+  u = blist_cache_union(c1, c2, &size);
+  expected = blist_cache_rank(u, rank, NULL, &tmeta);
+  blist_cache_free(u);
+  blist_cache_free(c1);
+  blist_cache_free(c2);
+
+  c1 = cache_build(0, len, meta);
+  ranked = blist_cache_rank(c1, rank, NULL, &tmeta);
+  blist_cache_free(c1);
+  c2 = cache_build(n - len, len, newmeta);
+  blist_cache_update(ranked);
+  if (blist_cache_merge_ranked(ranked, c2, rank, &tmeta) != cache_size(expected) || cache_size(ranked) != n) {
+    fprintf(stderr, "Merge: %d entries, %d expected\n", cache_size(ranked), cache_size(expected));
+    res = -1;
+  } else if (cache_compare(ranked, expected, n, tmeta) < 0) {
+    fprintf(stderr, "Merge: wrong entries\n");
+    res = -1;
+  }
+  blist_cache_free(ranked);
+  blist_cache_free(c2);
+  blist_cache_free(expected);
+
+  return res;
+}
+
+/*
+ * Without a ranking function the entries are ordered by timestamp. All the
+ * timestamps are different (c1 has the even ones and c2 the odd ones, also
+ * for the peers in both caches, which are newer in c2), so the order is unique
+ */
+static int check_timestamp_order(const int32_t *meta, const int32_t *newmeta)
+{
+  struct peer_cache *c1, *c2, *u, *ranked, *top, *expected;
+  int tops[] = {1, 5, n / 2, n - 1, n, 0};
+  int len = 2 * n / 3, size, i, res = 0;
+
+  /* The union is not sorted: the entries of c1 are followed by the ones of c2 */
+  c1 = cache_build_aged(0, len, 2, meta);
+  c2 = cache_build_aged(n - len, len, 2 * (n - len) + 1, newmeta);
+  u = blist_cache_union(c1, c2, &size);
+  blist_cache_free(c1);
+  blist_cache_free(c2);
+  expected = blist_cache_rank(u, NULL, NULL, NULL);
+  for (i = 0; i < sizeof(tops) / sizeof(tops[0]); i++) {
+    int top_len = tops[i] > 0 && tops[i] < n ? tops[i] : n;
+
+    top = blist_cache_rank_top(u, NULL, NULL, NULL, tops[i]);
+    if (cache_size(top) != top_len || cache_compare_ids(top, expected, top_len) < 0) {
+      fprintf(stderr, "Top %d by timestamp: wrong entries\n", tops[i]);
+      res = -1;
+    }
+    blist_cache_free(top);
+  }
+  blist_cache_free(u);
+
+  c1 = cache_build_aged(0, len, 2, meta);
+  ranked = blist_cache_rank(c1, NULL, NULL, NULL);
+  blist_cache_free(c1);
+  c2 = cache_build_aged(n - len, len, 2 * (n - len) + 1, newmeta);
+  if (blist_cache_merge_ranked(ranked, c2, NULL, NULL) != n || cache_compare_ids(ranked, expected, n) < 0) {
+    fprintf(stderr, "Merge by timestamp: wrong entries\n");
+    res = -1;
+  }
+  blist_cache_free(ranked);
+  blist_cache_free(c2);
+  blist_cache_free(expected);
+
+  return res;
+}
+
+/* Merging a cache with a blacklisted peer (not the sender) in it */
+static int merge_blacklisted(struct peer_cache *c, struct nodeID *blacklisted, const int32_t *meta, int32_t tmeta)
+{
+  struct peer_cache *c2;
+  int i, res = 0;
+
+  c2 = blist_cache_init(2, sizeof(int32_t), 0);
+  blist_cache_add(c2, blacklisted, &meta[0], sizeof(int32_t));
+  blist_cache_add(c2, ids[n - 1], &meta[n - 1], sizeof(int32_t));
+  blist_cache_merge_ranked(c, c2, rank, &tmeta);
+  for (i = 0; blist_nodeid(c, i); i++) {
+    if (nodeid_equal(blist_nodeid(c, i), blacklisted)) {
+      res = -1;
+    }
+  }
+  blist_cache_free(c2);
+
+  return res;
+}
+
+/* blist_cache_rank_top() keeps the blacklist, as blist_cache_rank() does */
+static int check_blacklist(const int32_t *meta)
+{
+  struct peer_cache *c, *ranked, *top;
+  struct nodeID *blacklisted;
+  int32_t tmeta = meta[0];
+  int res = 0;
+
+  /* Peers which do not reply to blist_rand_peer() twice are blacklisted */
+  c = cache_build(0, n - 1, meta);
+  do {
+    blacklisted = blist_rand_peer(c, NULL, 0);
+  } while (cache_size(c) == n - 1);
+  blacklisted = nodeid_dup(blacklisted);
+
+  ranked = blist_cache_rank(c, rank, NULL, &tmeta);
+  top = blist_cache_rank_top(c, rank, NULL, &tmeta, n / 2);
+  if (merge_blacklisted(ranked, blacklisted, meta, tmeta) < 0) {
+    fprintf(stderr, "Blacklisted peer inserted in the ranked cache\n");
+    res = -1;
+  }
+  if (merge_blacklisted(top, blacklisted, meta, tmeta) < 0) {
+    fprintf(stderr, "Blacklisted peer inserted in the top entries\n");
+    res = -1;
+  }
+  nodeid_free(blacklisted);
+  blist_cache_free(top);
+  blist_cache_free(ranked);
+  blist_cache_free(c);
+
+  return res;
+}
+
+int main(int argc, char *argv[])
+{
+  int32_t *meta, *newmeta;
+  int i, errors = 0;
+
+  cmdline_parse(argc, argv);
+  if (n < 6) {
+    fprintf(stderr, "At least 6 peers are needed\n");
+
+    return -1;
+  }
+
+  /* Few distinct values, so that there are many ties */
+  srand(seed);
+  ids = malloc(n * sizeof(struct nodeID *));
+  meta = malloc(n * sizeof(int32_t));
+  newmeta = malloc(n * sizeof(int32_t));
+  for (i = 0; i < n; i++) {
+    ids[i] = create_node("127.0.0.1", FIRST_PORT + i);
+    meta[i] = rand() % n;
+    newmeta[i] = i % 2 ? rand() % n : meta[i];
+  }
+
+  errors += check_rank_top(meta) < 0;
+  errors += check_merge_ranked(meta, newmeta) < 0;
+  errors += check_timestamp_order(meta, newmeta) < 0;
+  errors += check_blacklist(meta) < 0;
+
+  for (i = 0; i < n; i++) {
+    nodeid_free(ids[i]);
+  }
+  free(ids);
+  free(meta);
+  free(newmeta);
+
+  printf("%s\n", errors ? "FAILED" : "OK");
+
+  return errors ? -1 : 0;
+}
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Measure the cost of encoding and decoding bitmap buffer maps, for
+ *  windows of 64 to 64k chunks (90% of which are present).
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "chunkidset.h"
+#include "trade_sig_la.h"
+
+#define MAX_WINDOW (64 * 1024)
+#define BUFFSIZE (MAX_WINDOW / 8 + 64)
+
+static int density = 90;
+static int64_t work = 16 * 1024 * 1024;	/* chunks per measure */
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "d:w:")) != -1) {
+    switch(o) {
+      case 'd':
+        density = atoi(optarg);
+        break;
+      case 'w':
+        work = atoll(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+static uint64_t now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+int main(int argc, char *argv[])
+{
+  static uint8_t buff[BUFFSIZE];
+  int window;
+
+  cmdline_parse(argc, argv);
+  printf("%8s %8s %14s %14s\n", "window", "chunks", "encode (ns)", "decode (ns)");
+  for (window = 64; window <= MAX_WINDOW; window *= 4) {
+    struct chunkID_set *s, *d;
+    uint64_t t_enc, t_dec;
+    int i, len, meta_len, iterations;
+    void *meta;
+
+    s = chunkID_set_init("type=bitmap");
+    srand(window);
+    for (i = 0; i < window; i++) {
+      if (rand() % 100 < density || i == 0 || i == window - 1) {
+        chunkID_set_add_chunk(s, 1000000 + i);
+      }
+    }
+    iterations = work / window;
+
+    len = 0;
+    t_enc = now_us();
+    for (i = 0; i < iterations; i++) {
+      len = encodeChunkSignaling(s, NULL, 0, buff, sizeof(buff));
+    }
+    t_enc = now_us() - t_enc;
+    assert(len > 0);
+
+    d = NULL;
+    t_dec = now_us();
+    for (i = 0; i < iterations; i++) {
+      if (d) {
+        chunkID_set_free(d);
+      }
+      d = decodeChunkSignaling(&meta, &meta_len, buff, len);
+    }
+    t_dec = now_us() - t_dec;
+
+    assert(d && chunkID_set_size(d) == chunkID_set_size(s));
+    for (i = 0; i < chunkID_set_size(d); i++) {
+      /* Decoded in decreasing order */
+      assert(chunkID_set_get_chunk(d, i) == chunkID_set_get_chunk(s, chunkID_set_size(s) - 1 - i));
+    }
+    printf("%8d %8d %14.1f %14.1f\n", window, chunkID_set_size(s),
+           t_enc * 1000.0 / iterations, t_dec * 1000.0 / iterations);
+    chunkID_set_free(d);
+    chunkID_set_free(s);
+  }
+
+  return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  A peer sends its (sliding) buffer map to another one, first as full
+ *  buffer maps and then as deltas (see chunkSignalingConfig()); check that
+ *  the receiver always rebuilds the correct buffer map, that deltas are
+ *  actually sent, that the full buffer maps sent in delta mode are not
+ *  larger than the plain ones, and compare the number of bytes sent.
+ *  With -l, a percentage of the messages is lost: when the receiver misses
+ *  a full buffer map it requests a new one, and the next buffer map it
+ *  receives must be full.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "net_helper.h"
+#include "chunkidset.h"
+#include "grapes_msg_types.h"
+#include "trade_sig_ha.h"
+
+#define BUFFSIZE 4096
+
+static int steps = 500;
+static int window = 1024;
+static int refresh = 10;
+static int loss;
+static int port = 6666;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "n:w:r:l:P:")) != -1) {
+    switch(o) {
+      case 'n':
+        steps = atoi(optarg);
+        break;
+      case 'w':
+        window = atoi(optarg);
+        break;
+      case 'r':
+        refresh = atoi(optarg);
+        break;
+      case 'l':
+        loss = atoi(optarg);
+        break;
+      case 'P':
+        port = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+/* The buffer map at step i: a window advancing by 2 chunks per step,
+   where some of the latest chunks have not arrived yet */
+static struct chunkID_set *bmap_at(int i)
+{
+  struct chunkID_set *s;
+  int c;
+
+  s = chunkID_set_init("type=bitmap");
+  for (c = 2 * i; c < 2 * i + window; c++) {
+    if (c < 2 * i + window - 16 || (c * 7 + i) % 3) {
+      chunkID_set_add_chunk(s, c);
+    }
+  }
+
+  return s;
+}
+
+static int bmap_equal(const struct chunkID_set *a, const struct chunkID_set *b)
+{
+  int i;
+
+  if (chunkID_set_size(a) != chunkID_set_size(b)) {
+    return 0;
+  }
+  for (i = 0; i < chunkID_set_size(a); i++) {
+    int c = chunkID_set_get_chunk(a, i), j;
+
+    /* The decoded bitmaps are in reverse order: search linearly */
+    for (j = 0; j < chunkID_set_size(b) && chunkID_set_get_chunk(b, j) != c; j++);
+    if (j == chunkID_set_size(b)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Receive a signaling message, and parse it unless it is lost */
+static int sig_receive(struct nodeID *me, uint8_t *buff, struct chunkID_set **cset, enum signaling_type *type, int *len, int lost)
+{
+  struct nodeID *remote, *owner;
+  int max_deliver, res;
+  uint16_t trans_id;
+
+  *len = recv_from_peer(me, &remote, buff, BUFFSIZE);
+  if (*len <= 0) {
+    return -1;
+  }
+  nodeid_free(remote);
+  *cset = NULL;
+  if (lost) {
+    return 0;
+  }
+  owner = NULL;
+  res = parseSignaling(buff + 1, *len - 1, &owner, cset, &max_deliver, &trans_id, type);
+  if (owner) {
+    nodeid_free(owner);
+  }
+
+  return res;
+}
+
+/*
+ * Send the buffer maps from a to b. In full mode (delta == 0), store the
+ * size of each message in full_len; in delta mode, the messages shorter
+ * than the full ones are deltas, and the other ones must be exactly as
+ * large as the full ones
+ */
+static int run(struct nodeID *a, struct nodeID *b, int delta, int *full_len, int *bytes, int *deltas, int *requests)
+{
+  static uint8_t buff[BUFFSIZE];
+  char config[64];
+  int i, errors, requested;	/* the next buffer map must be full */
+
+  sprintf(config, "bmap_delta=%d,bmap_refresh=%d", delta, refresh);
+  chunkSignalingConfig(config);
+  srand(1);
+  *bytes = *deltas = *requests = errors = requested = 0;
+  for (i = 0; i < steps; i++) {
+    struct chunkID_set *map, *rmap;
+    enum signaling_type type;
+    int len, res, lost;
+
+    map = bmap_at(i);
+    sendBufferMap(a, b, NULL, map, 0, i);
+    lost = rand() % 100 < loss;
+    res = sig_receive(b, buff, &rmap, &type, &len, lost);
+    *bytes += len;
+    if (!delta) {
+      full_len[i] = len;
+    } else if (len < full_len[i]) {
+      (*deltas)++;
+      if (requested) {
+        fprintf(stderr, "Step %d: delta sent after a full buffer map has been requested\n", i);
+        errors++;
+      }
+    } else if (len != full_len[i]) {
+      fprintf(stderr, "Step %d: full buffer map of %d bytes instead of %d\n", i, len, full_len[i]);
+      errors++;
+    }
+    requested = 0;
+    if (lost) {
+      /* Nothing to check */
+    } else if (res < 0) {
+      /* A delta without its full map: ask a for its buffer map */
+      requestBufferMap(b, a, a, i);
+      sig_receive(a, buff, &rmap, &type, &len, 0);
+      (*requests)++;
+      requested = 1;
+    } else {
+      if (type != sig_send_buffermap || !bmap_equal(map, rmap)) {
+        errors++;
+      }
+      chunkID_set_free(rmap);
+    }
+    chunkID_set_free(map);
+  }
+
+  return errors;
+}
+
+int main(int argc, char *argv[])
+{
+  struct nodeID *a, *b;
+  int full_bytes, delta_bytes, deltas, requests, errors, *full_len;
+
+  cmdline_parse(argc, argv);
+  a = net_helper_init("127.0.0.1", port, "");
+  b = net_helper_init("127.0.0.1", port + 1, "");
+  if (a == NULL || b == NULL) {
+    fprintf(stderr, "Error creating the sockets\n");
+
+    return -1;
+  }
+  chunkSignalingInit(a);
+  full_len = malloc(steps * sizeof(int));
+  if (full_len == NULL) {
+    return -1;
+  }
+
+  errors = run(a, b, 0, full_len, &full_bytes, &deltas, &requests);
+  errors += run(a, b, 1, full_len, &delta_bytes, &deltas, &requests);
+  printf("%d buffer maps of %d chunks, %d%% loss\n", steps, window, loss);
+  printf("Full buffer maps: %d bytes\n", full_bytes);
+  printf("Delta buffer maps: %d bytes, %d deltas (%d full buffer maps requested)\n", delta_bytes, deltas, requests);
+  printf("Wrong buffer maps: %d\n", errors);
+  if (deltas == 0 || delta_bytes >= full_bytes) {
+    fprintf(stderr, "Delta mode has not been used\n");
+    errors++;
+  }
+  if (loss == 0 && requests) {
+    fprintf(stderr, "Full buffer maps requested without losses\n");
+    errors++;
+  }
+
+  free(full_len);
+  nodeid_free(a);
+  nodeid_free(b);
+
+  return errors ? -1 : 0;
+}
@@ -0,0 +1,206 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Measure the cost of a gossiping step on the topology cache, and of a
+ *  full Cyclon round between two local peers (query, parsing of the query
+ *  and reply, parsing of the reply).
+ *  cache_bench_checked is the same program, linked with a topology cache
+ *  and a Cyclon peer sampler compiled with CACHE_CHECKS (invariants
+ *  verified after every operation)
+ *    ./cache_bench [-n <cache size>] [-i <iterations>] [-P <port>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "net_helper.h"
+#include "peersampler.h"
+#include "../Cache/topocache.h"
+
+#define BUFFSIZE 65536
+
+static int cache_size = 100;
+static int iterations = 1000;
+static int port = 6666;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "n:i:P:")) != -1) {
+    switch(o) {
+      case 'n':
+        cache_size = atoi(optarg);
+        break;
+      case 'i':
+        iterations = atoi(optarg);
+        break;
+      case 'P':
+        port = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+static struct peer_cache *cache_fill(int first_port, int n)
+{
+  struct peer_cache *c;
+  uint8_t meta[4] = {0};
+  int i;
+
+  c = cache_init(n, sizeof(meta), 0);
+  for (i = 0; i < n; i++) {
+    struct nodeID *id;
+
+    id = create_node("127.0.0.1", first_port + i);
+    cache_add(c, id, meta, sizeof(meta));
+    nodeid_free(id);
+  }
+
+  return c;
+}
+
+/* A peer sampler having cache_size - 1 peers (which are not running) in its cache */
+static struct psample_context *psample_fill(struct nodeID *myID, int first_port)
+{
+  struct psample_context *ps;
+  uint8_t meta[4] = {0};
+  char config[128];
+  int i;
+
+  /* Messages are sent only when a peer is added */
+  sprintf(config, "protocol=cyclon,cache_size=%d,period=1000000000,bootstrap_period=1000000000", cache_size);
+  ps = psample_init(myID, meta, sizeof(meta), config);
+  for (i = 0; ps && i < cache_size - 1; i++) {
+    struct nodeID *id;
+
+    id = create_node("127.0.0.1", first_port + i);
+    psample_add_peer(ps, id, meta, sizeof(meta));
+    nodeid_free(id);
+  }
+
+  return ps;
+}
+
+/* Receive a message for ps, and parse it */
+static int psample_receive(struct nodeID *myID, struct psample_context *ps, uint8_t *buff)
+{
+  struct timeval tout = {1, 0};
+  struct nodeID *remote;
+  int len;
+
+  if (wait4data(myID, &tout, NULL) <= 0) {
+    return -1;
+  }
+  len = recv_from_peer(myID, &remote, buff, BUFFSIZE);
+  if (len < 0) {
+    return -1;
+  }
+  nodeid_free(remote);
+
+  return psample_parse_data(ps, buff, len);
+}
+
+/* Each round is started by adding b to the cache of a, which queries it */
+static int cyclon_bench(void)
+{
+  struct nodeID *a_id, *b_id;
+  struct psample_context *a, *b;
+  struct timeval start, end;
+  uint8_t meta[4] = {0};
+  uint8_t *buff;
+  int i, res = 0;
+  double us;
+
+  a_id = net_helper_init("127.0.0.1", port, "");
+  b_id = net_helper_init("127.0.0.1", port + 1, "");
+  if (a_id == NULL || b_id == NULL) {
+    fprintf(stderr, "Error creating the sockets\n");
+
+    return -1;
+  }
+  /* Half of the peers known by b are known by a too */
+  a = psample_fill(a_id, 10000);
+  b = psample_fill(b_id, 10000 + cache_size / 2);
+  buff = malloc(BUFFSIZE);
+  if (a == NULL || b == NULL || buff == NULL) {
+    fprintf(stderr, "Error creating the peer samplers\n");
+
+    return -1;
+  }
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < iterations && res >= 0; i++) {
+    psample_remove_peer(a, b_id);
+    if (psample_add_peer(a, b_id, meta, sizeof(meta)) < 0 ||
+        psample_receive(b_id, b, buff) < 0 || psample_receive(a_id, a, buff) < 0) {
+      fprintf(stderr, "Cyclon round %d failed\n", i);
+      res = -1;
+    }
+  }
+  gettimeofday(&end, NULL);
+
+  us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_usec - start.tv_usec);
+  printf("Cache size %d: %d Cyclon rounds in %.0fus (%.2fus per round)\n",
+         cache_size, i, us, us / i);
+  psample_destroy(&a);
+  psample_destroy(&b);
+  free(buff);
+  nodeid_free(a_id);
+  nodeid_free(b_id);
+  net_helper_deinit();
+
+  return res;
+}
+
+int main(int argc, char *argv[])
+{
+  struct peer_cache *local, *remote;
+  struct timeval start, end;
+  int i, source;
+  double us;
+
+  cmdline_parse(argc, argv);
+  if (cache_size < 2 || iterations < 1) {
+    fprintf(stderr, "Error: the cache size must be at least 2, and at least an iteration is needed\n");
+
+    return -1;
+  }
+  /* Half of the remote peers are already known */
+  local = cache_fill(10000, cache_size);
+  remote = cache_fill(10000 + cache_size / 2, cache_size);
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < iterations; i++) {
+    struct peer_cache *l, *r, *sent, *merged;
+
+    l = cache_copy(local);
+    r = cache_copy(remote);
+    cache_update(l);
+    sent = rand_cache(l, cache_size / 2);
+    merged = merge_caches(l, r, cache_size, &source);
+    cache_fill_rand(merged, sent, 0);
+    cache_free(l);
+    cache_free(r);
+    cache_free(sent);
+    cache_free(merged);
+  }
+  gettimeofday(&end, NULL);
+
+  us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_usec - start.tv_usec);
+  printf("Cache size %d: %d gossiping steps in %.0fus (%.2fus per step)\n",
+         cache_size, iterations, us, us / iterations);
+  cache_free(local);
+  cache_free(remote);
+
+  return cyclon_bench() < 0 ? -1 : 0;
+}
@@ -0,0 +1,260 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Automated test of the ring chunk buffer: eviction (compared with the
+ *  one of the array buffer), duplicates, chunks older than the window,
+ *  IDs close to INT_MAX, and random insertions compared with a brute
+ *  force model of the window.
+ *    ./cb_ring_test [-s <seed>] [-n <number of insertions>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+
+#include "chunk.h"
+#include "chunkbuffer.h"
+
+#define SIZE 8
+
+static unsigned int seed = 1;
+static int n = 10000;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "s:n:")) != -1) {
+    switch(o) {
+      case 's':
+        seed = atoi(optarg);
+        break;
+      case 'n':
+        n = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+/* Chunks without payload, with timestamps growing with the ID */
+static int add(struct chunk_buffer *cb, int id)
+{
+  struct chunk c;
+
+  memset(&c, 0, sizeof(c));
+  c.id = id;
+  c.timestamp = 40 * (uint64_t)id;
+
+  return cb_add_chunk(cb, &c);
+}
+
+/* The buffer contains exactly the given IDs */
+static int check_ids(const struct chunk_buffer *cb, const int *ids, int len, const char *what)
+{
+  struct chunk *chunks;
+  int i, size;
+
+  chunks = cb_get_chunks(cb, &size);
+  if (size != len) {
+    fprintf(stderr, "%s: %d chunks instead of %d\n", what, size, len);
+
+    return -1;
+  }
+  for (i = 0; i < len; i++) {
+    if (chunks[i].id != ids[i]) {
+      fprintf(stderr, "%s: chunk %d has ID %d instead of %d\n", what, i, chunks[i].id, ids[i]);
+
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * With 5, 10 and 12 in the buffer, 40 evicts all of them from the ring
+ * (its window becomes 33 - 40), while the array keeps them, as it is not full
+ */
+static int check_eviction(const char *type, const int *expected, int len)
+{
+  struct chunk_buffer *cb;
+  char config[32];
+  int res = 0;
+
+  sprintf(config, "size=%d,type=%s", SIZE, type);
+  cb = cb_init(config);
+  if (add(cb, 10) < 0 || add(cb, 5) < 0 || add(cb, 12) < 0) {
+    fprintf(stderr, "Eviction (%s): chunk not inserted\n", type);
+    res = -1;
+  }
+  if (add(cb, 12) != E_CB_DUPLICATE) {
+    fprintf(stderr, "Eviction (%s): duplicate inserted\n", type);
+    res = -1;
+  }
+  if (add(cb, 40) < 0) {
+    fprintf(stderr, "Eviction (%s): chunk 40 not inserted\n", type);
+    res = -1;
+  }
+  if (check_ids(cb, expected, len, type) < 0) {
+    res = -1;
+  }
+  cb_destroy(cb);
+
+  return res;
+}
+
+static int check_window(void)
+{
+  struct chunk_buffer *cb;
+  int full[] = {34, 35, 36, 37, 38, 39, 40, 41};
+  int holes[] = {38, 39, 40, 41, 45};
+  int jump[] = {1000};
+  int id, res = 0;
+
+  cb = cb_init("size=8,type=ring");
+  for (id = 40; id > 40 - SIZE; id--) {
+    if (add(cb, id) < 0) {
+      fprintf(stderr, "Window: chunk %d not inserted\n", id);
+      res = -1;
+    }
+  }
+  if (add(cb, 40 - SIZE) != E_CB_OLD || add(cb, 2) != E_CB_OLD || add(cb, -1) != E_CB_OLD) {
+    fprintf(stderr, "Window: chunk out of the window inserted\n");
+    res = -1;
+  }
+  if (add(cb, 41) < 0 || add(cb, 33) != E_CB_OLD) {
+    fprintf(stderr, "Window: the window did not move\n");
+    res = -1;
+  }
+  res |= check_ids(cb, full, sizeof(full) / sizeof(full[0]), "Window");
+  if (cb_get_chunk(cb, 33) || cb_get_chunk(cb, 42) || !cb_get_chunk(cb, 34) || !cb_get_chunk(cb, 41)) {
+    fprintf(stderr, "Window: wrong lookup\n");
+    res = -1;
+  }
+  add(cb, 45);
+  res |= check_ids(cb, holes, sizeof(holes) / sizeof(holes[0]), "Window with holes");
+  add(cb, 1000);
+  res |= check_ids(cb, jump, 1, "Jump");
+  cb_destroy(cb);
+
+  return res;
+}
+
+static int check_large_ids(void)
+{
+  struct chunk_buffer *cb;
+  int top[] = {INT_MAX - 3, INT_MAX - 2, INT_MAX - 1, INT_MAX};
+  int res = 0;
+
+  cb = cb_init("size=8,type=ring");
+  add(cb, 100);
+  add(cb, INT_MAX - 20);
+  add(cb, INT_MAX - 3);
+  add(cb, INT_MAX);
+  add(cb, INT_MAX - 1);
+  add(cb, INT_MAX - 2);
+  res |= check_ids(cb, top, sizeof(top) / sizeof(top[0]), "Large IDs");
+  if (add(cb, INT_MAX) != E_CB_DUPLICATE || add(cb, INT_MAX - SIZE) != E_CB_OLD) {
+    fprintf(stderr, "Large IDs: duplicate or old chunk inserted\n");
+    res = -1;
+  }
+  if (cb_get_chunk(cb, INT_MAX) == NULL) {
+    fprintf(stderr, "Large IDs: chunk %d not found\n", INT_MAX);
+    res = -1;
+  }
+  cb_clear(cb);
+  res |= check_ids(cb, NULL, 0, "Large IDs, cleared");
+  add(cb, INT_MAX);
+  res |= check_ids(cb, top + 3, 1, "Large IDs, after clearing");
+  cb_destroy(cb);
+
+  return res;
+}
+
+/*
+ * The buffer keeps the IDs in (last - SIZE, last]: compare random
+ * insertions (moving forward, with some old and duplicated IDs) with
+ * an array of flags (each insertion moves forward by less than SIZE)
+ */
+static int check_random(void)
+{
+  struct chunk_buffer *cb;
+  int *present, ids[SIZE];
+  int i, last = -1, count = 0, res = 0;
+
+  present = calloc(n + 1, SIZE * sizeof(int));
+  cb = cb_init("size=8,type=ring");
+  srand(seed);
+  for (i = 0; i < n && res == 0; i++) {
+    int id, expected, got, j, len;
+
+    id = (last < 0 ? 0 : last) + rand() % (2 * SIZE) - SIZE;
+    if (id < 0) {
+      id = 0;
+    }
+    if (count && id <= last - SIZE) {
+      expected = E_CB_OLD;
+    } else if (present[id]) {
+      expected = E_CB_DUPLICATE;
+    } else {
+      expected = 0;
+      if (id > last) {
+        for (j = last - SIZE + 1; j <= id - SIZE; j++) {
+          if (j >= 0 && present[j]) {
+            present[j] = 0;
+            count--;
+          }
+        }
+        last = id;
+      }
+      present[id] = 1;
+      count++;
+    }
+    got = add(cb, id);
+    if ((got < 0 ? got : 0) != expected) {
+      fprintf(stderr, "Random: adding %d returned %d instead of %d\n", id, got, expected);
+      res = -1;
+    }
+    for (len = 0, j = last - SIZE + 1; j <= last; j++) {
+      if (j >= 0 && present[j]) {
+        ids[len++] = j;
+      }
+    }
+    res |= check_ids(cb, ids, len, "Random");
+    if ((cb_get_chunk(cb, id) != NULL) != present[id]) {
+      fprintf(stderr, "Random: wrong lookup of %d\n", id);
+      res = -1;
+    }
+  }
+  cb_destroy(cb);
+  free(present);
+
+  return res;
+}
+
+int main(int argc, char *argv[])
+{
+  int array_ids[] = {5, 10, 12, 40};
+  int ring_ids[] = {40};
+  int errors = 0;
+
+  cmdline_parse(argc, argv);
+
+  errors += check_eviction("array", array_ids, 4) < 0;
+  errors += check_eviction("ring", ring_ids, 1) < 0;
+  errors += check_window() < 0;
+  errors += check_large_ids() < 0;
+  errors += check_random() < 0;
+
+  printf("%s\n", errors ? "FAILED" : "OK");
+
+  return errors ? -1 : 0;
+}
@@ -68,7 +68,7 @@ int main(int argc, char *argv[])
 {
   struct chunk_buffer *b;
 
-  b = cb_init("size=8,time=now");
+  b = cb_init(argc > 1 ? argv[1] : "size=8,time=now");
   if (b == NULL) {
     printf("Error initialising the Chunk Buffer\n");
 
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include "chunk.h"
+#include "chunk_pool.h"
 #include "trade_msg_la.h"
 
 static void chunk_print(FILE *f, const struct chunk *c)
@@ -36,6 +37,7 @@ int main(int argc, char *argv[])
   struct chunk src_c;
   struct chunk dst_c;
   uint8_t buff[100];
+  uint8_t *pool_buff;
   int res;
 
   src_c.id = 666;
@@ -60,5 +62,28 @@ int main(int argc, char *argv[])
   chunk_print(stdout, &dst_c);
   free(dst_c.data);
 
-  return 0;
+  res = chunk_pool_init("min_size=64,slab_blocks=4");
+  fprintf(stdout, "Pool initialisation: %d\n", res);
+  /* decodeChunk() does not use the pool: its payload is released with free() */
+  res = decodeChunk(&dst_c, buff, sizeof(buff));
+  fprintf(stdout, "Decoding it with the pool: %d\n", res);
+  free(dst_c.data);
+  pool_buff = chunk_payload_alloc(sizeof(buff));
+  memcpy(pool_buff, buff, sizeof(buff));
+  res = decodeChunkAdopt(&dst_c, pool_buff, sizeof(buff));
+  fprintf(stdout, "Decoding it without copies: %d (%s)\n", res,
+          dst_c.data == pool_buff + 24 ? "shared" : "copied");
+  chunk_payload_release(pool_buff);
+  chunk_print(stdout, &dst_c);
+  /* The chunk still refers to the pool: it cannot be destroyed yet */
+  res = chunk_pool_destroy();
+  fprintf(stdout, "Destroying the pool while it is in use: %d\n", res);
+  if (res == 0) {
+    return -1;
+  }
+  chunk_payload_release(dst_c.data);
+  res = chunk_pool_destroy();
+  fprintf(stdout, "Destroying the pool: %d\n", res);
+
+  return res;
 }
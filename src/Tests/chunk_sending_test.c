@@ -9,6 +9,8 @@
 #include <string.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include "net_helper.h"
 #include "chunk.h"
@@ -21,10 +23,15 @@ static const char *my_addr;
 static int port = 6666;
 static int dst_port;
 static const char *dst_ip;
+static int msgs;
+static int msg_size = 1024;
+static int fanout = 1;
 extern enum L3PROTOCOL {IPv4, IPv6} l3;
 
 
 #define BUFFSIZE 1024
+#define BATCH 32
+#define MAX_FANOUT 256
 
 static void chunk_print(FILE *f, const struct chunk *c)
 {
@@ -65,8 +72,22 @@ static void cmdline_parse(int argc, char *argv[])
 {
   int o;
 
-  while ((o = getopt(argc, argv, "6p:i:P:I: ")) != -1) {
+  while ((o = getopt(argc, argv, "6p:i:P:I:n:s:f: ")) != -1) {
     switch(o) {
+      case 'n':
+        msgs = atoi(optarg);
+        break;
+      case 's':
+        msg_size = atoi(optarg);
+        break;
+      case 'f':
+        fanout = atoi(optarg);
+        if (fanout < 1 || fanout > MAX_FANOUT) {
+          fprintf(stderr, "Error: fanout must be between 1 and %d\n", MAX_FANOUT);
+
+          exit(-1);
+        }
+        break;
       case 'p':
         dst_port = atoi(optarg);
         break;
@@ -90,6 +111,103 @@ static void cmdline_parse(int argc, char *argv[])
   }
 }
 
+static void throughput_print(const char *what, int n, const struct timeval *start, const struct rusage *ru_start,
+                             const struct timeval *end, const struct rusage *ru)
+{
+  double elapsed, cpu;
+
+  elapsed = (end->tv_sec - start->tv_sec) + (end->tv_usec - start->tv_usec) / 1e6;
+  cpu = (ru->ru_utime.tv_sec - ru_start->ru_utime.tv_sec) + (ru->ru_utime.tv_usec - ru_start->ru_utime.tv_usec) / 1e6 +
+        (ru->ru_stime.tv_sec - ru_start->ru_stime.tv_sec) + (ru->ru_stime.tv_usec - ru_start->ru_stime.tv_usec) / 1e6;
+  fprintf(stdout, "%s %d messages in %f s: %f msgs/s, %f us CPU per message\n",
+          what, n, elapsed, elapsed > 0 ? n / elapsed : 0, n ? cpu * 1e6 / n : 0);
+}
+
+/* Send msgs chunks, each one to fanout copies of the destination */
+static void throughput_send(struct nodeID *my_sock, struct nodeID *dst)
+{
+  struct nodeID *to[MAX_FANOUT];
+  struct timeval start, end;
+  struct rusage ru_start, ru;
+  struct chunk c;
+  uint8_t *buff;
+  int i, len, sent;
+
+  for (i = 0; i < fanout; i++) {
+    to[i] = dst;
+  }
+  c.timestamp = 1000000000ULL;
+  c.size = msg_size;
+  c.data = malloc(msg_size);
+  memset(c.data, 'x', msg_size);
+  c.attributes_size = 0;
+  c.flow_id = 0;
+  len = 1 + 2 + CHUNK_HEADER_SIZE + msg_size;
+  buff = malloc(len);
+
+  sent = 0;
+  gettimeofday(&start, NULL);
+  getrusage(RUSAGE_SELF, &ru_start);
+  for (i = 0; i < msgs; i++) {
+    c.id = i;
+    buff[0] = MSG_TYPE_CHUNK;
+    buff[1] = buff[2] = 0;
+    encodeChunk(&c, buff + 3, len - 3);
+    sent += send_to_peers_batch(my_sock, to, fanout, buff, len);
+  }
+  gettimeofday(&end, NULL);
+  getrusage(RUSAGE_SELF, &ru);
+  throughput_print("Sent", sent, &start, &ru_start, &end, &ru);
+
+  free(buff);
+  free(c.data);
+}
+
+/* Receive until msgs messages arrived, or the sender went quiet for 2s (UDP can drop!) */
+static void throughput_recv(struct nodeID *my_sock)
+{
+  struct nodeID *remote[BATCH];
+  uint8_t *buff[BATCH];
+  int len[BATCH];
+  struct timeval start, end;
+  struct rusage ru_start, ru;
+  int i, res, received, size;
+
+  size = 1 + 2 + CHUNK_HEADER_SIZE + msg_size;
+  for (i = 0; i < BATCH; i++) {
+    buff[i] = malloc(size);
+  }
+
+  received = 0;
+  while (received < msgs) {
+    struct timeval tout = {2, 0};
+
+    if (wait4data(my_sock, &tout, NULL) <= 0) {
+      break;
+    }
+    if (received == 0) {
+      gettimeofday(&start, NULL);
+      getrusage(RUSAGE_SELF, &ru_start);
+    }
+    res = recv_from_peer_batch(my_sock, remote, buff, size, len, BATCH);
+    for (i = 0; i < res; i++) {
+      if (buff[i][0] == MSG_TYPE_CHUNK && len[i] == size) {
+        received++;
+      }
+      nodeid_free(remote[i]);
+    }
+    gettimeofday(&end, NULL);
+    getrusage(RUSAGE_SELF, &ru);
+  }
+  if (received) {
+    throughput_print("Received", received, &start, &ru_start, &end, &ru);
+  }
+
+  for (i = 0; i < BATCH; i++) {
+    free(buff[i]);
+  }
+}
+
 int main(int argc, char *argv[])
 {
   struct nodeID *my_sock;
@@ -98,7 +216,18 @@ int main(int argc, char *argv[])
   cmdline_parse(argc, argv);
 
   my_sock = init();
-  if (dst_port != 0) {
+  if (msgs > 0) {
+    /* Throughput mode */
+    if (dst_port != 0) {
+      struct nodeID *dst;
+
+      dst = create_node(dst_ip, dst_port);
+      throughput_send(my_sock, dst);
+      nodeid_free(dst);
+    } else {
+      throughput_recv(my_sock);
+    }
+  } else if (dst_port != 0) {
     struct nodeID *dst;
 
     c.id = 666;
@@ -108,7 +237,7 @@ int main(int argc, char *argv[])
     c.attributes_size = 0;
 
     dst = create_node(dst_ip, dst_port);
-    sendChunk(dst, &c, 0);
+    sendChunk(my_sock, dst, &c, 0);
     nodeid_free(dst);
     free(c.data);
   } else {
@@ -147,7 +147,7 @@ int client_side(struct nodeID *my_sock)
             }
             fillChunkID_set(cset, random_bmap);
             fprintf(stdout, "\"OFFER\" ");
-            ret = offerChunks(dst, cset, 8, 22);
+            ret = offerChunks(my_sock, dst, cset, 8, 22);
             break;
         case request:
             cset = chunkID_set_init("size=10");
@@ -160,7 +160,7 @@ int client_side(struct nodeID *my_sock)
             fprintf(stdout, "\"REQUEST\" ");
             fillChunkID_set(cset,random_bmap);
             printChunkID_set(cset);
-            ret = requestChunks(dst, cset, 10, 44);
+            ret = requestChunks(my_sock, dst, cset, 10, 44);
             break;
         case sendbmap:
             cset = chunkID_set_init("type=bitmap,size=10");
@@ -172,11 +172,11 @@ int client_side(struct nodeID *my_sock)
             }
             fillChunkID_set(cset, random_bmap);
             fprintf(stdout, "\"SEND BMAP\" ");
-            ret = sendBufferMap(dst, dst, cset, 0, 88);
+            ret = sendBufferMap(my_sock, dst, NULL, cset, 0, 88);
             break;
         case reqbmap:
             fprintf(stdout, "\"REQUEST BMAP\" ");
-            ret = requestBufferMap(dst, NULL, 99);
+            ret = requestBufferMap(my_sock, dst, NULL, 99);
             break;
         default:
             printf("Please select one operation (O)ffer, (R)equest, send (B)map, request (b)map\n");
@@ -213,7 +213,7 @@ int server_side(struct nodeID *my_sock)
             rcset = chunkID_set_init("size=1");
             fprintf(stdout, "2) Acceping only latest chunk #%d\n", chunktosend);
             chunkID_set_add_chunk(rcset, chunktosend);
-            acceptChunks(remote, rcset, trans_id++);
+            acceptChunks(my_sock, remote, rcset, trans_id++);
             break;
         case sig_request:
             fprintf(stdout, "1) Message REQUEST: peer requests %d chunks\n", chunkID_set_size(cset));
@@ -222,7 +222,7 @@ int server_side(struct nodeID *my_sock)
             rcset = chunkID_set_init("size=1");
             fprintf(stdout, "2) Deliver only earliest chunk #%d\n", chunktosend);
             chunkID_set_add_chunk(rcset, chunktosend);
-            deliverChunks(remote, rcset, trans_id++);
+            deliverChunks(my_sock, remote, rcset, trans_id++);
             break;
         case sig_send_buffermap:
             fprintf(stdout, "1) Message SEND_BMAP: I received a buffer of %d chunks\n", chunkID_set_size(cset));
@@ -236,7 +236,7 @@ int server_side(struct nodeID *my_sock)
             fillChunkID_set(rcset, random_bmap);
             fprintf(stdout, "2) Message SEND_BMAP: I send my buffer of %d chunks\n", chunkID_set_size(rcset));
             printChunkID_set(rcset);
-            sendBufferMap(remote, my_sock, rcset, 0, trans_id++);
+            sendBufferMap(my_sock, remote, NULL, rcset, 0, trans_id++);
             break;
         case sig_request_buffermap:
             fprintf(stdout, "1) Message REQUEST_BMAP: Someone requeste my buffer map [%d]\n", (cset == NULL));
@@ -247,7 +247,7 @@ int server_side(struct nodeID *my_sock)
                 return -1;
             }
             fillChunkID_set(rcset, random_bmap);
-            sendBufferMap(remote, my_sock, rcset, 0, trans_id++);
+            sendBufferMap(my_sock, remote, NULL, rcset, 0, trans_id++);
             break;
     }
     nodeid_free(remote);
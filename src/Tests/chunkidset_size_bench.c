@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Compare the size of the buffer map messages produced by the chunk ID
+ *  set encodings ("priority" list, "bitmap", "ranges", and "auto", which
+ *  picks the smallest one) for some typical buffer map shapes, checking
+ *  that every message decodes to the original set.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+
+#include "chunkidset.h"
+#include "trade_sig_la.h"
+
+#define BUFFSIZE (1024 * 1024)
+
+static const char *types[] = {"priority", "bitmap", "ranges", "auto"};
+#define TYPES (sizeof(types) / sizeof(types[0]))
+
+static int window = 256;
+static int base = 100000;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "w:")) != -1) {
+    switch(o) {
+      case 'w':
+        window = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+/* Build a buffer map of the given shape, using the given set type */
+static struct chunkID_set *shape_fill(int shape, const char *type)
+{
+  struct chunkID_set *s;
+  char config[32];
+  int i;
+
+  sprintf(config, "type=%s", type);
+  s = chunkID_set_init(config);
+  srand(shape + 1);
+  for (i = 0; i < window; i++) {
+    switch (shape) {
+      case 0:		/* complete window */
+        chunkID_set_add_chunk(s, base + i);
+        break;
+      case 1:		/* 10% of the chunks missing */
+        if (rand() % 10) {
+          chunkID_set_add_chunk(s, base + i);
+        }
+        break;
+      case 2:		/* complete, except some of the latest chunks */
+        if (i < window - 32 || rand() % 2) {
+          chunkID_set_add_chunk(s, base + i);
+        }
+        break;
+      case 3:		/* complete window, and an old chunk */
+        chunkID_set_add_chunk(s, base + i);
+        if (i == 0) {
+          chunkID_set_add_chunk(s, base - 50000);
+        }
+        break;
+      case 4:		/* few sparse chunks */
+        if (rand() % 8 == 0) {
+          chunkID_set_add_chunk(s, base + i * 40);
+        }
+        break;
+    }
+  }
+
+  return s;
+}
+
+static const char *shape_names[] = {
+  "complete window",
+  "10% missing",
+  "latest chunks missing",
+  "window + outlier",
+  "sparse",
+};
+#define SHAPES (sizeof(shape_names) / sizeof(shape_names[0]))
+
+static void check_decoding(const struct chunkID_set *s, const uint8_t *buff, int len)
+{
+  struct chunkID_set *d;
+  void *meta;
+  int meta_len, i;
+
+  d = decodeChunkSignaling(&meta, &meta_len, buff, len);
+  assert(d && chunkID_set_size(d) == chunkID_set_size(s));
+  for (i = 0; i < chunkID_set_size(d); i++) {
+    int j, c = chunkID_set_get_chunk(d, i);
+
+    /* The decoded bitmaps are not sorted: search linearly */
+    for (j = 0; j < chunkID_set_size(s) && chunkID_set_get_chunk(s, j) != c; j++);
+    assert(j < chunkID_set_size(s));
+  }
+  chunkID_set_free(d);
+}
+
+int main(int argc, char *argv[])
+{
+  static uint8_t buff[BUFFSIZE];
+  int i, j;
+
+  cmdline_parse(argc, argv);
+  printf("%-24s %8s", "Shape", "chunks");
+  for (j = 0; j < TYPES; j++) {
+    printf(" %9s", types[j]);
+  }
+  printf("\n");
+  for (i = 0; i < SHAPES; i++) {
+    struct chunkID_set *s;
+
+    s = shape_fill(i, types[0]);
+    printf("%-24s %8d", shape_names[i], chunkID_set_size(s));
+    chunkID_set_free(s);
+    for (j = 0; j < TYPES; j++) {
+      int len;
+
+      s = shape_fill(i, types[j]);
+      len = encodeChunkSignaling(s, NULL, 0, buff, sizeof(buff));
+      assert(len > 0);
+      check_decoding(s, buff, len);
+      printf(" %9d", len);
+      chunkID_set_free(s);
+    }
+    printf("\n");
+  }
+
+  return 0;
+}
@@ -89,12 +89,195 @@ static void metadata_test(void)
   free(meta);
 }
 
+/* Set types: the list, set and bitset ops, and a decoded bitmap (in decreasing order) */
+static const char *modes[] = {"priority", "ranges", "bitmap", "bitset", "decoded"};
+
+static struct chunkID_set *set_build(const char *mode, const int *ids, int n)
+{
+  struct chunkID_set *cset;
+  static uint8_t buff[2048];
+  char config[32];
+  int i, len, meta_len;
+  void *meta;
+
+  sprintf(config, "type=%s", strcmp(mode, "decoded") ? mode : "bitmap");
+  cset = chunkID_set_init(config);
+  if (!cset) {
+    return NULL;
+  }
+  for (i = 0; i < n; i++) {
+    chunkID_set_add_chunk(cset, ids[i]);
+  }
+  if (!strcmp(mode, "decoded")) {
+    len = encodeChunkSignaling(cset, NULL, 0, buff, sizeof(buff));
+    chunkID_set_free(cset);
+    cset = decodeChunkSignaling(&meta, &meta_len, buff, len);
+  }
+
+  return cset;
+}
+
+/* Number of elements of h which are (in = 1) or are not (in = 0) in a */
+static int count_in(const struct chunkID_set *h, const struct chunkID_set *a, int in)
+{
+  int i, n = 0;
+
+  for (i = 0; i < chunkID_set_size(h); i++) {
+    n += (chunkID_set_check(a, chunkID_set_get_chunk(h, i)) >= 0) == in;
+  }
+
+  return n;
+}
+
+/* Every element of h is in a (in = 1), or none is (in = 0) */
+static int all_in(const struct chunkID_set *h, const struct chunkID_set *a, int in)
+{
+  return count_in(h, a, in) == chunkID_set_size(h);
+}
+
+static int bitset_test(void)
+{
+  struct chunkID_set *cset, *cset1, *copy;
+  int kept[10];
+  int i, n, res = 0;
+
+  cset = chunkID_set_init("type=bitset");
+  cset1 = chunkID_set_init("type=bitset");
+  copy = chunkID_set_init("type=bitset");
+  if (!cset || !cset1 || !copy) {
+    fprintf(stderr,"Unable to allocate memory for the bitset sets\n");
+
+    return -1;
+  }
+
+  for (i = 0; i < 10; i++) {
+    chunkID_set_add_chunk(cset, 1000 + i * 7);
+    chunkID_set_add_chunk(cset1, 1000 + i * 5);
+  }
+  chunkID_set_add_chunk(cset, 10);
+  chunkID_set_add_chunk(cset, 5000);
+  if (chunkID_set_size(cset) != 12 || chunkID_set_check(cset, 10) < 0 ||
+      chunkID_set_check(cset, 11) >= 0 || chunkID_set_check(cset, 5000) < 0) {
+    fprintf(stderr, "Bitset: wrong elements\n");
+    res = -1;
+  }
+  chunkID_set_union(copy, cset);
+  n = chunkID_set_size(cset) + count_in(cset1, cset, 0);
+  if (chunkID_set_union(cset, cset1) != n || !all_in(copy, cset, 1) || !all_in(cset1, cset, 1)) {
+    fprintf(stderr, "Bitset: wrong union (%d chunks, %d expected)\n", chunkID_set_size(cset), n);
+    res = -1;
+  }
+
+  /* Trimming keeps the last chunks, and drops the others from the bitset too */
+  for (i = 0; i < 10; i++) {
+    kept[i] = chunkID_set_get_chunk(cset, chunkID_set_size(cset) - 10 + i);
+  }
+  chunkID_set_clear(copy, 0);
+  chunkID_set_union(copy, cset);
+  chunkID_set_trim(cset, 10);
+  for (i = 0; i < 10; i++) {
+    if (chunkID_set_get_chunk(cset, i) != kept[i]) {
+      res = -1;
+    }
+  }
+  if (res < 0 || chunkID_set_size(cset) != 10 || count_in(copy, cset, 1) != 10) {
+    fprintf(stderr, "Bitset: wrong trim\n");
+    res = -1;
+  }
+
+  chunkID_set_free(copy);
+  chunkID_set_free(cset1);
+  chunkID_set_free(cset);
+
+  return res;
+}
+
+/*
+ * Compare union, intersection and difference of two random sets (partly
+ * overlapping, in random order) with the results of chunkID_set_check()
+ */
+static int algebra_test(const char *mode, const char *other_mode, unsigned int seed)
+{
+  struct chunkID_set *mine, *other, *res_set;
+  int ids[100], other_ids[100];
+  int i, n, res = 0;
+
+  srand(seed);
+  for (i = 0; i < 100; i++) {
+    ids[i] = 1000 + rand() % 200;
+    other_ids[i] = 1100 + rand() % 200;
+  }
+  mine = set_build(mode, ids, 100);
+  other = set_build(other_mode, other_ids, 100);
+  if (!mine || !other) {
+    fprintf(stderr,"Unable to allocate memory for the sets\n");
+
+    return -1;
+  }
+  for (i = 0; i < 100; i++) {
+    if (chunkID_set_check(mine, ids[i]) < 0 || chunkID_set_check(other, other_ids[i]) < 0) {
+      fprintf(stderr, "%s vs %s: chunk missing after adding it\n", mode, other_mode);
+      res = -1;
+      break;
+    }
+  }
+
+  n = count_in(mine, other, 1);
+  if (chunkID_set_intersect_size(mine, other) != n || chunkID_set_difference_size(mine, other) != chunkID_set_size(mine) - n) {
+    fprintf(stderr, "%s vs %s: intersection size %d, difference size %d, instead of %d and %d\n", mode, other_mode,
+            chunkID_set_intersect_size(mine, other), chunkID_set_difference_size(mine, other), n, chunkID_set_size(mine) - n);
+    res = -1;
+  }
+
+  res_set = set_build(mode, ids, 100);
+  if (chunkID_set_intersect(res_set, other) != n || !all_in(res_set, mine, 1) || !all_in(res_set, other, 1)) {
+    fprintf(stderr, "%s vs %s: wrong intersection\n", mode, other_mode);
+    res = -1;
+  }
+  chunkID_set_free(res_set);
+
+  res_set = set_build(mode, ids, 100);
+  if (chunkID_set_difference(res_set, other) != chunkID_set_size(mine) - n || !all_in(res_set, mine, 1) || !all_in(res_set, other, 0)) {
+    fprintf(stderr, "%s vs %s: wrong difference\n", mode, other_mode);
+    res = -1;
+  }
+  chunkID_set_free(res_set);
+
+  res_set = set_build(mode, ids, 100);
+  n = chunkID_set_size(mine) + count_in(other, mine, 0);
+  if (chunkID_set_union(res_set, other) != n || !all_in(mine, res_set, 1) || !all_in(other, res_set, 1)) {
+    fprintf(stderr, "%s vs %s: wrong union (%d chunks instead of %d)\n", mode, other_mode, chunkID_set_size(res_set), n);
+    res = -1;
+  }
+  chunkID_set_free(res_set);
+
+  chunkID_set_free(other);
+  chunkID_set_free(mine);
+
+  return res;
+}
+
 int main(int argc, char *argv[])
 {
+  int i, j, seed, errors = 0;
+
   simple_test();
   encoding_test("priority");
   encoding_test("bitmap");
+  encoding_test("ranges");
+  encoding_test("auto");
+  encoding_test("bitset");
+  errors += bitset_test() < 0;
+  for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+    for (j = 0; j < sizeof(modes) / sizeof(modes[0]); j++) {
+      for (seed = 1; seed <= 10; seed++) {
+        errors += algebra_test(modes[i], modes[j], seed) < 0;
+      }
+    }
+  }
   metadata_test();
 
-  return 0;
+  printf("%s\n", errors ? "FAILED" : "OK");
+
+  return errors ? -1 : 0;
 }
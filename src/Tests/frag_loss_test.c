@@ -0,0 +1,238 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Send messages through a lossy relay, and show how many of them (and how
+ *  many bytes) are received, and how many received bytes are wasted because
+ *  some other fragment of their message has been lost. Lost messages and
+ *  bytes are counted on the sender side, so that the modes can be compared:
+ *  the receiver does not see the 60KB fragments which lost an IP packet.
+ *  Messages are delivered only if all their fragments arrive, so the
+ *  goodput is about the same in all the modes.
+ *  The relay drops each datagram with the probability that at least one of
+ *  the IP packets it would be split in (on an Ethernet link) is lost.
+ *  Compare, for example,
+ *    ./frag_loss_test -l 1
+ *  (60KB fragments, split by the IP layer) with
+ *    ./frag_loss_test -l 1 -m 1500
+ *  (fragments fitting in a 1500 bytes IP packet). -g uses UDP segmentation
+ *  offload (GSO and GRO) to send and receive the fragments.
+ *  The test fails if a received message is corrupted, or if some message
+ *  is lost when there is no packet loss (-l 0)
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "net_helper.h"
+
+#define LINK_MTU 1500
+#define BUFFSIZE (1024 * 1024)
+
+static int msgs = 500;
+static int msg_size = 50000;
+static double loss = 1.0;
+static int mtu;
+static int port = 6666;
+static int offload;
+static int corrupted;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "n:s:l:m:P:g")) != -1) {
+    switch(o) {
+      case 'n':
+        msgs = atoi(optarg);
+        break;
+      case 's':
+        msg_size = atoi(optarg);
+        break;
+      case 'l':
+        loss = atof(optarg);
+        break;
+      case 'm':
+        mtu = atoi(optarg);
+        break;
+      case 'P':
+        port = atoi(optarg);
+        break;
+      case 'g':
+        offload = 1;
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+  if (msg_size < 4 || msg_size > BUFFSIZE) {
+    fprintf(stderr, "Error: the message size must be between 4 and %d\n", BUFFSIZE);
+
+    exit(-1);
+  }
+}
+
+static int relay_open(int relay_port)
+{
+  struct sockaddr_in addr;
+  int fd, size = 4 * 1024 * 1024;
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(relay_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+
+    return -1;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  return fd;
+}
+
+/* Forward (or drop) all the queued datagrams */
+static void relay(int fd, int dst_port)
+{
+  static uint8_t buff[65536];
+  struct sockaddr_in dst;
+  int len;
+
+  memset(&dst, 0, sizeof(dst));
+  dst.sin_family = AF_INET;
+  dst.sin_port = htons(dst_port);
+  dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  while ((len = recv(fd, buff, sizeof(buff), MSG_DONTWAIT)) >= 0) {
+    /* IP packets needed for the datagram, including the UDP header */
+    int packets = (len + 8 + LINK_MTU - 20 - 1) / (LINK_MTU - 20);
+
+    if (rand() / (RAND_MAX + 1.0) >= 1 - pow(1 - loss / 100, packets)) {
+      sendto(fd, buff, len, 0, (struct sockaddr *)&dst, sizeof(dst));
+    }
+  }
+}
+
+/* The first 4 bytes of a message contain its index, the others depend on it */
+static void msg_fill(uint8_t *msg, uint32_t n)
+{
+  int i;
+
+  memcpy(msg, &n, 4);
+  for (i = 4; i < msg_size; i++) {
+    msg[i] = n + i * 7;
+  }
+}
+
+static int msg_check(const uint8_t *msg)
+{
+  uint32_t n;
+  int i;
+
+  memcpy(&n, msg, 4);
+  for (i = 4; i < msg_size; i++) {
+    if (msg[i] != (uint8_t)(n + i * 7)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int receive(struct nodeID *rx, uint8_t *buff)
+{
+  int received = 0;
+
+  for (;;) {
+    struct timeval tout = {0, 10000};
+    struct nodeID *remote;
+    int len;
+
+    if (wait4data(rx, &tout, NULL) <= 0) {
+      return received;
+    }
+    len = recv_from_peer(rx, &remote, buff, BUFFSIZE);
+    if (len == msg_size && msg_check(buff)) {
+      received++;
+    } else if (len >= 0) {
+      corrupted++;
+    }
+    if (len >= 0) {
+      nodeid_free(remote);
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  struct nodeID *rx, *tx, *dst;
+  struct net_helper_stats st;
+  uint8_t *msg, *buff;
+  char config[80];
+  int i, fd, received, size = 4 * 1024 * 1024;
+
+  cmdline_parse(argc, argv);
+  srand(1);
+
+  sprintf(config, "mtu=%d,reasm_timeout=100,gso=%d,gro=%d", mtu, offload, offload);
+  rx = net_helper_init("127.0.0.1", port, config);
+  tx = net_helper_init("127.0.0.1", port + 2, config);
+  fd = relay_open(port + 1);
+  if (rx == NULL || tx == NULL || fd < 0) {
+    fprintf(stderr, "Error creating the sockets\n");
+
+    return -1;
+  }
+  setsockopt(node_fd(rx), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  dst = create_node("127.0.0.1", port + 1);
+
+  msg = malloc(msg_size);
+  buff = malloc(BUFFSIZE);
+  received = 0;
+  for (i = 0; i < msgs; i++) {
+    msg_fill(msg, i);
+    if (send_to_peer(tx, dst, msg, msg_size) < 0) {
+      fprintf(stderr, "Error sending message %d\n", i);
+    }
+    relay(fd, port);
+    received += receive(rx, buff);
+  }
+  /* The last incomplete messages might not have timed out yet: they are not in msgs_lost */
+  net_helper_stats(&st);
+
+  printf("Fragment size %d, %.2f%% packet loss\n", st.frag_size, loss);
+  printf("Sent %d messages (%llu datagrams)\n", msgs, (unsigned long long)st.frags_sent);
+  printf("Received %d messages, %llu bytes\n", received, (unsigned long long)st.bytes_received);
+  printf("Lost %d messages (%llu sent bytes)\n", msgs - received, (unsigned long long)(msgs - received) * msg_size);
+  printf("Incomplete at the receiver: %llu messages, wasting %llu received bytes\n",
+         (unsigned long long)st.msgs_lost, (unsigned long long)st.bytes_wasted);
+  printf("Goodput: %.2f%% of the sent bytes\n", 100.0 * st.bytes_received / st.bytes_sent);
+  if (corrupted) {
+    fprintf(stderr, "Error: %d corrupted messages\n", corrupted);
+  }
+  if (loss == 0 && (received != msgs || st.msgs_lost)) {
+    fprintf(stderr, "Error: no packet loss, but %d messages have not been received\n", msgs - received);
+  }
+
+  free(msg);
+  free(buff);
+  nodeid_free(dst);
+  nodeid_free(tx);
+  nodeid_free(rx);
+  close(fd);
+
+  return (corrupted || (loss == 0 && received != msgs)) ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Automated test of the reactor: a periodic timer writes to a pipe and
+ *  sends a message to the local net helper socket, the fd callbacks read
+ *  them, and the loop stops by itself. Check that every callback runs the
+ *  expected number of times, that file descriptors and timers removed from
+ *  a callback are not dispatched anymore, and that reactor_run_once()
+ *  honours its timeout.
+ *    ./reactor_test [-P <port>] [-n <number of ticks>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "net_helper.h"
+#include "reactor.h"
+
+#define TICK_MS 10
+#define PIPE_READS 3	/* the pipe is removed after these reads */
+
+static struct reactor *r;
+static struct nodeID *myself;
+static int pipe_fds[2];
+static int port = 6666;
+static int ticks = 10;
+
+static int tick_count, oneshot_count, pipe_count, pipe_late, msg_count, msg_bad;
+static int oneshot_id;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "P:n:")) != -1) {
+    switch(o) {
+      case 'P':
+        port = atoi(optarg);
+        break;
+      case 'n':
+        ticks = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+static void tick(void *arg)
+{
+  uint8_t msg[4];
+
+  tick_count++;
+  if (write(pipe_fds[1], "x", 1) != 1) {
+    perror("write");
+  }
+  memcpy(msg, &tick_count, sizeof(msg));
+  if (send_to_peer(myself, myself, msg, sizeof(msg)) != sizeof(msg)) {
+    fprintf(stderr, "send_to_peer failed\n");
+  }
+  if (tick_count == ticks) {
+    reactor_stop(r);
+  }
+}
+
+/* Removes itself at the first expiration */
+static void oneshot(void *arg)
+{
+  oneshot_count++;
+  reactor_del_timer(r, oneshot_id);
+}
+
+static void pipe_readable(void *arg, int fd)
+{
+  char b;
+
+  if (pipe_count == PIPE_READS) {
+    pipe_late++;
+
+    return;
+  }
+  if (read(fd, &b, 1) == 1) {
+    pipe_count++;
+  }
+  if (pipe_count == PIPE_READS) {
+    reactor_del_fd(r, fd);
+  }
+}
+
+static void msg_readable(void *arg, int fd)
+{
+  struct nodeID *remote;
+  uint8_t buff[16];
+  int len, seq;
+
+  len = recv_from_peer(myself, &remote, buff, sizeof(buff));
+  if (len < 0) {
+    return;
+  }
+  memcpy(&seq, buff, sizeof(seq));
+  if (len != sizeof(seq) || seq != msg_count + 1 || nodeid_equal(remote, myself) == 0) {
+    msg_bad++;
+  }
+  msg_count++;
+  nodeid_free(remote);
+}
+
+static int elapsed_ms(const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+
+  return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+int main(int argc, char *argv[])
+{
+  struct timeval period = {0, TICK_MS * 1000}, tout = {0, 50000}, start;
+  int res, errors = 0;
+
+  cmdline_parse(argc, argv);
+  if (ticks <= PIPE_READS) {
+    fprintf(stderr, "At least %d ticks are needed\n", PIPE_READS + 1);
+
+    return -1;
+  }
+
+  myself = net_helper_init("127.0.0.1", port, "");
+  r = reactor_init("");
+  if (myself == NULL || r == NULL || pipe(pipe_fds) < 0) {
+    fprintf(stderr, "Initialisation failed\n");
+
+    return -1;
+  }
+
+  /* Nothing registered yet: only the timeout can expire */
+  gettimeofday(&start, NULL);
+  res = reactor_run_once(r, &tout);
+  if (res != 0 || elapsed_ms(&start) < 40) {
+    fprintf(stderr, "reactor_run_once() returned %d after %dms\n", res, elapsed_ms(&start));
+    errors++;
+  }
+
+  if (reactor_add_fd(r, node_fd(myself), msg_readable, NULL) < 0 ||
+      reactor_add_fd(r, pipe_fds[0], pipe_readable, NULL) < 0 ||
+      reactor_add_timer(r, &period, tick, NULL) < 0 ||
+      (oneshot_id = reactor_add_timer(r, &period, oneshot, NULL)) < 0) {
+    fprintf(stderr, "Cannot register the events\n");
+
+    return -1;
+  }
+  if (reactor_add_fd(r, pipe_fds[0], pipe_readable, NULL) >= 0) {
+    fprintf(stderr, "The same fd has been registered twice\n");
+    errors++;
+  }
+
+  if (reactor_run(r) < 0) {
+    fprintf(stderr, "reactor_run() failed\n");
+    errors++;
+  }
+  /* Receive the last message, if it was sent after the last wakeup */
+  while (msg_count < ticks && reactor_run_once(r, &tout) > 0);
+
+  printf("Ticks: %d, one-shot timer: %d, pipe reads: %d (%d after removal), messages: %d (%d bad)\n",
+         tick_count, oneshot_count, pipe_count, pipe_late, msg_count, msg_bad);
+  if (tick_count != ticks || oneshot_count != 1 || pipe_count != PIPE_READS ||
+      pipe_late || msg_count != ticks || msg_bad) {
+    errors++;
+  }
+
+  reactor_destroy(&r);
+  if (r != NULL) {
+    errors++;
+  }
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  nodeid_free(myself);
+  net_helper_deinit();
+
+  printf("%s\n", errors ? "FAILED" : "OK");
+
+  return errors ? -1 : 0;
+}
@@ -0,0 +1,265 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Automated test of the low level scheduler: the best K candidates
+ *  selected by the bounded heap must be the ones found by sorting all of
+ *  them, a given seed must always give the same selection (with both
+ *  orderings), weighted selection must follow the weights, and the
+ *  streaming selection of peer-chunk pairs must find the best pairs
+ *  without building the whole list.
+ *    ./sched_test [-s <seed>] [-n <number of candidates>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "scheduler_la.h"
+
+#define K_SMALL 5
+#define K_LARGE 40	/* more than the candidates kept without allocating */
+#define TRIALS 10000
+
+static unsigned int seed = 1;
+static int n = 1000;
+
+static double *weights;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "s:n:")) != -1) {
+    switch(o) {
+      case 's':
+        seed = atoi(optarg);
+        break;
+      case 'n':
+        n = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+/* Candidates are indexes in weights[] */
+static double evaluate(void *p)
+{
+  return weights[*(int *)p];
+}
+
+static int cmp_desc(const void *a, const void *b)
+{
+  double wa = *(const double *)a, wb = *(const double *)b;
+
+  return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+static size_t select_n(SchedOrdering ordering, int *candidates, size_t k, int *selected)
+{
+  selectWithOrdering(ordering, sizeof(int), (void *)candidates, n, evaluate, (void *)selected, &k);
+
+  return k;
+}
+
+/* The selection is made of distinct candidates, having the k largest weights, best first */
+static int check_best(int *candidates, size_t k)
+{
+  int selected[K_LARGE];
+  double *sorted;
+  size_t len, i, j;
+  int res = 0;
+
+  sorted = malloc(n * sizeof(double));
+  memcpy(sorted, weights, n * sizeof(double));
+  qsort(sorted, n, sizeof(double), cmp_desc);
+  len = select_n(SCHED_BEST, candidates, k, selected);
+  if (len != k) {
+    fprintf(stderr, "Best %zu: %zu candidates selected\n", k, len);
+    res = -1;
+  }
+  for (i = 0; i < len; i++) {
+    if (weights[selected[i]] != sorted[i]) {
+      fprintf(stderr, "Best %zu: position %zu has weight %f instead of %f\n", k, i, weights[selected[i]], sorted[i]);
+      res = -1;
+    }
+    for (j = 0; j < i; j++) {
+      if (selected[i] == selected[j]) {
+        fprintf(stderr, "Best %zu: candidate %d selected twice\n", k, selected[i]);
+        res = -1;
+      }
+    }
+  }
+  free(sorted);
+
+  return res;
+}
+
+/* Running the selection twice with the same seed gives the same result */
+static int check_stable(SchedOrdering ordering, int *candidates, size_t k)
+{
+  int s1[K_LARGE], s2[K_LARGE];
+  size_t len1, len2;
+
+  schedSeed(seed);
+  len1 = select_n(ordering, candidates, k, s1);
+  schedSeed(seed);
+  len2 = select_n(ordering, candidates, k, s2);
+  if (len1 != len2 || memcmp(s1, s2, len1 * sizeof(int))) {
+    fprintf(stderr, "%s %zu: different selections with the same seed\n", ordering == SCHED_BEST ? "Best" : "Weighted", k);
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Candidates with weight 0 are not selected, and the others are selected in proportion to their weights */
+static int check_weighted(void)
+{
+  double w[4] = {0, 1, 0, 9};
+  int candidates[4] = {0, 1, 2, 3};
+  int selected[4], count = 0, i, res = 0;
+  double *saved = weights;
+  int saved_n = n;
+  size_t len;
+
+  weights = w;
+  n = 4;
+  schedSeed(seed);
+  for (i = 0; i < TRIALS; i++) {
+    len = select_n(SCHED_WEIGHTED, candidates, 1, selected);
+    if (len != 1 || weights[selected[0]] == 0) {
+      fprintf(stderr, "Weighted: candidate with weight 0 selected\n");
+      res = -1;
+      break;
+    }
+    count += selected[0] == 3;
+  }
+  if (count < TRIALS * 0.88 || count > TRIALS * 0.92) {
+    fprintf(stderr, "Weighted: candidate with weight 0.9 selected %d times out of %d\n", count, TRIALS);
+    res = -1;
+  }
+  len = select_n(SCHED_WEIGHTED, candidates, 4, selected);
+  if (len != 2) {
+    fprintf(stderr, "Weighted: %zu candidates selected, but only 2 have positive weight\n", len);
+    res = -1;
+  }
+  weights = saved;
+  n = saved_n;
+
+  return res;
+}
+
+/* Peers and chunks are small integers disguised as pointers */
+static double pair_evaluate(struct PeerChunk *pc)
+{
+  intptr_t p = (intptr_t)pc->peer;
+
+  return (double)((p * 7919 + pc->chunk * 104729) % 100003);
+}
+
+static int pair_filter(schedPeerID p, schedChunkID c)
+{
+  return ((intptr_t)p + c) % 3 != 0;
+}
+
+/* The streaming selection of pairs finds the same weights as a scan of all the pairs */
+static int check_hybrid(int peers_len, int chunks_len)
+{
+  schedPeerID *peers;
+  schedChunkID *chunks;
+  struct PeerChunk selected[K_LARGE];
+  double best[K_LARGE + 1];
+  size_t len = K_LARGE, found = 0, i;
+  int p, c, res = 0;
+
+  peers = malloc(peers_len * sizeof(schedPeerID));
+  chunks = malloc(chunks_len * sizeof(schedChunkID));
+  for (p = 0; p < peers_len; p++) {
+    peers[p] = (schedPeerID)(intptr_t)(p + 1);
+  }
+  for (c = 0; c < chunks_len; c++) {
+    chunks[c] = c;
+  }
+
+  /* Reference: keep the K_LARGE largest weights by insertion */
+  for (c = 0; c < chunks_len; c++) {
+    for (p = 0; p < peers_len; p++) {
+      struct PeerChunk pc = {peers[p], chunks[c]};
+      double w;
+
+      if (!pair_filter(pc.peer, pc.chunk)) {
+        continue;
+      }
+      w = pair_evaluate(&pc);
+      for (i = found; i > 0 && best[i - 1] < w; i--) {
+        best[i] = best[i - 1];
+      }
+      best[i] = w;
+      if (found < K_LARGE) {
+        found++;
+      }
+    }
+  }
+
+  schedSelectHybrid(SCHED_BEST, peers, peers_len, chunks, chunks_len, selected, &len, pair_filter, pair_evaluate);
+  if (len != found) {
+    fprintf(stderr, "Hybrid: %zu pairs selected instead of %zu\n", len, found);
+    res = -1;
+  }
+  for (i = 0; i < len && i < found; i++) {
+    if (!pair_filter(selected[i].peer, selected[i].chunk) || pair_evaluate(&selected[i]) != best[i]) {
+      fprintf(stderr, "Hybrid: pair %zu has weight %f instead of %f\n", i, pair_evaluate(&selected[i]), best[i]);
+      res = -1;
+    }
+  }
+  free(peers);
+  free(chunks);
+
+  return res;
+}
+
+int main(int argc, char *argv[])
+{
+  int *candidates;
+  int i, errors = 0;
+
+  cmdline_parse(argc, argv);
+  if (n < K_LARGE) {
+    fprintf(stderr, "At least %d candidates are needed\n", K_LARGE);
+
+    return -1;
+  }
+
+  /* Few distinct weights, so that there are many ties */
+  srand(seed);
+  weights = malloc(n * sizeof(double));
+  candidates = malloc(n * sizeof(int));
+  for (i = 0; i < n; i++) {
+    weights[i] = rand() % (n / 4);
+    candidates[i] = i;
+  }
+
+  errors += check_best(candidates, K_SMALL) < 0;
+  errors += check_best(candidates, K_LARGE) < 0;
+  errors += check_stable(SCHED_BEST, candidates, K_SMALL) < 0;
+  errors += check_stable(SCHED_BEST, candidates, K_LARGE) < 0;
+  errors += check_stable(SCHED_WEIGHTED, candidates, K_SMALL) < 0;
+  errors += check_stable(SCHED_WEIGHTED, candidates, K_LARGE) < 0;
+  errors += check_weighted() < 0;
+  errors += check_hybrid(1000, 1000) < 0;
+
+  free(weights);
+  free(candidates);
+
+  printf("%s\n", errors ? "FAILED" : "OK");
+
+  return errors ? -1 : 0;
+}
@@ -0,0 +1,198 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Many threads send fragmented messages to the same peer at the same time
+ *  (with send_to_peer(), or with send_to_peer_async() and -a); check that
+ *  all the messages are received intact, and (with -a) that the messages
+ *  of each thread are received in order.
+ *  The senders are paced so that at most about <window> messages are in
+ *  flight, and the receive buffer cannot overflow: a lost message means
+ *  that the fragments of different messages have been mixed up.
+ *    ./send_threads_test [-t <threads>] [-n <messages per thread>] [-a] [-w <window>] [-P <port>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "net_helper.h"
+
+#define BUFFSIZE (64 * 1024)
+#define HDR_SIZE 12
+#define PACING_TIMEOUT 200	/* ms */
+
+static int threads = 4;
+static int msgs = 200;
+static int async;
+static int window;
+static int sent, received;
+static int port = 6666;
+static struct nodeID *tx, *dst;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "t:n:aw:P:")) != -1) {
+    switch(o) {
+      case 't':
+        threads = atoi(optarg);
+        break;
+      case 'n':
+        msgs = atoi(optarg);
+        break;
+      case 'a':
+        async = 1;
+        break;
+      case 'w':
+        window = atoi(optarg);
+        break;
+      case 'P':
+        port = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+/* Message i of thread t: thread, sequence number and size, then a pattern */
+static int msg_fill(uint8_t *buff, uint32_t t, uint32_t i)
+{
+  uint32_t size = HDR_SIZE + (i * 7919 + t * 104729) % (BUFFSIZE - HDR_SIZE);
+  uint32_t j;
+
+  memcpy(buff, &t, 4);
+  memcpy(buff + 4, &i, 4);
+  memcpy(buff + 8, &size, 4);
+  for (j = HDR_SIZE; j < size; j++) {
+    buff[j] = j * 31 + i + t;
+  }
+
+  return size;
+}
+
+/* Wait until less than window messages are in flight (or until a message seems to be lost) */
+static void pace(void)
+{
+  int waited = 0;
+
+  while (__atomic_load_n(&sent, __ATOMIC_SEQ_CST) - __atomic_load_n(&received, __ATOMIC_SEQ_CST) >= window &&
+         waited++ < PACING_TIMEOUT * 10) {
+    usleep(100);
+  }
+  __atomic_add_fetch(&sent, 1, __ATOMIC_SEQ_CST);
+}
+
+static void *sender(void *arg)
+{
+  uint8_t *buff = malloc(BUFFSIZE);
+  uint32_t t = (uintptr_t)arg;
+  int i;
+
+  for (i = 0; i < msgs; i++) {
+    int size = msg_fill(buff, t, i);
+
+    pace();
+    if (async) {
+      while (send_to_peer_async(tx, dst, buff, size) < 0);
+    } else {
+      send_to_peer(tx, dst, buff, size);
+    }
+  }
+  free(buff);
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  struct nodeID *rx;
+  pthread_t *th;
+  uint8_t *buff, *expected;
+  int *last;
+  char config[64];
+  int i, corrupted, reordered, size = 8 * 1024 * 1024;
+
+  cmdline_parse(argc, argv);
+  if (window <= 0) {
+    window = threads;
+  }
+  sprintf(config, "mtu=1500,send_threads=%d", async ? 2 : 0);
+  rx = net_helper_init("127.0.0.1", port, "");
+  tx = net_helper_init("127.0.0.1", port + 1, config);
+  if (rx == NULL || tx == NULL) {
+    fprintf(stderr, "Error creating the sockets\n");
+
+    return -1;
+  }
+  setsockopt(node_fd(rx), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  dst = create_node("127.0.0.1", port);
+
+  th = malloc(threads * sizeof(pthread_t));
+  last = malloc(threads * sizeof(int));
+  for (i = 0; i < threads; i++) {
+    last[i] = -1;
+    pthread_create(&th[i], NULL, sender, (void *)(uintptr_t)i);
+  }
+
+  buff = malloc(BUFFSIZE);
+  expected = malloc(BUFFSIZE);
+  corrupted = reordered = 0;
+  for (;;) {
+    struct timeval tout = {1, 0};
+    struct nodeID *remote;
+    uint32_t t, seq;
+    int len;
+
+    if (wait4data(rx, &tout, NULL) <= 0) {
+      break;
+    }
+    len = recv_from_peer(rx, &remote, buff, BUFFSIZE);
+    if (len < 0) {
+      continue;
+    }
+    nodeid_free(remote);
+    __atomic_add_fetch(&received, 1, __ATOMIC_SEQ_CST);
+    memcpy(&t, buff, 4);
+    memcpy(&seq, buff + 4, 4);
+    if (len < HDR_SIZE || t >= threads || seq >= msgs ||
+        msg_fill(expected, t, seq) != len || memcmp(buff, expected, len)) {
+      corrupted++;
+      continue;
+    }
+    if ((int)seq <= last[t]) {
+      reordered++;
+    }
+    last[t] = seq;
+  }
+  for (i = 0; i < threads; i++) {
+    pthread_join(th[i], NULL);
+  }
+  net_helper_deinit();
+
+  printf("Sent %d messages from %d threads%s\n", threads * msgs, threads, async ? " (async)" : "");
+  printf("Received %d messages: %d corrupted, %d out of order\n", received, corrupted, reordered);
+
+  free(buff);
+  free(expected);
+  free(last);
+  free(th);
+  nodeid_free(dst);
+  nodeid_free(tx);
+  nodeid_free(rx);
+
+  if (received != threads * msgs) {
+    fprintf(stderr, "Error: %d messages have not been received\n", threads * msgs - received);
+  }
+
+  return corrupted || received != threads * msgs || (async && reordered) ? -1 : 0;
+}
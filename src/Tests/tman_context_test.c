@@ -0,0 +1,221 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Two peers, each one running two Topology Manager instances (overlay 1
+ *  and overlay 2, with metadata of different sizes) on the same socket.
+ *  The received messages are dispatched with tman_overlay(); check that
+ *  every instance finds the other peer with the metadata of its own
+ *  overlay, and that the legacy API fails before tmanInit().
+ *    ./tman_context_test [-P <port>] [-t <timeout in s>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "net_helper.h"
+#include "tman.h"
+
+#define BUFFSIZE 2048
+#define PEERS 2
+#define OVERLAYS 2
+
+struct meta2 {
+  int32_t value;
+  int32_t overlay;
+};
+
+struct node {
+  struct nodeID *id;
+  struct tman_context *tc[OVERLAYS];
+  int32_t meta1;	/* overlay 1 */
+  struct meta2 meta2;	/* overlay 2 */
+};
+
+static struct node nodes[PEERS];
+static int port = 6666;
+static int timeout = 15;
+static int wrong_overlay;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "P:t:")) != -1) {
+    switch(o) {
+      case 'P':
+        port = atoi(optarg);
+        break;
+      case 't':
+        timeout = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+static int rank1(const void *target, const void *p1, const void *p2)
+{
+  int32_t t = *(const int32_t *)target, a = *(const int32_t *)p1, b = *(const int32_t *)p2;
+
+  return abs(t - a) == abs(t - b) ? 0 : abs(t - a) < abs(t - b) ? 1 : 2;
+}
+
+static int rank2(const void *target, const void *p1, const void *p2)
+{
+  return rank1(&((const struct meta2 *)target)->value, &((const struct meta2 *)p1)->value, &((const struct meta2 *)p2)->value);
+}
+
+static const void *meta_of(const struct node *n, int overlay, int *size)
+{
+  if (overlay == 0) {
+    *size = sizeof(n->meta1);
+
+    return &n->meta1;
+  }
+  *size = sizeof(n->meta2);
+
+  return &n->meta2;
+}
+
+/* Run the protocol of node i: bootstrap it with the other node, and handle one message if any */
+static void node_step(int i)
+{
+  struct node *n = &nodes[i], *other = &nodes[1 - i];
+  struct timeval tout = {0, 10000};
+  static uint8_t buff[BUFFSIZE];
+  int j;
+
+  if (wait4data(n->id, &tout, NULL) > 0) {
+    struct nodeID *remote;
+    int len, overlay;
+
+    len = recv_from_peer(n->id, &remote, buff, BUFFSIZE);
+    if (len > 0) {
+      overlay = tman_overlay(buff, len);
+      if (overlay < 1 || overlay > OVERLAYS) {
+        wrong_overlay++;
+      } else {
+        const void *meta;
+        int size;
+
+        meta = meta_of(other, overlay - 1, &size);
+        if (tman_parse_data(n->tc[overlay - 1], buff, len, &other->id, 1, meta, size) < 0) {
+          wrong_overlay++;
+        }
+      }
+      nodeid_free(remote);
+    }
+  }
+  for (j = 0; j < OVERLAYS; j++) {
+    const void *meta;
+    int size;
+
+    meta = meta_of(other, j, &size);
+    tman_parse_data(n->tc[j], NULL, 0, &other->id, 1, meta, size);
+  }
+}
+
+/* The instance of node i in overlay j knows the other node, with the right metadata */
+static int node_check(int i, int j)
+{
+  struct node *other = &nodes[1 - i];
+  struct nodeID *peers[4];
+  uint8_t meta[4 * sizeof(struct meta2)];
+  const void *expected;
+  int n, size;
+
+  n = tman_give_peers(nodes[i].tc[j], 4, peers, meta);
+  expected = meta_of(other, j, &size);
+
+  return n == 1 && nodeid_equal(peers[0], other->id) && memcmp(meta, expected, size) == 0;
+}
+
+static int all_found(void)
+{
+  int i, j;
+
+  for (i = 0; i < PEERS; i++) {
+    for (j = 0; j < OVERLAYS; j++) {
+      if (!node_check(i, j)) {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  struct timeval start, now;
+  int i, j, errors = 0, size;
+
+  cmdline_parse(argc, argv);
+
+  /* No instance created by tmanInit(): the legacy API must fail */
+  if (tmanGetNeighbourhoodSize() != -1 || tmanParseData(NULL, 0, NULL, 0, NULL, 0) != -1 ||
+      tmanGetMetadata(&size) != NULL || tmanAddNeighbour(NULL, NULL, 0) != -1) {
+    fprintf(stderr, "The legacy API works without tmanInit()\n");
+    errors++;
+  }
+
+  for (i = 0; i < PEERS; i++) {
+    struct node *n = &nodes[i];
+
+    n->id = net_helper_init("127.0.0.1", port + i, "");
+    n->meta1 = 100 * (i + 1);
+    n->meta2.value = 1000 * (i + 1);
+    n->meta2.overlay = 2;
+    if (n->id == NULL) {
+      return -1;
+    }
+    n->tc[0] = tman_init(n->id, &n->meta1, sizeof(n->meta1), rank1, "protocol=tman,overlay=1,period=1");
+    n->tc[1] = tman_init(n->id, &n->meta2, sizeof(n->meta2), rank2, "protocol=tman,overlay=2,period=1");
+    if (n->tc[0] == NULL || n->tc[1] == NULL) {
+      fprintf(stderr, "Cannot create the instances\n");
+
+      return -1;
+    }
+  }
+
+  gettimeofday(&start, NULL);
+  do {
+    for (i = 0; i < PEERS; i++) {
+      node_step(i);
+    }
+    gettimeofday(&now, NULL);
+  } while (!all_found() && now.tv_sec - start.tv_sec < timeout);
+
+  for (i = 0; i < PEERS; i++) {
+    for (j = 0; j < OVERLAYS; j++) {
+      int ok = node_check(i, j);
+
+      printf("Peer %d, overlay %d: %s\n", i, j + 1, ok ? "OK" : "other peer not found");
+      if (!ok) {
+        errors++;
+      }
+    }
+  }
+  printf("Messages of a wrong or unknown overlay: %d\n", wrong_overlay);
+  if (wrong_overlay) {
+    errors++;
+  }
+
+  for (i = 0; i < PEERS; i++) {
+    for (j = 0; j < OVERLAYS; j++) {
+      tman_destroy(&nodes[i].tc[j]);
+    }
+    nodeid_free(nodes[i].id);
+  }
+  net_helper_deinit();
+
+  return errors ? -1 : 0;
+}
@@ -21,6 +21,7 @@ int main(int argc, char *argv[])
   struct psample_context *context;
   int port, res;
   char psample_cfg[16];
+  uint8_t id_buff[256];
 
   myID = net_helper_init("127.0.0.1", 5555, "");
   if (myID == NULL) {
@@ -28,6 +29,7 @@ int main(int argc, char *argv[])
 
     return -1;
   }
+  printf("nodeID dump size: %d bytes\n", nodeid_dump(id_buff, myID, sizeof(id_buff)));
   memset(psample_cfg, 0, sizeof(psample_cfg));
   sprintf(psample_cfg, "cache_size=%d", cache_size);
   context = psample_init(myID, NULL, 0, psample_cfg);
@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Same as topology_test, but driven by a reactor: the net helper socket is
+ *  registered once, and a periodic timer runs the peer sampler.
+ *    ./topology_test_reactor -I <network interface> -P <port> [-i <remote IP> -p <remote port>] [-t <period in ms>]
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "net_helper.h"
+#include "peersampler.h"
+#include "reactor.h"
+#include "net_helpers.h"
+
+static const char *psample_config;
+static struct psample_context *context;
+static const char *my_addr = "127.0.0.1";
+static int port = 6666;
+static int srv_port;
+static const char *srv_ip;
+static int period = 1000;
+
+static void cmdline_parse(int argc, char *argv[])
+{
+  int o;
+
+  while ((o = getopt(argc, argv, "p:i:P:I:t:cno")) != -1) {
+    switch(o) {
+      case 'p':
+        srv_port = atoi(optarg);
+        break;
+      case 'i':
+        srv_ip = strdup(optarg);
+        break;
+      case 'P':
+        port =  atoi(optarg);
+        break;
+      case 'I':
+        my_addr = iface_addr(optarg);
+        break;
+      case 't':
+        period = atoi(optarg);
+        break;
+      case 'c':
+        psample_config = "protocol=cyclon";
+        break;
+      case 'n':
+        psample_config = "protocol=newscast";
+        break;
+      case 'o':
+        psample_config = "protocol=newscastplus";
+        break;
+      default:
+        fprintf(stderr, "Error: unknown option %c\n", o);
+
+        exit(-1);
+    }
+  }
+}
+
+static void data_ready(void *arg, int fd)
+{
+#define BUFFSIZE 1024
+  static uint8_t buff[BUFFSIZE];
+  struct nodeID *s = arg;
+  struct nodeID *remote;
+  int len;
+
+  len = recv_from_peer(s, &remote, buff, BUFFSIZE);
+  if (len > 0) {
+    psample_parse_data(context, buff, len);
+    nodeid_free(remote);
+  }
+}
+
+static void tick(void *arg)
+{
+  static int cnt;
+  const struct nodeID *const *neighbourhoods;
+  char addr[256];
+  int n, i;
+
+  psample_parse_data(context, NULL, 0);
+  if (cnt++ % 10) {
+    return;
+  }
+  neighbourhoods = psample_get_cache(context, &n);
+  printf("I have %d neighbours:\n", n);
+  for (i = 0; i < n; i++) {
+    node_addr(neighbourhoods[i], addr, 256);
+    printf("\t%d: %s\n", i, addr);
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+  struct nodeID *my_sock;
+  struct reactor *r;
+  struct timeval tout;
+
+  cmdline_parse(argc, argv);
+
+  my_sock = net_helper_init(my_addr, port, "");
+  if (my_sock == NULL) {
+    fprintf(stderr, "Error creating my socket (%s:%d)!\n", my_addr, port);
+
+    return -1;
+  }
+  context = psample_init(my_sock, NULL, 0, psample_config);
+  if (srv_port != 0) {
+    struct nodeID *knownHost;
+
+    knownHost = create_node(srv_ip, srv_port);
+    if (knownHost == NULL) {
+      fprintf(stderr, "Error creating knownHost socket (%s:%d)!\n", srv_ip, srv_port);
+
+      return -1;
+    }
+    psample_add_peer(context, knownHost, NULL, 0);
+  }
+
+  r = reactor_init("");
+  if (r == NULL) {
+    fprintf(stderr, "Error creating the reactor\n");
+
+    return -1;
+  }
+  tout.tv_sec = period / 1000;
+  tout.tv_usec = (period % 1000) * 1000;
+  reactor_add_fd(r, node_fd(my_sock), data_ready, my_sock);
+  reactor_add_timer(r, &tout, tick, NULL);
+  psample_parse_data(context, NULL, 0);
+
+  reactor_run(r);
+  reactor_destroy(&r);
+
+  return 0;
+}
@@ -21,16 +21,18 @@
 #define DUMB_DEFAULT_CSIZE	20
 #define DUMB_DEFAULT_PERIOD	10
 
-static uint64_t currtime;
-static int memory;
-static int cache_size;
-static int current_size;
-static int mdata_size;
-static int do_resize;
-static int period;
-static struct peer_cache *local_cache;
-static uint8_t *my_mdata;
-static struct nodeID *me;
+struct topman_context {
+	uint64_t currtime;
+	int memory;
+	int cache_size;
+	int current_size;
+	int mdata_size;
+	int do_resize;
+	int period;
+	struct peer_cache *local_cache;
+	uint8_t *my_mdata;
+	struct nodeID *me;
+};
 
 static uint64_t gettime(void)
 {
@@ -41,64 +43,82 @@ static uint64_t gettime(void)
 	return tv.tv_usec + tv.tv_sec * 1000000ull;
 }
 
-static int time_to_run(void)
+static int time_to_run(struct topman_context *context)
 {
-	if (gettime() - currtime > period) {
-		currtime += period;
+	if (gettime() - context->currtime > context->period) {
+		context->currtime += context->period;
 		return 1;
 	}
 
 	return 0;
 }
 
-static int dumbInit(struct nodeID *myID, void *metadata, int metadata_size, ranking_function rfun, const char *config)
+static void dumbDestroy(struct topman_context **context)
+{
+	if (context && *context) {
+		if ((*context)->local_cache)
+			cache_free((*context)->local_cache);
+		free((*context)->my_mdata);
+		free(*context);
+		*context = NULL;
+	}
+}
+
+static struct topman_context *dumbInit(struct nodeID *myID, void *metadata, int metadata_size, ranking_function rfun, const char *config)
 {
+	struct topman_context *context;
 	struct tag *cfg_tags;
 	int res;
 
+	context = calloc(1, sizeof(struct topman_context));
+	if (context == NULL) {
+		return NULL;
+	}
 	cfg_tags = grapes_config_parse(config);
-	res = grapes_config_value_int(cfg_tags, "cache_size", &cache_size);
+	res = grapes_config_value_int(cfg_tags, "cache_size", &context->cache_size);
 	if (!res) {
-		cache_size = DUMB_DEFAULT_CSIZE;
+		context->cache_size = DUMB_DEFAULT_CSIZE;
 	}
-	res = grapes_config_value_int(cfg_tags, "memory", &memory);
+	res = grapes_config_value_int(cfg_tags, "memory", &context->memory);
 	if (!res) {
-		memory = DUMB_DEFAULT_MEM;
+		context->memory = DUMB_DEFAULT_MEM;
 	}
-	res = grapes_config_value_int(cfg_tags, "period", &period);
+	res = grapes_config_value_int(cfg_tags, "period", &context->period);
 	if (!res) {
-		period = DUMB_DEFAULT_PERIOD;
+		context->period = DUMB_DEFAULT_PERIOD;
 	}
-	period *= 1000000;
+	context->period *= 1000000;
+	free(cfg_tags);
 
-	local_cache = cache_init(cache_size, metadata_size, 0);
-	if (local_cache == NULL) {
-		return -1;
+	context->local_cache = cache_init(context->cache_size, metadata_size, 0);
+	if (context->local_cache == NULL) {
+		dumbDestroy(&context);
+		return NULL;
 	}
-	mdata_size = metadata_size;
-	if (mdata_size) {
-		my_mdata = malloc(mdata_size);
-		if (my_mdata == NULL) {
-			cache_free(local_cache);
-			return -1;
+	context->mdata_size = metadata_size;
+	if (context->mdata_size) {
+		context->my_mdata = malloc(context->mdata_size);
+		if (context->my_mdata == NULL) {
+			dumbDestroy(&context);
+			return NULL;
 		}
-		memcpy(my_mdata, metadata, mdata_size);
+		memcpy(context->my_mdata, metadata, context->mdata_size);
 	}
-	me = myID;
-	currtime = gettime();
+	context->me = myID;
+	context->currtime = gettime();
 
-	return 0;
+	return context;
 }
 
-static int dumbGivePeers (int n, struct nodeID **peers, void *metadata)
+static int dumbGivePeers (struct topman_context *context, int n, struct nodeID **peers, void *metadata)
 {
 	int metadata_size;
 	const uint8_t *mdata;
 	int i;
 
-	mdata = get_metadata(local_cache, &metadata_size);
-	for (i=0; nodeid(local_cache, i) && (i < n); i++) {
-		peers[i] = nodeid(local_cache,i);
+	mdata = get_metadata(context->local_cache, &metadata_size);
+	for (i=0; nodeid(context->local_cache, i) && (i < n); i++) {
+		peers[i] = nodeid(context->local_cache,i);
 		if (metadata_size)
 			memcpy((uint8_t *)metadata + i * metadata_size, mdata + i * metadata_size, metadata_size);
 	}
@@ -106,49 +126,49 @@ static int dumbGivePeers (int n, struct nodeID **peers, void *metadata)
 	return i;
 }
 
-static int dumbGetNeighbourhoodSize(void)
+static int dumbGetNeighbourhoodSize(struct topman_context *context)
 {
 	int i;
 
-	for (i = 0; nodeid(local_cache, i); i++);
+	for (i = 0; nodeid(context->local_cache, i); i++);
 
 	return i;
 }
 
-static int dumbAddNeighbour(struct nodeID *neighbour, void *metadata, int metadata_size)
+static int dumbAddNeighbour(struct topman_context *context, struct nodeID *neighbour, void *metadata, int metadata_size)
 {
-	if (cache_add(local_cache, neighbour, metadata, metadata_size) < 0) {
+	if (cache_add(context->local_cache, neighbour, metadata, metadata_size) < 0) {
 		return -1;
 	}
 
-	current_size++;
+	context->current_size++;
 	return 1;
 }
 
-static const void *dumbGetMetadata(int *metadata_size)
+static const void *dumbGetMetadata(struct topman_context *context, int *metadata_size)
 {
-	return get_metadata(local_cache, metadata_size);
+	return get_metadata(context->local_cache, metadata_size);
 }
 
-static int dumbChangeMetadata(void *metadata, int metadata_size)
+static int dumbChangeMetadata(struct topman_context *context, void *metadata, int metadata_size)
 {
-	if (metadata_size && metadata_size == mdata_size) {
-		memcpy(my_mdata, (uint8_t *)metadata, mdata_size);
+	if (metadata_size && metadata_size == context->mdata_size) {
+		memcpy(context->my_mdata, (uint8_t *)metadata, context->mdata_size);
 		return 1;
 	}
 	else return -1;
 }
 
-static int dumbParseData(const uint8_t *buff, int len, struct nodeID **peers, int size, const void *metadata, int metadata_size)
+static int dumbParseData(struct topman_context *context, const uint8_t *buff, int len, struct nodeID **peers, int size, const void *metadata, int metadata_size)
 {
 	struct peer_cache *new_cache;
 	const uint8_t *m_data;
 	int r,j, msize, csize, heritage;
 
-	if (!time_to_run()) {
+	if (!time_to_run(context)) {
 		return 1;
 	}
-	if (metadata_size != mdata_size) {
+	if (metadata_size != context->mdata_size) {
 		fprintf(stderr, "DumbTopman : Metadata size mismatch with peer sampler!\n");
 		return 1;
 	}
@@ -156,70 +176,70 @@ static int dumbParseData(const uint8_t *buff, int len, struct nodeID **peers, in
 		fprintf(stderr, "DumbTopman : No peer available from peer sampler!\n");
 	}
 
-	m_data = (const uint8_t *)get_metadata(local_cache, &msize);
-	new_cache = cache_init(cache_size, msize, 0);
+	m_data = (const uint8_t *)get_metadata(context->local_cache, &msize);
+	new_cache = cache_init(context->cache_size, msize, 0);
 	if (!new_cache) {
 		fprintf(stderr, "DumbTopman : Memory error while creating new cache!\n");
 		return 1;
 	}
 
-	cache_update(local_cache);
-	heritage = (cache_size * memory) / 100;
-	if (heritage > current_size) {
-		heritage = current_size;
+	cache_update(context->local_cache);
+	heritage = (context->cache_size * context->memory) / 100;
+	if (heritage > context->current_size) {
+		heritage = context->current_size;
 	}
 	for (csize = 0; csize < heritage; ) {
-		if (heritage == current_size) {
+		if (heritage == context->current_size) {
 			r = csize;
 		} else {
-			r = ((double)rand() / (double)RAND_MAX) * current_size;
-			if (r == current_size) r--;
+			r = ((double)rand() / (double)RAND_MAX) * context->current_size;
+			if (r == context->current_size) r--;
 		}
-		r = cache_add(new_cache, nodeid(local_cache, r), m_data + r * msize, msize);
+		r = cache_add(new_cache, nodeid(context->local_cache, r), m_data + r * msize, msize);
 		if (csize < r) {
 			csize = r;
 		}
 	}
-	for (j = 0; j < size && csize < cache_size; j++) {
+	for (j = 0; j < size && csize < context->cache_size; j++) {
 		r = cache_add(new_cache, peers[j], (const uint8_t *)metadata + j * metadata_size,
 			metadata_size);
 		if (csize < r) {
 			csize = r;
 		}
 	}
-	current_size = csize;
-	cache_free(local_cache);
-	local_cache = new_cache;
-	do_resize = 0;
+	context->current_size = csize;
+	cache_free(context->local_cache);
+	context->local_cache = new_cache;
+	context->do_resize = 0;
 
 	fprintf(stderr, "DumbTopman : Parse Data.\n");
 	return 0;
 }
 
 // limit : at most it doubles the current cache size...
-static int dumbGrowNeighbourhood(int n)
+static int dumbGrowNeighbourhood(struct topman_context *context, int n)
 {
-	if (n <= 0 || do_resize)
+	if (n <= 0 || context->do_resize)
 		return -1;
-	n = n > cache_size ? cache_size : n;
-	cache_size += n;
-	do_resize = 1;
-	return cache_size;
+	n = n > context->cache_size ? context->cache_size : n;
+	context->cache_size += n;
+	context->do_resize = 1;
+	return context->cache_size;
 }
 
-static int dumbShrinkNeighbourhood(int n)
+static int dumbShrinkNeighbourhood(struct topman_context *context, int n)
 {
-	if (n <= 0 || n >= cache_size || do_resize)
+	if (n <= 0 || n >= context->cache_size || context->do_resize)
 		return -1;
-	cache_size -= n;
-	do_resize = 1;
-	return cache_size;
+	context->cache_size -= n;
+	context->do_resize = 1;
+	return context->cache_size;
 }
 
-static int dumbRemoveNeighbour(struct nodeID *neighbour)
+static int dumbRemoveNeighbour(struct topman_context *context, struct nodeID *neighbour)
 {
-	current_size = cache_del(local_cache, neighbour);
-	return current_size;
+	context->current_size = cache_del(context->local_cache, neighbour);
+	return context->current_size;
 }
 
 
@@ -234,4 +254,5 @@ struct topman_iface dumb = {
 	.shrinkNeighbourhood = dumbShrinkNeighbourhood,
 	.removeNeighbour = dumbRemoveNeighbour,
 	.getNeighbourhoodSize = dumbGetNeighbourhoodSize,
+	.destroy = dumbDestroy,
 };
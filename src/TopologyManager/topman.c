@@ -1,73 +1,210 @@
 #include <sys/time.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "net_helper.h"
 #include "tman.h"
 #include "topman_iface.h"
+#include "grapes_config.h"
+#include "grapes_msg_types.h"
+#include "int_coding.h"
+#include "../Cache/proto.h"
 
 extern struct topman_iface tman;
 extern struct topman_iface dumb;
 
-static struct topman_iface *tm;
+struct tman_context {
+	struct topman_iface *tm;
+	struct topman_context *tm_context;
+};
+
+/* Instance used by the legacy (context-less) API; NULL until tmanInit() succeeds */
+static struct tman_context *default_context;
+
+
+struct tman_context *tman_init(struct nodeID *myID, void *metadata, int metadata_size, tmanRankingFunction rfun, const char *config)
+{
+	struct tman_context *tc;
+	struct tag *cfg_tags;
+	const char *proto;
+
+	tc = malloc(sizeof(struct tman_context));
+	if (!tc) return NULL;
+
+	tc->tm = &dumb;
+	cfg_tags = grapes_config_parse(config);
+	proto = grapes_config_value_str(cfg_tags, "protocol");
+	if (proto) {
+		if (strcmp(proto, "tman") == 0) {
+			tc->tm = &tman;
+		} else if (strcmp(proto, "dumb") == 0) {
+			tc->tm = &dumb;
+		} else {
+			free(cfg_tags);
+			free(tc);
+			return NULL;
+		}
+	}
+	free(cfg_tags);
+
+	tc->tm_context = tc->tm->init(myID, metadata, metadata_size, rfun, config);
+	if (!tc->tm_context) {
+		free(tc);
+		return NULL;
+	}
+
+	return tc;
+}
+
+void tman_destroy(struct tman_context **tc)
+{
+	if (tc && *tc) {
+		(*tc)->tm->destroy(&((*tc)->tm_context));
+		free(*tc);
+		*tc = NULL;
+	}
+}
+
+int tman_overlay(const uint8_t *buff, int len)
+{
+	const struct topo_header *h = (const struct topo_header *)buff;
+
+	if (len < (int)sizeof(struct topo_header) || h->protocol != MSG_TYPE_TMAN) {
+		return -1;
+	}
+	if (!(h->type & TOPO_OVERLAY)) {
+		return 0;
+	}
+	if (len < (int)sizeof(struct topo_header) + 4) {
+		return -1;
+	}
+
+	return int_rcpy(buff + sizeof(struct topo_header));
+}
+
+int tman_add_neighbour(struct tman_context *tc, struct nodeID *neighbour, void *metadata, int metadata_size)
+{
+	return tc->tm->addNeighbour(tc->tm_context, neighbour, metadata, metadata_size);
+}
+
+int tman_parse_data(struct tman_context *tc, const uint8_t *buff, int len, struct nodeID **peers, int size, const void *metadata, int metadata_size)
+{
+	return tc->tm->parseData(tc->tm_context, buff, len, peers, size, metadata, metadata_size);
+}
+
+int tman_change_metadata(struct tman_context *tc, void *metadata, int metadata_size)
+{
+	return tc->tm->changeMetadata(tc->tm_context, metadata, metadata_size);
+}
+
+const void *tman_get_metadata(struct tman_context *tc, int *metadata_size)
+{
+	return tc->tm->getMetadata(tc->tm_context, metadata_size);
+}
+
+int tman_get_neighbourhood_size(struct tman_context *tc)
+{
+	return tc->tm->getNeighbourhoodSize(tc->tm_context);
+}
+
+int tman_give_peers(struct tman_context *tc, int n, struct nodeID **peers, void *metadata)
+{
+	return tc->tm->givePeers(tc->tm_context, n, peers, metadata);
+}
+
+int tman_grow_neighbourhood(struct tman_context *tc, int n)
+{
+	return tc->tm->growNeighbourhood(tc->tm_context, n);
+}
+
+int tman_shrink_neighbourhood(struct tman_context *tc, int n)
+{
+	return tc->tm->shrinkNeighbourhood(tc->tm_context, n);
+}
+
+int tman_remove_neighbour(struct tman_context *tc, struct nodeID *neighbour)
+{
+	return tc->tm->removeNeighbour(tc->tm_context, neighbour);
+}
 
 
 int tmanInit(struct nodeID *myID, void *metadata, int metadata_size, tmanRankingFunction rfun, const char *config)
 {
-	tm = &dumb;
-	return tm->init(myID, metadata, metadata_size, rfun, config);
+	tman_destroy(&default_context);
+	default_context = tman_init(myID, metadata, metadata_size, rfun, config);
+
+	return default_context ? 0 : -1;
 }
 
 
 int tmanAddNeighbour(struct nodeID *neighbour, void *metadata, int metadata_size)
 {
-	return tm->addNeighbour(neighbour, metadata, metadata_size);
+	if (!default_context) return -1;
+
+	return tman_add_neighbour(default_context, neighbour, metadata, metadata_size);
 }
 
 
 int tmanParseData(const uint8_t *buff, int len, struct nodeID **peers, int size, const void *metadata, int metadata_size)
 {
-	return tm->parseData(buff, len, peers, size, metadata, metadata_size);
+	if (!default_context) return -1;
+
+	return tman_parse_data(default_context, buff, len, peers, size, metadata, metadata_size);
 }
 
 
 int tmanChangeMetadata(void *metadata, int metadata_size)
 {
-	return tm->changeMetadata(metadata, metadata_size);
+	if (!default_context) return -1;
+
+	return tman_change_metadata(default_context, metadata, metadata_size);
 }
 
 
 const void *tmanGetMetadata(int *metadata_size)
 {
-	return tm->getMetadata(metadata_size);
+	if (!default_context) return NULL;
+
+	return tman_get_metadata(default_context, metadata_size);
 }
 
 
 int tmanGetNeighbourhoodSize(void)
 {
-	return tm->getNeighbourhoodSize();
+	if (!default_context) return -1;
+
+	return tman_get_neighbourhood_size(default_context);
 }
 
 
 int tmanGivePeers (int n, struct nodeID **peers, void *metadata)
 {
-	return tm->givePeers (n, peers, metadata);
+	if (!default_context) return -1;
+
+	return tman_give_peers(default_context, n, peers, metadata);
 }
 
 
 int tmanGrowNeighbourhood(int n)
 {
-	return tm->growNeighbourhood(n);
+	if (!default_context) return -1;
+
+	return tman_grow_neighbourhood(default_context, n);
 }
 
 
 int tmanShrinkNeighbourhood(int n)
 {
-	return tm->shrinkNeighbourhood(n);
+	if (!default_context) return -1;
+
+	return tman_shrink_neighbourhood(default_context, n);
 }
 
 
 int tmanRemoveNeighbour(struct nodeID *neighbour)
 {
-	return tm->removeNeighbour(neighbour);
+	if (!default_context) return -1;
+
+	return tman_remove_neighbour(default_context, neighbour);
 }
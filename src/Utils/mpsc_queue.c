@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Multiple producers, single consumer queue (Vyukov's algorithm): a push
+ *  is an atomic exchange of the head pointer, followed by the store linking
+ *  the previous head to the new node.
+ */
+#include <stdlib.h>
+
+#include "mpsc_queue.h"
+
+void mpsc_queue_init(struct mpsc_queue *q)
+{
+  q->stub.next = NULL;
+  q->head = &q->stub;
+  q->tail = &q->stub;
+}
+
+void mpsc_queue_push(struct mpsc_queue *q, struct mpsc_node *n)
+{
+  struct mpsc_node *prev;
+
+  __atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n(&q->head, n, __ATOMIC_SEQ_CST);
+  /* Until this store, the consumer cannot see n (nor the nodes pushed
+     after it) */
+  __atomic_store_n(&prev->next, n, __ATOMIC_SEQ_CST);
+}
+
+struct mpsc_node *mpsc_queue_pop(struct mpsc_queue *q)
+{
+  struct mpsc_node *tail, *next, *head;
+
+  tail = q->tail;
+  next = __atomic_load_n(&tail->next, __ATOMIC_SEQ_CST);
+  if (tail == &q->stub) {
+    if (next == NULL) {
+      return NULL;
+    }
+    q->tail = next;
+    tail = next;
+    next = __atomic_load_n(&next->next, __ATOMIC_SEQ_CST);
+  }
+  if (next) {
+    q->tail = next;
+
+    return tail;
+  }
+
+  head = __atomic_load_n(&q->head, __ATOMIC_SEQ_CST);
+  if (tail != head) {
+    /* A push is in progress */
+    return NULL;
+  }
+  /* tail is the last node: it can be returned only when another one
+     follows it, so push the stub */
+  mpsc_queue_push(q, &q->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_SEQ_CST);
+  if (next) {
+    q->tail = next;
+
+    return tail;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,28 @@
+#ifndef MPSC_QUEUE
+#define MPSC_QUEUE
+
+/* Lock-free, unbounded, intrusive queue: any number of threads can push
+   nodes, a single thread pops them. Embed a struct mpsc_node in the queued
+   structures */
+struct mpsc_node {
+  struct mpsc_node *next;
+};
+
+struct mpsc_queue {
+  struct mpsc_node *head;	/* last pushed node */
+  struct mpsc_node *tail;	/* next node to pop (owned by the consumer) */
+  struct mpsc_node stub;
+};
+
+/* Initialise an empty queue */
+void mpsc_queue_init(struct mpsc_queue *q);
+
+/* Add a node to the tail of the queue; can be invoked by any thread, and
+   never blocks */
+void mpsc_queue_push(struct mpsc_queue *q, struct mpsc_node *n);
+
+/* Remove and return the head of the queue, or NULL if the queue is empty.
+   Only the consumer thread can invoke it. NULL can also be returned while
+   a push is in progress: the node becomes visible when the push completes */
+struct mpsc_node *mpsc_queue_pop(struct mpsc_queue *q);
+#endif
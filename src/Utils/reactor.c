@@ -0,0 +1,445 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Event loop: file descriptors are registered once (in an epoll set on
+ *  Linux, in a persistent pollfd array elsewhere), timers are kept in a
+ *  binary heap ordered by expiration time.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+#include <unistd.h>
+
+#include "reactor.h"
+#include "grapes_config.h"
+
+#define DEFAULT_MAX_EVENTS 64
+
+struct fd_handler {
+  int fd;		/* -1 if the slot is free */
+  uint32_t gen;		/* incremented when the slot is released */
+  reactor_fd_cb cb;
+  void *arg;
+};
+
+struct timer {
+  uint64_t deadline;	/* in us */
+  uint64_t period;
+  int id;
+  reactor_timer_cb cb;
+  void *arg;
+};
+
+struct reactor {
+  struct fd_handler *fds;
+  int fds_size;
+  int n_fds;
+  uint64_t *ready;	/* (generation << 32) | slot, for each ready fd */
+  int max_events;
+#ifdef __linux__
+  int epfd;
+  struct epoll_event *events;
+#else
+  struct pollfd *pfds;	/* pfds[i] describes fds[i] */
+#endif
+
+  struct timer *timers;
+  int timers_size;
+  int n_timers;
+  int next_id;
+
+  int stop;
+};
+
+static uint64_t now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+struct reactor *reactor_init(const char *config)
+{
+  struct reactor *r;
+  struct tag *cfg_tags;
+  int max_events;
+
+  max_events = DEFAULT_MAX_EVENTS;
+  cfg_tags = grapes_config_parse(config);
+  if (cfg_tags) {
+    grapes_config_value_int(cfg_tags, "max_events", &max_events);
+    free(cfg_tags);
+  }
+  if (max_events <= 0) {
+    return NULL;
+  }
+
+  r = malloc(sizeof(struct reactor));
+  if (r == NULL) {
+    return NULL;
+  }
+  memset(r, 0, sizeof(struct reactor));
+  r->max_events = max_events;
+  r->ready = malloc(max_events * sizeof(uint64_t));
+#ifdef __linux__
+  r->events = malloc(max_events * sizeof(struct epoll_event));
+  r->epfd = epoll_create(max_events);
+  if (r->ready == NULL || r->events == NULL || r->epfd < 0) {
+    if (r->epfd >= 0) {
+      close(r->epfd);
+    }
+    free(r->events);
+#else
+  if (r->ready == NULL) {
+#endif
+    free(r->ready);
+    free(r);
+
+    return NULL;
+  }
+
+  return r;
+}
+
+void reactor_destroy(struct reactor **r)
+{
+  if (*r == NULL) {
+    return;
+  }
+#ifdef __linux__
+  close((*r)->epfd);
+  free((*r)->events);
+#else
+  free((*r)->pfds);
+#endif
+  free((*r)->ready);
+  free((*r)->fds);
+  free((*r)->timers);
+  free(*r);
+  *r = NULL;
+}
+
+static int fd_slot(const struct reactor *r, int fd)
+{
+  int i;
+
+  for (i = 0; i < r->fds_size; i++) {
+    if (r->fds[i].fd == fd) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static int fd_slot_alloc(struct reactor *r)
+{
+  struct fd_handler *new_fds;
+  int i, new_size;
+
+  i = fd_slot(r, -1);
+  if (i >= 0) {
+    return i;
+  }
+
+  new_size = r->fds_size ? r->fds_size * 2 : 8;
+  new_fds = realloc(r->fds, new_size * sizeof(struct fd_handler));
+  if (new_fds == NULL) {
+    return -1;
+  }
+  r->fds = new_fds;
+#ifndef __linux__
+  {
+    struct pollfd *new_pfds;
+
+    new_pfds = realloc(r->pfds, new_size * sizeof(struct pollfd));
+    if (new_pfds == NULL) {
+      return -1;
+    }
+    r->pfds = new_pfds;
+    for (i = r->fds_size; i < new_size; i++) {
+      r->pfds[i].fd = -1;
+      r->pfds[i].events = POLLIN;
+    }
+  }
+#endif
+  for (i = r->fds_size; i < new_size; i++) {
+    r->fds[i].fd = -1;
+    r->fds[i].gen = 0;
+  }
+  i = r->fds_size;
+  r->fds_size = new_size;
+
+  return i;
+}
+
+int reactor_add_fd(struct reactor *r, int fd, reactor_fd_cb cb, void *arg)
+{
+  int i;
+
+  if (fd < 0 || fd_slot(r, fd) >= 0) {
+    return -1;
+  }
+  i = fd_slot_alloc(r);
+  if (i < 0) {
+    return -1;
+  }
+#ifdef __linux__
+  {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)r->fds[i].gen << 32) | i;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      return -1;
+    }
+  }
+#else
+  r->pfds[i].fd = fd;
+#endif
+  r->fds[i].fd = fd;
+  r->fds[i].cb = cb;
+  r->fds[i].arg = arg;
+  r->n_fds++;
+
+  return 0;
+}
+
+int reactor_del_fd(struct reactor *r, int fd)
+{
+  int i;
+
+  i = fd < 0 ? -1 : fd_slot(r, fd);
+  if (i < 0) {
+    return -1;
+  }
+#ifdef __linux__
+  epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+#else
+  r->pfds[i].fd = -1;
+#endif
+  /* Events already collected for this slot are ignored by the dispatcher */
+  r->fds[i].fd = -1;
+  r->fds[i].gen++;
+  r->n_fds--;
+
+  return 0;
+}
+
+static void timer_swap(struct reactor *r, int i, int j)
+{
+  struct timer tmp;
+
+  tmp = r->timers[i];
+  r->timers[i] = r->timers[j];
+  r->timers[j] = tmp;
+}
+
+static void heap_up(struct reactor *r, int i)
+{
+  while (i > 0 && r->timers[(i - 1) / 2].deadline > r->timers[i].deadline) {
+    timer_swap(r, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void heap_down(struct reactor *r, int i)
+{
+  for (;;) {
+    int l = 2 * i + 1;
+    int min = i;
+
+    if (l < r->n_timers && r->timers[l].deadline < r->timers[min].deadline) {
+      min = l;
+    }
+    if (l + 1 < r->n_timers && r->timers[l + 1].deadline < r->timers[min].deadline) {
+      min = l + 1;
+    }
+    if (min == i) {
+      return;
+    }
+    timer_swap(r, i, min);
+    i = min;
+  }
+}
+
+int reactor_add_timer(struct reactor *r, const struct timeval *period, reactor_timer_cb cb, void *arg)
+{
+  struct timer *t;
+  uint64_t p;
+
+  p = (uint64_t)period->tv_sec * 1000000 + period->tv_usec;
+  if (period->tv_sec < 0 || period->tv_usec < 0 || p == 0 || r->next_id == INT_MAX) {
+    return -1;
+  }
+  if (r->n_timers == r->timers_size) {
+    struct timer *new_timers;
+    int new_size = r->timers_size ? r->timers_size * 2 : 8;
+
+    new_timers = realloc(r->timers, new_size * sizeof(struct timer));
+    if (new_timers == NULL) {
+      return -1;
+    }
+    r->timers = new_timers;
+    r->timers_size = new_size;
+  }
+  t = &r->timers[r->n_timers];
+  t->period = p;
+  t->deadline = now_us() + p;
+  t->id = r->next_id++;
+  t->cb = cb;
+  t->arg = arg;
+  heap_up(r, r->n_timers++);
+
+  return r->next_id - 1;
+}
+
+int reactor_del_timer(struct reactor *r, int id)
+{
+  int i;
+
+  for (i = 0; i < r->n_timers; i++) {
+    if (r->timers[i].id == id) {
+      r->timers[i] = r->timers[--r->n_timers];
+      if (i < r->n_timers) {
+        heap_up(r, i);
+        heap_down(r, i);
+      }
+
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/* Wait for at most wait (in us, or forever if negative), and store the
+   ready slots in r->ready */
+static int fds_wait(struct reactor *r, int64_t wait)
+{
+  int ms, i, n;
+
+  if (wait < 0) {
+    ms = -1;
+  } else if (wait / 1000 >= INT_MAX) {
+    ms = INT_MAX;
+  } else {
+    ms = (wait + 999) / 1000;
+  }
+
+#ifdef __linux__
+  n = epoll_wait(r->epfd, r->events, r->max_events, ms);
+  if (n < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+  for (i = 0; i < n; i++) {
+    r->ready[i] = r->events[i].data.u64;
+  }
+#else
+  n = poll(r->pfds, r->fds_size, ms);
+  if (n < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+  /* Level triggered: descriptors exceeding max_events are reported again
+     by the next wait */
+  for (i = 0, n = 0; i < r->fds_size && n < r->max_events; i++) {
+    if (r->pfds[i].fd >= 0 && r->pfds[i].revents) {
+      r->ready[n++] = ((uint64_t)r->fds[i].gen << 32) | i;
+    }
+  }
+#endif
+
+  return n;
+}
+
+int reactor_run_once(struct reactor *r, const struct timeval *tout)
+{
+  int64_t wait;
+  uint64_t now;
+  int i, n, res;
+
+  if (tout) {
+    wait = (int64_t)tout->tv_sec * 1000000 + tout->tv_usec;
+  } else if (r->n_fds == 0 && r->n_timers == 0) {
+    return -1;
+  } else {
+    wait = -1;
+  }
+  if (r->n_timers) {
+    int64_t next;
+
+    now = now_us();
+    next = r->timers[0].deadline > now ? (int64_t)(r->timers[0].deadline - now) : 0;
+    if (wait < 0 || next < wait) {
+      wait = next;
+    }
+  }
+
+  n = fds_wait(r, wait);
+  if (n < 0) {
+    return n;
+  }
+  res = 0;
+  for (i = 0; i < n; i++) {
+    int slot = r->ready[i] & 0xFFFFFFFF;
+    struct fd_handler *h = &r->fds[slot];
+
+    /* Skip the descriptors removed by a previous callback of this batch */
+    if (h->fd >= 0 && h->gen == r->ready[i] >> 32) {
+      h->cb(h->arg, h->fd);
+      res++;
+    }
+  }
+
+  now = now_us();
+  while (r->n_timers && r->timers[0].deadline <= now) {
+    struct timer *t = &r->timers[0];
+    reactor_timer_cb cb = t->cb;
+    void *arg = t->arg;
+
+    /* Reschedule before invoking the callback, so that it can delete the
+       timer; if the loop has been late, do not try to catch up */
+    t->deadline += t->period;
+    if (t->deadline <= now) {
+      t->deadline = now + t->period;
+    }
+    heap_down(r, 0);
+    cb(arg);
+    res++;
+  }
+
+  return res;
+}
+
+int reactor_run(struct reactor *r)
+{
+  r->stop = 0;
+  while (!r->stop) {
+    int res;
+
+    res = reactor_run_once(r, NULL);
+    if (res < 0) {
+      return res;
+    }
+  }
+
+  return 0;
+}
+
+void reactor_stop(struct reactor *r)
+{
+  r->stop = 1;
+}
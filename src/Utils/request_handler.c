@@ -5,11 +5,13 @@
  *
  */
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <string.h>
 #include <sys/time.h>
+#include <fcntl.h>
 
 #include "request_handler.h"
 #include "fifo_queue.h"
@@ -27,6 +29,9 @@ struct req_handler_ctx {
   pthread_cond_t rsp_queue_sync_cond;
   pthread_mutex_t rsp_queue_lock;
   fifo_queue_p rsp_queue;
+  /* holds one byte per queued response, so that the read end is readable
+     while some response is ready */
+  int rsp_pipe[2];
 
   /* thread management */
   pthread_attr_t req_handler_thread_attr;
@@ -70,6 +75,9 @@ void req_handler_destroy(struct req_handler_ctx *ctx)
 
   pthread_attr_destroy(&ctx->req_handler_thread_attr);
 
+  if (ctx->rsp_pipe[0] >= 0) close(ctx->rsp_pipe[0]);
+  if (ctx->rsp_pipe[1] >= 0) close(ctx->rsp_pipe[1]);
+
   free(ctx);
   return;
 }
@@ -82,6 +90,7 @@ struct req_handler_ctx* req_handler_init()
 
   ctx = malloc(sizeof(struct req_handler_ctx));
   memset(ctx, 0, sizeof(struct req_handler_ctx));
+  ctx->rsp_pipe[0] = ctx->rsp_pipe[1] = -1;
 
   ctx->req_queue = fifo_queue_create(10);
   if (!ctx->req_queue) {
@@ -95,6 +104,15 @@ struct req_handler_ctx* req_handler_init()
     return 0;
   }
 
+  err = pipe(ctx->rsp_pipe);
+  if (err) {
+    ctx->rsp_pipe[0] = ctx->rsp_pipe[1] = -1;
+    req_handler_destroy(ctx);
+    return 0;
+  }
+  fcntl(ctx->rsp_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(ctx->rsp_pipe[1], F_SETFL, O_NONBLOCK);
+
 
   err = pthread_mutex_init(&ctx->req_queue_lock, NULL);
   if (err) {
@@ -238,11 +256,17 @@ static int add_response(struct req_handler_ctx *ctx, void *rsp)
   /* add the response to the pool */
   pthread_mutex_lock(&ctx->rsp_queue_lock);
   err = fifo_queue_add(ctx->rsp_queue, rsp);
+  if (!err) {
+    /* notify the event loops monitoring the response fd (before a
+       consumer can take the response, so that the pipe never holds
+       fewer bytes than the queued responses)... */
+    write(ctx->rsp_pipe[1], "", 1);
+  }
   pthread_mutex_unlock(&ctx->rsp_queue_lock);
 
   if (err) return 1;
 
-  /* notify wait4response there's a response in the queue */
+  /* ...and wait4response there's a response in the queue */
   pthread_mutex_lock(&ctx->rsp_queue_sync_mutex);
   pthread_cond_signal(&ctx->rsp_queue_sync_cond);
   pthread_mutex_unlock(&ctx->rsp_queue_sync_mutex);
@@ -270,11 +294,21 @@ void* req_handler_remove_response(struct req_handler_ctx *ctx)
 
   pthread_mutex_lock(&ctx->rsp_queue_lock);
   rsp = fifo_queue_remove_head(ctx->rsp_queue);
+  if (rsp) {
+    uint8_t b;
+
+    read(ctx->rsp_pipe[0], &b, 1);
+  }
   pthread_mutex_unlock(&ctx->rsp_queue_lock);
 
   return rsp;
 }
 
+int req_handler_get_fd(struct req_handler_ctx *ctx)
+{
+  return ctx->rsp_pipe[0];
+}
+
 
 /***********************************************************************
  * Request handler implementation
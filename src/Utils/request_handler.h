@@ -49,4 +49,8 @@ void* req_handler_get_response(struct req_handler_ctx *ctx);
 /* Return and remove the first response in the queue or NULL if none is ready*/
 void* req_handler_remove_response(struct req_handler_ctx *ctx);
 
+/* Return a file descriptor which is readable while some response is in the
+   queue, to be monitored by event loops in place of wait4response */
+int req_handler_get_fd(struct req_handler_ctx *ctx);
+
 #endif /* CLOUD_HELPER_DELEGATE_UTILS_H */
@@ -0,0 +1,196 @@
+/*
+ *  Copyright (c) 2026 agent
+ *
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  UDP net helper using sendmmsg()/recvmmsg() for batched I/O.
+ *  Everything but the batch API is shared with net_helper-udp.c
+ */
+
+#define _GNU_SOURCE
+#define NH_BATCH
+
+#include "net_helper-udp.c"
+
+#define BATCH_SIZE 64
+
+/*
+ * Send the n datagrams in msgs; peer[k] is the index of the destination of
+ * msgs[k], and failed[peer[k]] is set if msgs[k] cannot be sent. Return the
+ * number of datagrams sent
+ */
+static int batch_flush(int fd, struct mmsghdr *msgs, const int *peer, int n, int size, uint8_t *failed)
+{
+  int done, res, sent;
+
+  done = 0;
+  sent = 0;
+  while (done < n) {
+    res = sendmmsg(fd, msgs + done, n - done, 0);
+    if (res < 0) {
+      int error = errno;
+
+      fprintf(stderr,"net-helper: sendmmsg failed errno %d: %s\n", error, strerror(error));
+      if (error == EMSGSIZE) {
+        /* The next messages will use smaller fragments */
+        frag_size_shrink(msgs[done].msg_hdr.msg_name, size);
+      }
+      /* Skip the offending datagram, and go on with the other ones */
+      failed[peer[done]] = 1;
+      done++;
+      continue;
+    }
+    done += res;
+    sent += res;
+  }
+
+  return sent;
+}
+
+int send_to_peers_iov(const struct nodeID *from, struct nodeID * const *to, int n, const struct iovec *data, int iovcnt)
+{
+  struct mmsghdr msgs[BATCH_SIZE];
+  int peer[BATCH_SIZE];
+  struct my_hdr_t *hdrs;
+  struct iovec *iov;
+  int *iovlen;
+  uint8_t *failed;
+  uint32_t m_seq;
+  int frags, i, j, queued, errors, batched, batch_failed, frags_sent, buffer_size, size;
+
+  buffer_size = iov_size(data, iovcnt);
+  if (buffer_size <= 0 || n <= 0 || iovcnt > MAX_IOV) return -1;
+
+  size = frag_size;
+  frags = (buffer_size + size - 1) / size;
+  hdrs = malloc(frags * sizeof(struct my_hdr_t));
+  iov = malloc((MAX_IOV + 1) * frags * sizeof(struct iovec));
+  iovlen = malloc(frags * sizeof(int));
+  failed = calloc(n, 1);
+  if (hdrs == NULL || iov == NULL || iovlen == NULL || failed == NULL) {
+    free(hdrs);
+    free(iov);
+    free(iovlen);
+    free(failed);
+
+    return -1;
+  }
+
+  /* The fragments are the same for all the destinations: build them once */
+  m_seq = ATOMIC_ADD(&next_m_seq, 1);
+  for (j = 0; j < frags; j++) {
+    struct iovec *frag_iov = &iov[(MAX_IOV + 1) * j];
+    int len = (j == frags - 1) ? buffer_size - j * size : size;
+
+    hdr_fill(&hdrs[j], m_seq, buffer_size, j, size);
+    frag_iov[0].iov_base = &hdrs[j];
+    frag_iov[0].iov_len = sizeof(struct my_hdr_t);
+    iovlen[j] = 1 + iov_slice(frag_iov + 1, MAX_IOV, data, iovcnt, j * size, len);
+  }
+
+  memset(msgs, 0, sizeof(msgs));
+  queued = 0;
+  errors = 0;
+  batched = 0;
+  frags_sent = 0;
+  for (i = 0; i < n; i++) {
+    if (dest_frag_size(&to[i]->addr) != size) {
+      /* The path MTU towards this peer is smaller: send it on its own
+         (send_to_peer_iov() updates the counters) */
+      if (send_to_peer_iov(from, to[i], data, iovcnt) < 0) {
+        errors++;
+      }
+      continue;
+    }
+    batched++;
+    /* The fragments of a peer can be split between two flushes */
+    for (j = 0; j < frags; j++) {
+      msgs[queued].msg_hdr.msg_name = &to[i]->addr;
+      msgs[queued].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+      msgs[queued].msg_hdr.msg_iov = &iov[(MAX_IOV + 1) * j];
+      msgs[queued].msg_hdr.msg_iovlen = iovlen[j];
+      peer[queued] = i;
+      if (++queued == BATCH_SIZE) {
+        frags_sent += batch_flush(from->fd, msgs, peer, queued, size, failed);
+        queued = 0;
+      }
+    }
+  }
+  if (queued) {
+    frags_sent += batch_flush(from->fd, msgs, peer, queued, size, failed);
+  }
+
+  batch_failed = 0;
+  for (i = 0; i < n; i++) {
+    batch_failed += failed[i];
+  }
+  free(hdrs);
+  free(iov);
+  free(iovlen);
+  free(failed);
+  sent_account(batched - batch_failed, frags_sent, (uint64_t)(batched - batch_failed) * buffer_size);
+
+  return n - errors - batch_failed;
+}
+
+int recv_from_peer_batch(const struct nodeID *local, struct nodeID **remote, uint8_t **buffer_ptr, int buffer_size, int *len, int n)
+{
+  struct mmsghdr msgs[BATCH_SIZE];
+  struct sockaddr_storage raddr[BATCH_SIZE];
+  struct my_hdr_t hdrs[BATCH_SIZE];
+  struct iovec iov[2 * BATCH_SIZE];
+  int i, res, received;
+
+  if (n <= 0) return -1;
+  if (n > BATCH_SIZE) n = BATCH_SIZE;
+
+  if (gro_state(local->fd)) {
+    /* Coalesced buffers can be larger than the batch buffers: split them
+       one by one */
+    for (received = 0; received < n; received++) {
+      res = recv_msg(local, &remote[received], buffer_ptr[received], buffer_size, received ? MSG_DONTWAIT : 0);
+      if (res < 0) {
+        break;
+      }
+      len[received] = res;
+    }
+
+    return received ? received : -1;
+  }
+
+  memset(msgs, 0, n * sizeof(struct mmsghdr));
+  for (i = 0; i < n; i++) {
+    iov[2 * i].iov_base = &hdrs[i];
+    iov[2 * i].iov_len = sizeof(struct my_hdr_t);
+    iov[2 * i + 1].iov_base = buffer_ptr[i];
+    iov[2 * i + 1].iov_len = buffer_size > MAX_MSG_SIZE ? MAX_MSG_SIZE : buffer_size;
+    msgs[i].msg_hdr.msg_name = &raddr[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    msgs[i].msg_hdr.msg_iov = &iov[2 * i];
+    msgs[i].msg_hdr.msg_iovlen = 2;
+  }
+
+  res = recvmmsg(local->fd, msgs, n, MSG_WAITFORONE, NULL);
+  if (res <= 0) {
+    return -1;
+  }
+
+  /* The completed messages are compacted at the beginning of buffer_ptr;
+     the fragments of incomplete ones go to the reassembly table */
+  received = 0;
+  for (i = 0; i < res; i++) {
+    int size;
+
+    size = frag_recv(&raddr[i], &hdrs[i], buffer_ptr[i], msgs[i].msg_len - (int)sizeof(struct my_hdr_t), buffer_ptr[received], buffer_size);
+    if (size <= 0) {
+      continue;
+    }
+    remote[received] = nodeid_new(&raddr[i], msgs[i].msg_hdr.msg_namelen);
+    if (remote[received] == NULL) {
+      break;
+    }
+    len[received++] = size;
+  }
+
+  return received ? received : -1;
+}
@@ -172,6 +172,29 @@ int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *
   return recv;
 }
 
+/* No batched I/O: one system call per message */
+int send_to_peers_batch(const struct nodeID *from, struct nodeID * const *to, int n, const uint8_t *buffer_ptr, int buffer_size)
+{
+  int i, sent;
+
+  for (i = 0, sent = 0; i < n; i++) {
+    if (send_to_peer(from, to[i], buffer_ptr, buffer_size) >= 0) {
+      sent++;
+    }
+  }
+
+  return sent;
+}
+
+int recv_from_peer_batch(const struct nodeID *local, struct nodeID **remote, uint8_t **buffer_ptr, int buffer_size, int *len, int n)
+{
+  if (n <= 0) return -1;
+
+  len[0] = recv_from_peer(local, &remote[0], buffer_ptr[0], buffer_size);
+
+  return len[0] < 0 ? -1 : 1;
+}
+
 int node_addr(const struct nodeID *s, char *addr, int len)
 {
   int n;
@@ -203,6 +226,22 @@ int nodeid_cmp(const struct nodeID *s1, const struct nodeID *s2)
   return memcmp(&s1->addr, &s2->addr, sizeof(struct sockaddr_in));
 }
 
+uint32_t nodeid_hash(const struct nodeID *s)
+{
+  const uint8_t *addr = (const uint8_t *)&s->addr.sin_addr;
+  uint16_t port = ntohs(s->addr.sin_port);
+  uint32_t h = 2166136261U;	/* 32 bit FNV-1a, as in the UDP net helper */
+  int i;
+
+  for (i = 0; i < sizeof(s->addr.sin_addr); i++) {
+    h = (h ^ addr[i]) * 16777619U;
+  }
+  h = (h ^ (port & 0xff)) * 16777619U;
+  h = (h ^ (port >> 8)) * 16777619U;
+
+  return h;
+}
+
 int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size)
 {
   if (max_write_size < sizeof(struct sockaddr_in)) return -1;
@@ -225,6 +264,19 @@ struct nodeID *nodeid_undump(const uint8_t *b, int *len)
   return res;
 }
 
+struct nodeID *nodeid_undump_reuse(struct nodeID *s, const uint8_t *b, int *len)
+{
+  if (s == NULL) {
+    return nodeid_undump(b, len);
+  }
+  /* nodeIDs are not shared here, so s can simply be overwritten */
+  memcpy(&s->addr, b, sizeof(struct sockaddr_in));
+  s->fd = -1;
+  *len = sizeof(struct sockaddr_in);
+
+  return s;
+}
+
 void nodeid_free(struct nodeID *s)
 {
   free(s);
@@ -237,3 +289,83 @@ int node_ip(const struct nodeID *s, char *ip, int len)
   return 1;
 }
 
+int node_fd(const struct nodeID *s)
+{
+  return s->fd;
+}
+
+int net_helper_stats(struct net_helper_stats *s)
+{
+  return -1;
+}
+
+int send_to_peer_async(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+{
+  return send_to_peer(from, (struct nodeID *)(uintptr_t)to, buffer_ptr, buffer_size);
+}
+
+void send_to_peer_flush(void)
+{
+}
+
+/* No scatter/gather I/O: the buffers are gathered in a single message */
+static uint8_t *iov_gather(const struct iovec *iov, int iovcnt, int *size)
+{
+  uint8_t *buff;
+  int i, pos;
+
+  for (i = 0, *size = 0; i < iovcnt; i++) {
+    *size += iov[i].iov_len;
+  }
+  if (*size <= 0) {
+    return NULL;
+  }
+  buff = malloc(*size);
+  if (buff == NULL) {
+    return NULL;
+  }
+  for (i = 0, pos = 0; i < iovcnt; i++) {
+    memcpy(buff + pos, iov[i].iov_base, iov[i].iov_len);
+    pos += iov[i].iov_len;
+  }
+
+  return buff;
+}
+
+int send_to_peer_iov(const struct nodeID *from, const struct nodeID *to, const struct iovec *iov, int iovcnt)
+{
+  uint8_t *buff;
+  int size, res;
+
+  buff = iov_gather(iov, iovcnt, &size);
+  if (buff == NULL) {
+    return -1;
+  }
+  res = send_to_peer(from, (struct nodeID *)(uintptr_t)to, buff, size);
+  free(buff);
+
+  return res;
+}
+
+int send_to_peers_iov(const struct nodeID *from, struct nodeID * const *to, int n, const struct iovec *iov, int iovcnt)
+{
+  uint8_t *buff;
+  int i, size, sent;
+
+  buff = iov_gather(iov, iovcnt, &size);
+  if (buff == NULL) {
+    return -1;
+  }
+  for (i = 0, sent = 0; i < n; i++) {
+    if (send_to_peer(from, to[i], buff, size) >= 0) {
+      sent++;
+    }
+  }
+  free(buff);
+
+  return sent;
+}
+
+void net_helper_deinit(void)
+{
+}
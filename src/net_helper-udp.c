@@ -19,21 +19,107 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <netinet/udp.h>
+/* Segmentation offload: available since Linux 4.18 (GSO) and 5.0 (GRO) */
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#endif
 #else
 #define _WIN32_WINNT 0x0501 /* WINNT>=0x501 (WindowsXP) for supporting getaddrinfo/freeaddrinfo.*/
 #include "win32-net.h"
 #endif
 
 #include "net_helper.h"
+#include "grapes_config.h"
+#include "Utils/mpsc_queue.h"
+
+#define MAX_MSG_SIZE (1024 * 60)
+#define MAX_IOV 8
+#define WAIT_FDS 16
+#define REASM_BUCKETS 64
+#define UDP_HDR_SIZE 8
+#define MIN_FRAG_SIZE 512
+#define GSO_MAX_SEGS 64
+#define GSO_MAX_BYTES 65000
+#define DEFAULT_REASM_TIMEOUT 1000		/* ms */
+#define DEFAULT_REASM_MEMORY (8 * 1024 * 1024)
+#define PMTU_ENTRIES 256
+#define DEFAULT_PMTU_TIMEOUT 600000		/* ms */
+#define DEFAULT_SEND_QUEUE 1024
 
-#define MAX_MSG_SIZE 1024 * 60
+/*
+ * The send functions can be invoked by many threads at the same time: the
+ * state they share (message sequence number, GSO flag and send counters)
+ * is only accessed through these, and the path MTU cache is locked. The
+ * counters are read by net_helper_stats() from any thread, so the receive
+ * path updates them atomically too. The reassembly table is not locked: it
+ * is used (and expired) by the receive path only
+ */
+#define ATOMIC_LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define ATOMIC_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define ATOMIC_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0
+#endif
 enum L3PROTOCOL {IPv4, IPv6} l3 = IPv4;
 
+/*
+ * Compact nodeID serialisation: a tag byte followed by the port and by the
+ * address (both in network byte order), for a total of 7 bytes for IPv4 and
+ * 19 bytes for IPv6. The tag always has the most significant bit set, while
+ * the legacy format (a raw struct sockaddr_storage) starts with the address
+ * family, so nodeid_undump() can accept both.
+ * Older peers only understand the legacy format, so unless the
+ * "nodeid_dump" config tag forces a format nodeid_dump() produces legacy
+ * dumps until a compact one is received (all the peers that can send it
+ * can also parse it).
+ */
+#define NODEID_COMPACT_V1 0x80
+#define NODEID_COMPACT_IPV4 (NODEID_COMPACT_V1 | 0x04)
+#define NODEID_COMPACT_IPV6 (NODEID_COMPACT_V1 | 0x06)
+enum dump_format {DUMP_AUTO, DUMP_LEGACY, DUMP_COMPACT};
+static enum dump_format dump_format = DUMP_AUTO;
+static int compact_seen;
+
 struct nodeID {
   struct sockaddr_storage addr;
   int fd;
+  int interned;		/* set on creation, never changed */
+  int refcnt;		/* only for interned nodeIDs, protected by intern_lock */
+  struct nodeID *next;	/* interning table chain */
 };
 
+/*
+ * Optional (see the "nodeid_intern" config tag) table of canonical nodeIDs:
+ * when enabled there is only one nodeID per address, shared through a
+ * reference count, so nodeid_equal() is a pointer comparison and receiving
+ * from or parsing known peers does not allocate memory.
+ * The table and the reference counts are protected by intern_lock, so
+ * nodeIDs can be created, duplicated and freed by different threads.
+ */
+static struct nodeID **intern_table;
+static unsigned int intern_size;
+static unsigned int intern_count;
+#ifndef _WIN32
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+#define INTERN_LOCK() pthread_mutex_lock(&intern_lock)
+#define INTERN_UNLOCK() pthread_mutex_unlock(&intern_lock)
+#else
+#define INTERN_LOCK()
+#define INTERN_UNLOCK()
+#endif
+
 #ifdef _WIN32
 static int inet_aton(const char *cp, struct in_addr *addr)
 {
@@ -147,14 +233,107 @@ ssize_t sendmsg (int sd, struct msghdr * msg, int flags)
 
 #endif
 
+/*
+ * With "gso=1", the fragments of a message are passed to the kernel in
+ * groups, as single buffers that the kernel (or the NIC) splits in
+ * datagrams. With "gro=1", the kernel can return many datagrams of the
+ * same flow as a single buffer (which can be larger than the receiver's
+ * buffer, because of the fragment headers): it is received in the
+ * gro_state of the socket, and its datagrams are handled one by one by
+ * the next receive operations
+ */
+#define GRO_BUFF_SIZE 65536
+
+struct gro_state {
+  uint8_t *next;
+  int len;			/* bytes still to be handled */
+  int seg;			/* datagram size */
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  uint8_t buff[GRO_BUFF_SIZE];
+};
+
+static int gso;
+static int gro;
+static struct gro_state **gro_states;	/* indexed by fd; NULL if GRO is not enabled */
+static int gro_states_size;
+
+static struct gro_state *gro_state(int fd)
+{
+  return fd >= 0 && fd < gro_states_size ? gro_states[fd] : NULL;
+}
+
+/* Some coalesced datagrams received by s have not been handled yet */
+static int gro_pending(const struct nodeID *s)
+{
+  struct gro_state *g = gro_state(s->fd);
+
+  return g && g->len > 0;
+}
+
 int wait4data(const struct nodeID *s, struct timeval *tout, int *user_fds)
 /* returns 0 if timeout expires 
- * returns -1 in case of error of the select function
+ * returns -1 in case of error of the poll/select function
  * retruns 1 if the nodeID file descriptor is ready to be read
  * 					(i.e., some data is ready from the network socket)
  * returns 2 if some of the user_fds file descriptors is ready
  */
 {
+#ifndef _WIN32
+  /* poll() does not depend on the values of the fds (no FD_SETSIZE limit);
+     applications waiting on many descriptors should use a reactor */
+  struct pollfd small_pfds[WAIT_FDS], *pfds;
+  int i, n, res, ms;
+
+  n = s ? 1 : 0;
+  if (user_fds) {
+    for (i = 0; user_fds[i] != -1; i++);
+    n += i;
+  }
+  pfds = n > WAIT_FDS ? malloc(n * sizeof(struct pollfd)) : small_pfds;
+  if (pfds == NULL) {
+    return -1;
+  }
+  n = 0;
+  if (s) {
+    pfds[n].fd = s->fd;
+    pfds[n++].events = POLLIN;
+  }
+  if (user_fds) {
+    for (i = 0; user_fds[i] != -1; i++) {
+      pfds[n].fd = user_fds[i];
+      pfds[n++].events = POLLIN;
+    }
+  }
+  ms = tout ? tout->tv_sec * 1000 + (tout->tv_usec + 999) / 1000 : -1;
+  if (s && gro_pending(s)) {
+    ms = 0;
+  }
+  res = poll(pfds, n, ms);
+  if (s && gro_pending(s)) {
+    pfds[0].revents |= POLLIN;
+    res = 1;
+  }
+  if (res > 0) {
+    if (s && pfds[0].revents) {
+      res = 1;
+    } else {
+      /* If execution arrives here, user_fds cannot be 0
+         (an FD is ready, and it's not s->fd) */
+      for (i = 0; user_fds[i] != -1; i++) {
+        if (!pfds[i + (s ? 1 : 0)].revents) {
+          user_fds[i] = -2;
+        }
+      }
+      res = 2;
+    }
+  }
+  if (pfds != small_pfds) {
+    free(pfds);
+  }
+
+  return res;
+#else
   fd_set fds;
   int i, res, max_fd;
 
@@ -190,11 +369,89 @@ int wait4data(const struct nodeID *s, struct timeval *tout, int *user_fds)
   }
 
   return 2;
+#endif
+}
+
+static int intern_resize(unsigned int size)
+{
+  struct nodeID **table;
+  unsigned int i;
+
+  table = calloc(size, sizeof(struct nodeID *));
+  if (table == NULL) {
+    return -1;
+  }
+  for (i = 0; i < intern_size; i++) {
+    while (intern_table[i]) {
+      struct nodeID *n = intern_table[i];
+      uint32_t h = nodeid_hash(n) & (size - 1);
+
+      intern_table[i] = n->next;
+      n->next = table[h];
+      table[h] = n;
+    }
+  }
+  free(intern_table);
+  intern_table = table;
+  intern_size = size;
+
+  return 0;
+}
+
+/*
+ * Return a nodeID for the given address: a new one, or (if interning is
+ * enabled) a new reference to the canonical one
+ */
+static struct nodeID *nodeid_new(const void *addr, size_t addr_len)
+{
+  struct nodeID key, *res;
+  uint32_t h = 0;
+
+  memset(&key.addr, 0, sizeof(struct sockaddr_storage));
+  memcpy(&key.addr, addr, addr_len);
+  if (intern_table) {
+    INTERN_LOCK();
+    h = nodeid_hash(&key) & (intern_size - 1);
+    for (res = intern_table[h]; res; res = res->next) {
+      if (nodeid_cmp(res, &key) == 0) {
+        res->refcnt++;
+        INTERN_UNLOCK();
+
+        return res;
+      }
+    }
+  }
+
+  res = malloc(sizeof(struct nodeID));
+  if (res == NULL) {
+    if (intern_table) {
+      INTERN_UNLOCK();
+    }
+
+    return NULL;
+  }
+  res->addr = key.addr;
+  res->fd = -1;
+  res->interned = 0;
+  res->refcnt = 0;
+  res->next = NULL;
+  if (intern_table) {
+    res->interned = 1;
+    res->refcnt = 1;
+    res->next = intern_table[h];
+    intern_table[h] = res;
+    if (++intern_count > intern_size) {
+      intern_resize(intern_size * 2);
+    }
+    INTERN_UNLOCK();
+  }
+
+  return res;
 }
 
 struct nodeID *create_node(const char *IPaddr, int port)
 {
-  struct nodeID *s;
+  struct sockaddr_storage addr;
   int res;
   struct addrinfo hints, *result;
 
@@ -202,24 +459,23 @@ struct nodeID *create_node(const char *IPaddr, int port)
   hints.ai_family = AF_UNSPEC;
   hints.ai_flags = AI_NUMERICHOST;
 
-  s = malloc(sizeof(struct nodeID));
-  memset(s, 0, sizeof(struct nodeID));
+  memset(&addr, 0, sizeof(struct sockaddr_storage));
 
   if ((res = getaddrinfo(IPaddr, NULL, &hints, &result)))
   {
     fprintf(stderr, "Cannot resolve hostname '%s'\n", IPaddr);
     return NULL;
   }
-  s->addr.ss_family = result->ai_family;
+  addr.ss_family = result->ai_family;
   switch (result->ai_family)
   {
     case (AF_INET):
-      ((struct sockaddr_in *)&s->addr)->sin_port = htons(port);
-      res = inet_pton (result->ai_family, IPaddr, &((struct sockaddr_in *)&s->addr)->sin_addr);
+      ((struct sockaddr_in *)&addr)->sin_port = htons(port);
+      res = inet_pton (result->ai_family, IPaddr, &((struct sockaddr_in *)&addr)->sin_addr);
     break;
     case (AF_INET6):
-      ((struct sockaddr_in6 *)&s->addr)->sin6_port = htons(port);
-      res = inet_pton (result->ai_family, IPaddr, &(((struct sockaddr_in6 *) &s->addr)->sin6_addr));
+      ((struct sockaddr_in6 *)&addr)->sin6_port = htons(port);
+      res = inet_pton (result->ai_family, IPaddr, &(((struct sockaddr_in6 *) &addr)->sin6_addr));
     break;
     default:
       fprintf(stderr, "Cannot resolve address family %d for '%s'\n", result->ai_family, IPaddr);
@@ -230,251 +486,1362 @@ struct nodeID *create_node(const char *IPaddr, int port)
   if (res != 1)
   {
     fprintf(stderr, "Could not convert address '%s'\n", IPaddr);
-    free(s);
 
     return NULL;
   }
 
-  s->fd = -1;
-
-  return s;
+  return nodeid_new(&addr, sizeof(struct sockaddr_storage));
 }
 
-struct nodeID *net_helper_init(const char *my_addr, int port, const char *config)
-{
-  int res;
-  struct nodeID *myself;
+/*
+ * Every datagram starts with a my_hdr_t (all the fields are in network byte
+ * order). Messages larger than a fragment are split in fragments of
+ * frag_size bytes (the last one can be shorter); the fragments can arrive in
+ * any order, interleaved with the fragments of other messages, and are
+ * collected in a reassembly table indexed by sender and m_seq until the
+ * message is complete. Incomplete messages are dropped when they are older
+ * than reasm_timeout ms, or (oldest first) when they use more than
+ * reasm_memory bytes.
+ */
+struct my_hdr_t {
+  uint32_t m_seq;	/* message sequence number */
+  uint32_t size;	/* of the whole message */
+  uint16_t frag_seq;	/* index of this fragment */
+  uint16_t frag_size;
+} __attribute__((packed));
 
-  myself = create_node(my_addr, port);
-  if (myself == NULL) {
-    fprintf(stderr, "Error creating my socket (%s:%d)!\n", my_addr, port);
+struct reasm {
+  struct nodeID key;	/* sender; only the address is used */
+  uint32_t m_seq;
+  int size;
+  int frag_size;
+  int missing;		/* number of fragments still to be received */
+  int received;		/* bytes */
+  uint64_t deadline;	/* in ms */
+  uint8_t *buff;
+  uint8_t *done;	/* one bit per received fragment */
+  struct reasm *next;	/* hash chain */
+  struct reasm *older, *newer;
+};
 
-    return NULL;
-  }
-  myself->fd =  socket(myself->addr.ss_family, SOCK_DGRAM, 0);
-  if (myself->fd < 0) {
-    free(myself);
+static uint32_t next_m_seq;
+static struct reasm *reasm_table[REASM_BUCKETS];
+static struct reasm *reasm_oldest, *reasm_newest;
+static int reasm_mem;
+static int reasm_max_mem = DEFAULT_REASM_MEMORY;
+static int reasm_timeout = DEFAULT_REASM_TIMEOUT;
 
-    return NULL;
-  }
-//  TODO:
-//  if (addr->sa_family == AF_INET6) {
-//      r = setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
-//  }
+/*
+ * If an MTU is configured, messages are split in fragments fitting in a
+ * single IP packet, sent with the DF bit set. Otherwise, fragments are
+ * MAX_MSG_SIZE bytes, and the IP layer fragments them
+ */
+static int mtu;
+static int frag_size = MAX_MSG_SIZE;
+static struct net_helper_stats stats;
 
-  fprintf(stderr, "My sock: %d\n", myself->fd);
+/*
+ * Destinations whose path MTU turned out to be smaller than mtu use smaller
+ * fragments, remembered here (a direct mapped cache: on a collision, the
+ * smaller size is discovered again). After pmtu_timeout ms an entry
+ * expires, so that the fragments to that destination grow back to
+ * frag_size if the path has changed
+ */
+struct pmtu_entry {
+  struct sockaddr_storage addr;
+  int frag_size;		/* 0 if the entry is not used */
+  uint64_t expire;		/* in ms */
+};
 
-  switch (myself->addr.ss_family)
-  {
-    case (AF_INET):
-        res = bind(myself->fd, (struct sockaddr *)&myself->addr, sizeof(struct sockaddr_in));
-    break;
-    case (AF_INET6):
-        res = bind(myself->fd, (struct sockaddr *)&myself->addr, sizeof(struct sockaddr_in6));
-    break;
-    default:
-      fprintf(stderr, "Cannot resolve address family %d in bind\n", myself->addr.ss_family);
-      res = 0;
-    break;
-  }
+static struct pmtu_entry pmtu_cache[PMTU_ENTRIES];
+static int pmtu_timeout = DEFAULT_PMTU_TIMEOUT;
+#ifndef _WIN32
+static pthread_mutex_t pmtu_lock = PTHREAD_MUTEX_INITIALIZER;
+#define PMTU_LOCK() pthread_mutex_lock(&pmtu_lock)
+#define PMTU_UNLOCK() pthread_mutex_unlock(&pmtu_lock)
+#else
+#define PMTU_LOCK()
+#define PMTU_UNLOCK()
+#endif
 
-  if (res < 0) {
-    /* bind failed: not a local address... Just close the socket! */
-    close(myself->fd);
-    free(myself);
+#ifndef _WIN32
+/*
+ * Optional sender threads (see the "send_threads" config tag): each one
+ * pops the messages queued by send_to_peer_async() from its own queue. All
+ * the messages to a destination go through the same thread, so they are
+ * sent in order
+ */
+struct send_req {
+  struct mpsc_node node;	/* must be the first field */
+  int fd;			/* of the local nodeID */
+  struct sockaddr_storage addr;	/* of the destination */
+  int size;
+  uint8_t data[];
+};
 
-    return NULL;
-  }
+struct sender {
+  pthread_t thread;
+  struct mpsc_queue queue;
+  int queued;			/* requests not sent yet */
+  int sleeping;
+  int stop;			/* protected by lock */
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;	/* a request has been queued */
+  pthread_cond_t drained;	/* no more requests to send */
+};
 
-  return myself;
+static struct sender *senders;
+static int send_threads;
+static int send_queue_size = DEFAULT_SEND_QUEUE;
+#endif
+
+static void hdr_fill(struct my_hdr_t *h, uint32_t m_seq, int size, int frag_seq, int frag_size)
+{
+  h->m_seq = htonl(m_seq);
+  h->size = htonl(size);
+  h->frag_seq = htons(frag_seq);
+  h->frag_size = htons(frag_size);
 }
 
-void bind_msg_type (uint8_t msgtype)
+static uint64_t now_ms(void)
 {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
-struct my_hdr_t {
-  uint8_t m_seq;
-  uint8_t frag_seq;
-  uint8_t frags;
-} __attribute__((packed));
+static unsigned int reasm_bucket(const struct nodeID *key, uint32_t m_seq)
+{
+  return (nodeid_hash(key) ^ (m_seq * 2654435761U)) & (REASM_BUCKETS - 1);
+}
 
-int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+static void reasm_free(struct reasm *r, int lost)
 {
-  struct msghdr msg = {0};
-  static struct my_hdr_t my_hdr;
-  struct iovec iov[2];
-  int res;
+  struct reasm **p;
 
-  if (buffer_size <= 0) return -1;
+  for (p = &reasm_table[reasm_bucket(&r->key, r->m_seq)]; *p != r; p = &(*p)->next);
+  *p = r->next;
+  if (r->older) {
+    r->older->newer = r->newer;
+  } else {
+    reasm_oldest = r->newer;
+  }
+  if (r->newer) {
+    r->newer->older = r->older;
+  } else {
+    reasm_newest = r->older;
+  }
+  reasm_mem -= r->size;
+  if (lost) {
+    ATOMIC_ADD(&stats.msgs_lost, 1);
+    ATOMIC_ADD(&stats.bytes_wasted, r->received);
+  }
+  free(r->buff);
+  free(r);
+}
 
-  iov[0].iov_base = &my_hdr;
-  iov[0].iov_len = sizeof(struct my_hdr_t);
-  msg.msg_name = &to->addr;
-  msg.msg_namelen = sizeof(struct sockaddr_storage);
-  msg.msg_iovlen = 2;
-  msg.msg_iov = iov;
+static struct reasm *reasm_get(const struct sockaddr_storage *raddr, uint32_t m_seq, int size, int frag_size, int frags)
+{
+  struct nodeID key;
+  struct reasm *r;
+  unsigned int h;
+
+  memcpy(&key.addr, raddr, sizeof(struct sockaddr_storage));
+  h = reasm_bucket(&key, m_seq);
+  for (r = reasm_table[h]; r; r = r->next) {
+    if (r->m_seq == m_seq && nodeid_cmp(&r->key, &key) == 0) {
+      return (r->size == size && r->frag_size == frag_size) ? r : NULL;
+    }
+  }
 
-  my_hdr.m_seq++;
-  my_hdr.frags = (buffer_size / (MAX_MSG_SIZE)) + 1;
-  my_hdr.frag_seq = 0;
+  if (size > reasm_max_mem) {
+    return NULL;
+  }
+  while (reasm_mem + size > reasm_max_mem) {
+    reasm_free(reasm_oldest, 1);
+  }
+  r = malloc(sizeof(struct reasm));
+  if (r == NULL) {
+    return NULL;
+  }
+  r->buff = malloc(size + (frags + 7) / 8);
+  if (r->buff == NULL) {
+    free(r);
 
-  do {
-    iov[1].iov_base = buffer_ptr;
-    if (buffer_size > MAX_MSG_SIZE) {
-      iov[1].iov_len = MAX_MSG_SIZE;
-    } else {
-      iov[1].iov_len = buffer_size;
-    }
-    my_hdr.frag_seq++;
+    return NULL;
+  }
+  r->done = r->buff + size;
+  memset(r->done, 0, (frags + 7) / 8);
+  r->key.addr = key.addr;
+  r->m_seq = m_seq;
+  r->size = size;
+  r->frag_size = frag_size;
+  r->missing = frags;
+  r->received = 0;
+  r->deadline = now_ms() + reasm_timeout;
+  r->next = reasm_table[h];
+  reasm_table[h] = r;
+  r->older = reasm_newest;
+  r->newer = NULL;
+  if (reasm_newest) {
+    reasm_newest->newer = r;
+  } else {
+    reasm_oldest = r;
+  }
+  reasm_newest = r;
+  reasm_mem += size;
 
-    buffer_size -= iov[1].iov_len;
-    buffer_ptr += iov[1].iov_len;
-    res = sendmsg(from->fd, &msg, 0);
+  return r;
+}
 
-    if (res  < 0){
-      int error = errno;
-      fprintf(stderr,"net-helper: sendmsg failed errno %d: %s\n", error, strerror(error));
-    }
-  } while (buffer_size > 0);
+static void reasm_expire(void)
+{
+  uint64_t now;
 
-  return res;
+  if (reasm_oldest == NULL) {
+    return;
+  }
+  now = now_ms();
+  while (reasm_oldest && reasm_oldest->deadline <= now) {
+    reasm_free(reasm_oldest, 1);
+  }
 }
 
-int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *buffer_ptr, int buffer_size)
+/*
+ * Handle a datagram received from raddr, whose header is h and whose len
+ * bytes of payload are in data. If this completes a message, store it in
+ * dst (which can be data) and return its size; otherwise return 0 (the
+ * fragment has been stored in the reassembly table) or -1 (the datagram
+ * has been dropped)
+ */
+static int frag_recv(const struct sockaddr_storage *raddr, const struct my_hdr_t *h, uint8_t *data, int len, uint8_t *dst, int dst_size)
 {
-  int res, recv, m_seq, frag_seq;
-  struct sockaddr_storage raddr;
-  struct msghdr msg = {0};
-  static struct my_hdr_t my_hdr;
-  struct iovec iov[2];
+  struct reasm *r;
+  uint32_t m_seq;
+  int size, frag_seq, frag_size, frags, off;
 
-  iov[0].iov_base = &my_hdr;
-  iov[0].iov_len = sizeof(struct my_hdr_t);
-  msg.msg_name = &raddr;
-  msg.msg_namelen = sizeof(struct sockaddr_storage);
-  msg.msg_iovlen = 2;
-  msg.msg_iov = iov;
+  if (len < 0) {
+    ATOMIC_ADD(&stats.frags_dropped, 1);
 
-  *remote = malloc(sizeof(struct nodeID));
-  if (*remote == NULL) {
     return -1;
   }
+  ATOMIC_ADD(&stats.frags_received, 1);
+  m_seq = ntohl(h->m_seq);
+  size = ntohl(h->size);
+  frag_seq = ntohs(h->frag_seq);
+  frag_size = ntohs(h->frag_size);
+  if (frag_seq == 0 && size == len) {
+    /* Not fragmented: the common case */
+    if (len > dst_size) {
+      ATOMIC_ADD(&stats.frags_dropped, 1);
 
-  recv = 0;
-  m_seq = -1;
-  frag_seq = 0;
-  do {
-    iov[1].iov_base = buffer_ptr;
-    if (buffer_size > MAX_MSG_SIZE) {
-      iov[1].iov_len = MAX_MSG_SIZE;
-    } else {
-      iov[1].iov_len = buffer_size;
-    }
-    buffer_size -= iov[1].iov_len;
-    buffer_ptr += iov[1].iov_len;
-    res = recvmsg(local->fd, &msg, 0);
-    recv += (res - sizeof(struct my_hdr_t));
-    if (m_seq != -1 && my_hdr.m_seq != m_seq) {
       return -1;
-    } else {
-      m_seq = my_hdr.m_seq;
     }
-    if (my_hdr.frag_seq != frag_seq + 1) {
-      return -1;
-    } else {
-     frag_seq++;
+    if (dst != data) {
+      memcpy(dst, data, len);
     }
-  } while ((my_hdr.frag_seq < my_hdr.frags) && (buffer_size > 0));
-  memcpy(&(*remote)->addr, &raddr, msg.msg_namelen);
-  (*remote)->fd = -1;
+    ATOMIC_ADD(&stats.msgs_received, 1);
+    ATOMIC_ADD(&stats.bytes_received, len);
 
-  return recv;
-}
+    return len;
+  }
 
-int node_addr(const struct nodeID *s, char *addr, int len)
-{
-  int n;
+  reasm_expire();
+  if (size <= 0 || size > dst_size || frag_size == 0) {
+    ATOMIC_ADD(&stats.frags_dropped, 1);
 
-	if (s && node_ip(s, addr, len)>=0)
-	{
-		n = snprintf(addr + strlen(addr), len - strlen(addr) - 1, ":%d", node_port(s));
-	} else
-		n = snprintf(addr, len , "None");
+    return -1;
+  }
+  frags = (size + frag_size - 1) / frag_size;
+  if (frag_seq >= frags) {
+    ATOMIC_ADD(&stats.frags_dropped, 1);
 
-  return n;
-}
+    return -1;
+  }
+  /* frag_seq < frags, so off < size */
+  off = frag_seq * frag_size;
+  if (len != (frag_seq == frags - 1 ? size - off : frag_size)) {
+    ATOMIC_ADD(&stats.frags_dropped, 1);
 
-struct nodeID *nodeid_dup(const struct nodeID *s)
-{
-  struct nodeID *res;
+    return -1;
+  }
+  r = reasm_get(raddr, m_seq, size, frag_size, frags);
+  if (r == NULL) {
+    ATOMIC_ADD(&stats.frags_dropped, 1);
 
-  res = malloc(sizeof(struct nodeID));
-  if (res != NULL) {
-    memcpy(res, s, sizeof(struct nodeID));
+    return -1;
   }
+  if (r->done[frag_seq / 8] & (1 << (frag_seq % 8))) {
+    /* Duplicate */
+    ATOMIC_ADD(&stats.frags_dropped, 1);
 
-  return res;
+    return 0;
+  }
+  if (r->missing > 1) {
+    memcpy(r->buff + off, data, len);
+    r->done[frag_seq / 8] |= 1 << (frag_seq % 8);
+    r->missing--;
+    r->received += len;
+
+    return 0;
+  }
+
+  /* Last missing fragment: move it in place, and copy the others around it */
+  memmove(dst + off, data, len);
+  memcpy(dst, r->buff, off);
+  memcpy(dst + off + len, r->buff + off + len, size - off - len);
+  reasm_free(r, 0);
+  ATOMIC_ADD(&stats.msgs_received, 1);
+  ATOMIC_ADD(&stats.bytes_received, size);
+
+  return size;
 }
 
-int nodeid_equal(const struct nodeID *s1, const struct nodeID *s2)
+static int l3_hdr_size(const struct sockaddr_storage *addr)
 {
-	return (nodeid_cmp(s1,s2) == 0);
-//  return (memcmp(&s1->addr, &s2->addr, sizeof(struct sockaddr_storage)) == 0);
+  return addr->ss_family == AF_INET6 ? 40 : 20;
 }
 
-int nodeid_cmp(const struct nodeID *s1, const struct nodeID *s2)
+/* Path MTU towards addr as known by the kernel, or -1 */
+static int path_mtu(const struct sockaddr_storage *addr)
 {
-	char ip1[80], ip2[80];
-	int port1,port2,res;
+  int res = -1;
+#if defined(IP_MTU) && defined(IPV6_MTU)
+  socklen_t len = sizeof(res);
+  int fd;
 
-  if(s1 && s2)
-  {
-    port1=node_port(s1);
-    port2=node_port(s2);
-    node_ip(s1,ip1,80);
-    node_ip(s2,ip2,80);
-
-  //	int res = (port1^port2)|strcmp(ip1,ip2);
-  //	fprintf(stderr,"Comparing %s:%d and %s:%d\n",ip1,port1,ip2,port2);
-  //	fprintf(stderr,"Result: %d\n",res);
-    res  = strcmp(ip1,ip2);
-    if (res!=0)
-      return res;
-    else
-      return port1-port2;
-  //		return port1 == port2 ? 0 : 1;
-
-  //  return memcmp(&s1->addr, &s2->addr, sizeof(struct sockaddr_storage));
-  }
-  else
-    return 0;
+  /* The kernel reports the path MTU only for connected sockets */
+  fd = socket(addr->ss_family, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (const struct sockaddr *)addr, addr->ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in)) < 0 ||
+      getsockopt(fd, addr->ss_family == AF_INET6 ? IPPROTO_IPV6 : IPPROTO_IP,
+                 addr->ss_family == AF_INET6 ? IPV6_MTU : IP_MTU, &res, &len) < 0) {
+    res = -1;
+  }
+  close(fd);
+#endif
+
+  return res;
 }
 
-int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size)
+static struct pmtu_entry *pmtu_entry(const struct sockaddr_storage *addr)
 {
-  if (max_write_size < sizeof(struct sockaddr_storage)) return -1;
+  struct nodeID key;
 
-  memcpy(b, &s->addr, sizeof(struct sockaddr_storage));
+  memcpy(&key.addr, addr, sizeof(struct sockaddr_storage));
 
-  return sizeof(struct sockaddr_storage);
+  return &pmtu_cache[nodeid_hash(&key) % PMTU_ENTRIES];
 }
 
-struct nodeID *nodeid_undump(const uint8_t *b, int *len)
+/* Fragment size for the messages sent to addr */
+static int dest_frag_size(const struct sockaddr_storage *addr)
+{
+  struct pmtu_entry *e;
+  int size;
+
+  size = frag_size;
+  if (mtu == 0) {
+    return size;
+  }
+  e = pmtu_entry(addr);
+  PMTU_LOCK();
+  if (e->frag_size && memcmp(&e->addr, addr, sizeof(struct sockaddr_storage)) == 0) {
+    if (e->expire > now_ms()) {
+      size = e->frag_size;
+    } else {
+      /* Probe the path MTU again, starting from frag_size */
+      e->frag_size = 0;
+    }
+  }
+  PMTU_UNLOCK();
+
+  return size;
+}
+
+/*
+ * A fragment of size bytes did not fit in the path MTU towards addr: use
+ * smaller fragments for addr. Return 0 if this is not possible
+ */
+static int frag_size_shrink(const struct sockaddr_storage *addr, int size)
+{
+  struct pmtu_entry *e;
+  int new_size, pmtu;
+
+  if (mtu == 0) {
+    return 0;
+  }
+  new_size = -1;
+  pmtu = path_mtu(addr);
+  if (pmtu > 0) {
+    new_size = pmtu - l3_hdr_size(addr) - UDP_HDR_SIZE - (int)sizeof(struct my_hdr_t);
+  }
+  if (new_size <= 0 || new_size >= size) {
+    new_size = size * 3 / 4;
+  }
+  if (new_size < MIN_FRAG_SIZE) {
+    return 0;
+  }
+  e = pmtu_entry(addr);
+  PMTU_LOCK();
+  /* If other threads are shrinking it too, keep the smallest size */
+  if (e->frag_size == 0 || memcmp(&e->addr, addr, sizeof(struct sockaddr_storage)) ||
+      new_size < e->frag_size) {
+    memcpy(&e->addr, addr, sizeof(struct sockaddr_storage));
+    e->frag_size = new_size;
+    e->expire = now_ms() + pmtu_timeout;
+  }
+  PMTU_UNLOCK();
+
+  return 1;
+}
+
+static void pmtu_discovery_set(int fd, int family)
+{
+#if defined(IP_MTU_DISCOVER) && defined(IPV6_MTU_DISCOVER)
+  int val;
+
+  if (family == AF_INET6) {
+    val = IPV6_PMTUDISC_DO;
+    setsockopt(fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &val, sizeof(val));
+  } else {
+    val = IP_PMTUDISC_DO;
+    setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+  }
+#endif
+}
+
+static void gro_state_set(int fd, int enable)
+{
+  if (fd >= gro_states_size) {
+    struct gro_state **states;
+    int i, size = fd + 16;
+
+    if (!enable) {
+      return;
+    }
+    states = realloc(gro_states, size * sizeof(struct gro_state *));
+    if (states == NULL) {
+      return;
+    }
+    for (i = gro_states_size; i < size; i++) {
+      states[i] = NULL;
+    }
+    gro_states = states;
+    gro_states_size = size;
+  }
+  /* The fd might belong to a socket which has been closed */
+  free(gro_states[fd]);
+  gro_states[fd] = NULL;
+  if (enable) {
+    gro_states[fd] = malloc(sizeof(struct gro_state));
+    if (gro_states[fd]) {
+      gro_states[fd]->len = 0;
+    }
+  }
+}
+
+/* Enable the requested segmentation offloads, if the kernel supports them */
+static void offload_set(int fd)
+{
+  int enable_gro = 0;
+#ifdef UDP_SEGMENT
+  int val;
+  socklen_t len = sizeof(val);
+
+  if (gso && getsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, &len) < 0) {
+    fprintf(stderr, "net-helper: UDP GSO not supported\n");
+    gso = 0;
+  }
+  val = 1;
+  if (gro && setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val)) < 0) {
+    fprintf(stderr, "net-helper: UDP GRO not supported\n");
+    gro = 0;
+  }
+  enable_gro = gro;
+#else
+  gso = 0;
+  gro = 0;
+#endif
+  gro_state_set(fd, enable_gro);
+#ifdef UDP_GRO
+  if (enable_gro && gro_state(fd) == NULL) {
+    val = 0;
+    setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val));
+  }
+#endif
+}
+
+static void sent_account(int msgs, int frags, uint64_t bytes)
+{
+  ATOMIC_ADD(&stats.msgs_sent, msgs);
+  ATOMIC_ADD(&stats.frags_sent, frags);
+  ATOMIC_ADD(&stats.bytes_sent, bytes);
+}
+
+int net_helper_stats(struct net_helper_stats *s)
+{
+  s->msgs_sent = ATOMIC_LOAD(&stats.msgs_sent);
+  s->frags_sent = ATOMIC_LOAD(&stats.frags_sent);
+  s->bytes_sent = ATOMIC_LOAD(&stats.bytes_sent);
+  s->msgs_received = ATOMIC_LOAD(&stats.msgs_received);
+  s->frags_received = ATOMIC_LOAD(&stats.frags_received);
+  s->bytes_received = ATOMIC_LOAD(&stats.bytes_received);
+  s->msgs_lost = ATOMIC_LOAD(&stats.msgs_lost);
+  s->bytes_wasted = ATOMIC_LOAD(&stats.bytes_wasted);
+  s->frags_dropped = ATOMIC_LOAD(&stats.frags_dropped);
+  s->frag_size = frag_size;
+
+  return 0;
+}
+
+#ifndef _WIN32
+/* A request has been sent (or dropped) */
+static void sender_done(struct sender *s)
+{
+  if (__atomic_sub_fetch(&s->queued, 1, __ATOMIC_SEQ_CST) == 0) {
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_broadcast(&s->drained);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+static void *sender_loop(void *arg)
+{
+  struct sender *s = arg;
+  struct nodeID from, to;
+
+  for (;;) {
+    struct send_req *r;
+
+    r = (struct send_req *)mpsc_queue_pop(&s->queue);
+    if (r == NULL) {
+      pthread_mutex_lock(&s->lock);
+      /* A producer pushing from now on sees sleeping set, and signals */
+      __atomic_store_n(&s->sleeping, 1, __ATOMIC_SEQ_CST);
+      while ((r = (struct send_req *)mpsc_queue_pop(&s->queue)) == NULL && !s->stop) {
+        pthread_cond_wait(&s->wakeup, &s->lock);
+      }
+      __atomic_store_n(&s->sleeping, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&s->lock);
+      if (r == NULL) {
+        break;
+      }
+    }
+    /* Only the fields used by send_to_peer() are set */
+    from.fd = r->fd;
+    to.addr = r->addr;
+    send_to_peer(&from, &to, r->data, r->size);
+    free(r);
+    sender_done(s);
+  }
+
+  return NULL;
+}
+
+static void senders_start(int n)
+{
+  int i;
+
+  if (senders || n <= 0) {
+    return;
+  }
+  senders = calloc(n, sizeof(struct sender));
+  if (senders == NULL) {
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    struct sender *s = &senders[i];
+
+    mpsc_queue_init(&s->queue);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wakeup, NULL);
+    pthread_cond_init(&s->drained, NULL);
+    if (pthread_create(&s->thread, NULL, sender_loop, s) != 0) {
+      pthread_mutex_destroy(&s->lock);
+      pthread_cond_destroy(&s->wakeup);
+      pthread_cond_destroy(&s->drained);
+      break;
+    }
+  }
+  if (i == 0) {
+    fprintf(stderr, "net-helper: cannot create the sender threads\n");
+    free(senders);
+    senders = NULL;
+
+    return;
+  }
+  send_threads = i;
+}
+
+/* Send the queued messages, then stop and join the sender threads */
+static void senders_stop(void)
+{
+  int i;
+
+  send_to_peer_flush();
+  for (i = 0; i < send_threads; i++) {
+    struct sender *s = &senders[i];
+
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_signal(&s->wakeup);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wakeup);
+    pthread_cond_destroy(&s->drained);
+  }
+  free(senders);
+  senders = NULL;
+  send_threads = 0;
+}
+#endif
+
+struct nodeID *net_helper_init(const char *my_addr, int port, const char *config)
+{
+  int res, threads = 0;
+  struct nodeID *myself;
+  struct tag *cfg_tags;
+
+  cfg_tags = grapes_config_parse(config);
+  if (cfg_tags) {
+    const char *format;
+    int intern;
+
+    format = grapes_config_value_str(cfg_tags, "nodeid_dump");
+    if (format && !strcmp(format, "legacy")) {
+      dump_format = DUMP_LEGACY;
+    } else if (format && !strcmp(format, "compact")) {
+      dump_format = DUMP_COMPACT;
+    }
+    grapes_config_value_int_default(cfg_tags, "nodeid_intern", &intern, 0);
+    if (intern && intern_table == NULL) {
+      intern_resize(64);
+    }
+    grapes_config_value_int(cfg_tags, "reasm_timeout", &reasm_timeout);
+    grapes_config_value_int(cfg_tags, "reasm_memory", &reasm_max_mem);
+    grapes_config_value_int(cfg_tags, "mtu", &mtu);
+    grapes_config_value_int(cfg_tags, "pmtu_timeout", &pmtu_timeout);
+    grapes_config_value_int(cfg_tags, "gso", &gso);
+    grapes_config_value_int(cfg_tags, "gro", &gro);
+    grapes_config_value_int(cfg_tags, "send_threads", &threads);
+#ifndef _WIN32
+    grapes_config_value_int(cfg_tags, "send_queue", &send_queue_size);
+#endif
+    free(cfg_tags);
+  }
+
+  myself = create_node(my_addr, port);
+  if (myself == NULL) {
+    fprintf(stderr, "Error creating my socket (%s:%d)!\n", my_addr, port);
+
+    return NULL;
+  }
+  myself->fd =  socket(myself->addr.ss_family, SOCK_DGRAM, 0);
+  if (myself->fd < 0) {
+    nodeid_free(myself);
+
+    return NULL;
+  }
+//  TODO:
+//  if (addr->sa_family == AF_INET6) {
+//      r = setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+//  }
+
+  fprintf(stderr, "My sock: %d\n", myself->fd);
+
+  if (mtu > 0) {
+    int size = mtu - l3_hdr_size(&myself->addr) - UDP_HDR_SIZE - sizeof(struct my_hdr_t);
+
+    if (size < MIN_FRAG_SIZE) {
+      size = MIN_FRAG_SIZE;
+    }
+    frag_size = size < MAX_MSG_SIZE ? size : MAX_MSG_SIZE;
+    pmtu_discovery_set(myself->fd, myself->addr.ss_family);
+  }
+  offload_set(myself->fd);
+#ifndef _WIN32
+  senders_start(threads);
+#endif
+
+  switch (myself->addr.ss_family)
+  {
+    case (AF_INET):
+        res = bind(myself->fd, (struct sockaddr *)&myself->addr, sizeof(struct sockaddr_in));
+    break;
+    case (AF_INET6):
+        res = bind(myself->fd, (struct sockaddr *)&myself->addr, sizeof(struct sockaddr_in6));
+    break;
+    default:
+      fprintf(stderr, "Cannot resolve address family %d in bind\n", myself->addr.ss_family);
+      res = 0;
+    break;
+  }
+
+  if (res < 0) {
+    /* bind failed: not a local address... Just close the socket! */
+    close(myself->fd);
+    myself->fd = -1;
+    nodeid_free(myself);
+
+    return NULL;
+  }
+
+  return myself;
+}
+
+void bind_msg_type (uint8_t msgtype)
+{
+}
+
+/*
+ * Fill dst with the pieces of the iov array covering len bytes starting at
+ * offset off; return the number of dst elements used, or -1 if more than
+ * max are needed
+ */
+static int iov_slice(struct iovec *dst, int max, const struct iovec *iov, int iovcnt, size_t off, size_t len)
+{
+  int i, n;
+
+  n = 0;
+  for (i = 0; i < iovcnt && len > 0; i++) {
+    size_t l;
+
+    if (off >= iov[i].iov_len) {
+      off -= iov[i].iov_len;
+      continue;
+    }
+    if (n == max) {
+      return -1;
+    }
+    l = iov[i].iov_len - off;
+    if (l > len) {
+      l = len;
+    }
+    dst[n].iov_base = (uint8_t *)iov[i].iov_base + off;
+    dst[n++].iov_len = l;
+    len -= l;
+    off = 0;
+  }
+
+  return n;
+}
+
+static int iov_size(const struct iovec *iov, int iovcnt)
+{
+  int i, size;
+
+  size = 0;
+  for (i = 0; i < iovcnt; i++) {
+    size += iov[i].iov_len;
+  }
+
+  return size;
+}
+
+#ifdef UDP_SEGMENT
+/*
+ * Send the fragments (of size bytes) of a message, passing up to
+ * GSO_MAX_SEGS of them (with their headers) to the kernel in a single
+ * system call. Return the result of the last sendmsg()
+ */
+static int gso_send(int fd, const struct sockaddr_storage *to, const struct iovec *data, int iovcnt, int buffer_size, uint32_t m_seq, int size)
+{
+  struct my_hdr_t hdrs[GSO_MAX_SEGS];
+  struct iovec iov[GSO_MAX_SEGS * (MAX_IOV + 1)];
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  struct msghdr msg = {0};
+  int frags, max_segs, frag_seq, res;
+
+  frags = (buffer_size + size - 1) / size;
+  max_segs = GSO_MAX_BYTES / (size + sizeof(struct my_hdr_t));
+  if (max_segs > GSO_MAX_SEGS) {
+    max_segs = GSO_MAX_SEGS;
+  }
+  msg.msg_name = (void *)(uintptr_t)to;
+  msg.msg_namelen = sizeof(struct sockaddr_storage);
+  msg.msg_iov = iov;
+  res = -1;
+  for (frag_seq = 0; frag_seq < frags;) {
+    int segs, n;
+
+    n = 0;
+    for (segs = 0; segs < max_segs && frag_seq < frags; segs++, frag_seq++) {
+      int off = frag_seq * size;
+
+      hdr_fill(&hdrs[segs], m_seq, buffer_size, frag_seq, size);
+      iov[n].iov_base = &hdrs[segs];
+      iov[n++].iov_len = sizeof(struct my_hdr_t);
+      n += iov_slice(iov + n, MAX_IOV, data, iovcnt, off, buffer_size - off > size ? size : buffer_size - off);
+    }
+    msg.msg_iovlen = n;
+    if (segs > 1) {
+      struct cmsghdr *cm;
+      uint16_t seg_size = size + sizeof(struct my_hdr_t);
+
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      cm = CMSG_FIRSTHDR(&msg);
+      cm->cmsg_level = SOL_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      memcpy(CMSG_DATA(cm), &seg_size, sizeof(uint16_t));
+    } else {
+      msg.msg_control = NULL;
+      msg.msg_controllen = 0;
+    }
+    res = sendmsg(fd, &msg, 0);
+    if (res < 0) {
+      return -1;
+    }
+  }
+
+  return res;
+}
+#endif
+
+int send_to_peer_iov(const struct nodeID *from, const struct nodeID *to, const struct iovec *data, int iovcnt)
+{
+  struct msghdr msg = {0};
+  struct my_hdr_t my_hdr;
+  struct iovec iov[MAX_IOV + 1];
+  uint32_t m_seq;
+  int res, buffer_size, sent, frag_seq, size, failed;
+
+  buffer_size = iov_size(data, iovcnt);
+  if (buffer_size <= 0 || iovcnt > MAX_IOV) return -1;
+
+  iov[0].iov_base = &my_hdr;
+  iov[0].iov_len = sizeof(struct my_hdr_t);
+  msg.msg_name = (void *)(uintptr_t)&to->addr;
+  msg.msg_namelen = sizeof(struct sockaddr_storage);
+  msg.msg_iov = iov;
+
+restart:
+  size = dest_frag_size(&to->addr);
+  m_seq = ATOMIC_ADD(&next_m_seq, 1);
+#ifdef UDP_SEGMENT
+  if (ATOMIC_LOAD(&gso) && buffer_size > size && 2 * (size + sizeof(struct my_hdr_t)) <= GSO_MAX_BYTES) {
+    res = gso_send(from->fd, &to->addr, data, iovcnt, buffer_size, m_seq, size);
+    if (res < 0) {
+      int error = errno, pmtu;
+
+      /* EINVAL: the segments do not fit in the path MTU, or GSO cannot be used */
+      if ((error == EMSGSIZE || (error == EINVAL && (pmtu = path_mtu(&to->addr)) > 0 &&
+           pmtu < size + (int)sizeof(struct my_hdr_t) + UDP_HDR_SIZE + l3_hdr_size(&to->addr))) &&
+          frag_size_shrink(&to->addr, size)) {
+        goto restart;
+      }
+      if (error == EINVAL || error == EIO || error == ENOPROTOOPT || error == EOPNOTSUPP) {
+        fprintf(stderr, "net-helper: UDP GSO failed (%s), disabling it\n", strerror(error));
+        ATOMIC_STORE(&gso, 0);
+        goto restart;
+      }
+      fprintf(stderr,"net-helper: sendmsg failed errno %d: %s\n", error, strerror(error));
+
+      return -1;
+    }
+    sent_account(1, (buffer_size + size - 1) / size, buffer_size);
+
+    return buffer_size;
+  }
+#endif
+  frag_seq = 0;
+  sent = 0;
+  failed = 0;
+  do {
+    int len = buffer_size - sent > size ? size : buffer_size - sent;
+
+    msg.msg_iovlen = 1 + iov_slice(iov + 1, MAX_IOV, data, iovcnt, sent, len);
+    hdr_fill(&my_hdr, m_seq, buffer_size, frag_seq++, size);
+    sent += len;
+    res = sendmsg(from->fd, &msg, 0);
+
+    if (res  < 0){
+      int error = errno;
+
+      if (error == EMSGSIZE && frag_size_shrink(&to->addr, size)) {
+        /* Send the whole message again, with smaller fragments */
+        goto restart;
+      }
+      fprintf(stderr,"net-helper: sendmsg failed errno %d: %s\n", error, strerror(error));
+      failed = 1;
+    }
+  } while (sent < buffer_size);
+  sent_account(1, frag_seq, buffer_size);
+
+  return failed ? -1 : buffer_size;
+}
+
+int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *)(uintptr_t)buffer_ptr;
+  iov.iov_len = buffer_size > 0 ? buffer_size : 0;
+
+  return send_to_peer_iov(from, to, &iov, 1);
+}
+
+int send_to_peer_async(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+{
+#ifndef _WIN32
+  struct sender *s;
+  struct send_req *r;
+
+  if (senders == NULL) {
+    return send_to_peer(from, to, buffer_ptr, buffer_size);
+  }
+  if (buffer_size <= 0) {
+    return -1;
+  }
+
+  s = &senders[nodeid_hash(to) % send_threads];
+  if (__atomic_add_fetch(&s->queued, 1, __ATOMIC_SEQ_CST) > send_queue_size) {
+    sender_done(s);
+
+    return -1;
+  }
+  r = malloc(sizeof(struct send_req) + buffer_size);
+  if (r == NULL) {
+    sender_done(s);
+
+    return -1;
+  }
+  /* The nodeIDs are not copied: they might be interned and shared */
+  r->fd = from->fd;
+  r->addr = to->addr;
+  r->size = buffer_size;
+  memcpy(r->data, buffer_ptr, buffer_size);
+  mpsc_queue_push(&s->queue, &r->node);
+  if (__atomic_load_n(&s->sleeping, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_signal(&s->wakeup);
+    pthread_mutex_unlock(&s->lock);
+  }
+
+  return buffer_size;
+#else
+  return send_to_peer(from, to, buffer_ptr, buffer_size);
+#endif
+}
+
+void send_to_peer_flush(void)
+{
+#ifndef _WIN32
+  int i;
+
+  for (i = 0; i < send_threads; i++) {
+    struct sender *s = &senders[i];
+
+    pthread_mutex_lock(&s->lock);
+    while (__atomic_load_n(&s->queued, __ATOMIC_SEQ_CST) > 0) {
+      pthread_cond_wait(&s->drained, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+#endif
+}
+
+void net_helper_deinit(void)
+{
+  int i;
+
+#ifndef _WIN32
+  senders_stop();
+#endif
+  while (reasm_oldest) {
+    reasm_free(reasm_oldest, 0);
+  }
+  for (i = 0; i < gro_states_size; i++) {
+    free(gro_states[i]);
+  }
+  free(gro_states);
+  gro_states = NULL;
+  gro_states_size = 0;
+}
+
+/* Size of the datagrams coalesced by GRO in the received buffer, or 0 */
+static int gro_segment_size(struct msghdr *msg)
+{
+#ifdef UDP_GRO
+  struct cmsghdr *cm;
+
+  for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+    if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+      int seg;
+
+      memcpy(&seg, CMSG_DATA(cm), sizeof(int));
+
+      return seg;
+    }
+  }
+#endif
+
+  return 0;
+}
+
+/*
+ * Receive a message. Wait for the first datagram only if flags does not
+ * contain MSG_DONTWAIT: if it does not complete a message, go on with the
+ * datagrams already queued, and give up when none is left (the fragments
+ * received so far are kept)
+ */
+static int recv_msg(const struct nodeID *local, struct nodeID **remote, uint8_t *buffer_ptr, int buffer_size, int flags)
+{
+  int res;
+  struct sockaddr_storage raddr;
+  socklen_t raddr_len;
+  struct msghdr msg = {0};
+  struct my_hdr_t my_hdr;
+  struct iovec iov[2];
+  struct gro_state *g = gro_state(local->fd);
+#ifdef UDP_GRO
+  char control[CMSG_SPACE(sizeof(int))];
+#endif
+
+  if (g) {
+    iov[0].iov_base = g->buff;
+    iov[0].iov_len = GRO_BUFF_SIZE;
+    msg.msg_iovlen = 1;
+  } else {
+    iov[0].iov_base = &my_hdr;
+    iov[0].iov_len = sizeof(struct my_hdr_t);
+    iov[1].iov_base = buffer_ptr;
+    iov[1].iov_len = buffer_size;
+    msg.msg_iovlen = 2;
+  }
+  msg.msg_name = &raddr;
+  msg.msg_iov = iov;
+
+  *remote = NULL;
+  do {
+    if (g && g->len > 0) {
+      /* The next datagram of the last coalesced buffer */
+      int len = g->len > g->seg ? g->seg : g->len;
+
+      memcpy(&my_hdr, g->next, sizeof(struct my_hdr_t));
+      raddr = g->addr;
+      raddr_len = g->addr_len;
+      res = frag_recv(&raddr, &my_hdr, g->next + sizeof(struct my_hdr_t), len - (int)sizeof(struct my_hdr_t), buffer_ptr, buffer_size);
+      g->next += len;
+      g->len -= len;
+      continue;
+    }
+    msg.msg_namelen = sizeof(struct sockaddr_storage);
+#ifdef UDP_GRO
+    if (g) {
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+    }
+#endif
+    res = recvmsg(local->fd, &msg, flags);
+    if (res < 0) {
+      return -1;
+    }
+    flags |= MSG_DONTWAIT;
+    raddr_len = msg.msg_namelen;
+    if (g) {
+      if (msg.msg_flags & MSG_TRUNC) {
+        ATOMIC_ADD(&stats.frags_dropped, 1);
+        res = -1;
+        continue;
+      }
+      g->seg = gro_segment_size(&msg);
+      if (g->seg <= 0) {
+        g->seg = res;
+      }
+      g->next = g->buff;
+      g->len = res;
+      g->addr = raddr;
+      g->addr_len = raddr_len;
+      res = 0;
+      continue;
+    }
+    res = frag_recv(&raddr, &my_hdr, buffer_ptr, res - (int)sizeof(struct my_hdr_t), buffer_ptr, buffer_size);
+  } while (res <= 0);
+  *remote = nodeid_new(&raddr, raddr_len);
+  if (*remote == NULL) {
+    return -1;
+  }
+
+  return res;
+}
+
+int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *buffer_ptr, int buffer_size)
+{
+  return recv_msg(local, remote, buffer_ptr, buffer_size, 0);
+}
+
+#ifndef NH_BATCH
+/* Batched I/O is emulated here; see net_helper-udp-mmsg.c for the real thing */
+int send_to_peers_iov(const struct nodeID *from, struct nodeID * const *to, int n, const struct iovec *iov, int iovcnt)
+{
+  int i, sent;
+
+  if (iov_size(iov, iovcnt) <= 0 || iovcnt > MAX_IOV) return -1;
+
+  sent = 0;
+  for (i = 0; i < n; i++) {
+    if (send_to_peer_iov(from, to[i], iov, iovcnt) >= 0) {
+      sent++;
+    }
+  }
+
+  return sent;
+}
+
+int recv_from_peer_batch(const struct nodeID *local, struct nodeID **remote, uint8_t **buffer_ptr, int buffer_size, int *len, int n)
+{
+  if (n <= 0) return -1;
+
+  len[0] = recv_from_peer(local, &remote[0], buffer_ptr[0], buffer_size);
+
+  return len[0] < 0 ? -1 : 1;
+}
+#endif
+
+int send_to_peers_batch(const struct nodeID *from, struct nodeID * const *to, int n, const uint8_t *buffer_ptr, int buffer_size)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *)(uintptr_t)buffer_ptr;
+  iov.iov_len = buffer_size > 0 ? buffer_size : 0;
+
+  return send_to_peers_iov(from, to, n, &iov, 1);
+}
+
+int node_addr(const struct nodeID *s, char *addr, int len)
+{
+  int n;
+
+	if (s && node_ip(s, addr, len)>=0)
+	{
+		n = snprintf(addr + strlen(addr), len - strlen(addr) - 1, ":%d", node_port(s));
+	} else
+		n = snprintf(addr, len , "None");
+
+  return n;
+}
+
+struct nodeID *nodeid_dup(const struct nodeID *s)
 {
   struct nodeID *res;
+
+  if (s->interned) {
+    /* Interned: just take a new reference to the canonical nodeID */
+    return nodeid_new(&s->addr, sizeof(struct sockaddr_storage));
+  }
+
   res = malloc(sizeof(struct nodeID));
   if (res != NULL) {
-    memcpy(&res->addr, b, sizeof(struct sockaddr_storage));
-    res->fd = -1;
+    memcpy(res, s, sizeof(struct nodeID));
   }
-  *len = sizeof(struct sockaddr_storage);
 
   return res;
 }
 
+static int nodeid_key(const struct nodeID *s, const uint8_t **addr, uint16_t *port)
+{
+  switch (s->addr.ss_family) {
+    case AF_INET:
+      *addr = (const uint8_t *)&((const struct sockaddr_in *)&s->addr)->sin_addr;
+      *port = ((const struct sockaddr_in *)&s->addr)->sin_port;
+      return 4;
+    case AF_INET6:
+      *addr = (const uint8_t *)&((const struct sockaddr_in6 *)&s->addr)->sin6_addr;
+      *port = ((const struct sockaddr_in6 *)&s->addr)->sin6_port;
+      return 16;
+    default:
+      *addr = NULL;
+      *port = 0;
+      return 0;
+  }
+}
+
+int nodeid_equal(const struct nodeID *s1, const struct nodeID *s2)
+{
+  if (s1 == s2) {
+    return 1;
+  }
+  if (s1 && s2 && s1->interned && s2->interned) {
+    /* Two different canonical nodeIDs */
+    return 0;
+  }
+
+  return (nodeid_cmp(s1,s2) == 0);
+}
+
+int nodeid_cmp(const struct nodeID *s1, const struct nodeID *s2)
+{
+  const uint8_t *a1, *a2;
+  uint16_t port1, port2;
+  int len, res;
+
+  if (s1 == NULL || s2 == NULL || s1 == s2) {
+    return 0;
+  }
+  if (s1->addr.ss_family != s2->addr.ss_family) {
+    return s1->addr.ss_family < s2->addr.ss_family ? -1 : 1;
+  }
+  len = nodeid_key(s1, &a1, &port1);
+  nodeid_key(s2, &a2, &port2);
+  res = memcmp(a1, a2, len);
+  if (res) {
+    return res < 0 ? -1 : 1;
+  }
+  port1 = ntohs(port1);
+  port2 = ntohs(port2);
+
+  return port1 == port2 ? 0 : (port1 < port2 ? -1 : 1);
+}
+
+uint32_t nodeid_hash(const struct nodeID *s)
+{
+  const uint8_t *addr;
+  uint16_t port;
+  uint32_t h = 2166136261U;	/* 32 bit FNV-1a */
+  int i, len;
+
+  len = nodeid_key(s, &addr, &port);
+  for (i = 0; i < len; i++) {
+    h = (h ^ addr[i]) * 16777619U;
+  }
+  h = (h ^ (port & 0xff)) * 16777619U;
+  h = (h ^ (port >> 8)) * 16777619U;
+
+  return h;
+}
+
+int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size)
+{
+  const uint8_t *addr;
+  uint16_t port;
+  int len;
+
+  if (dump_format == DUMP_LEGACY || (dump_format == DUMP_AUTO && !ATOMIC_LOAD(&compact_seen))) {
+    if (max_write_size < sizeof(struct sockaddr_storage)) return -1;
+
+    memcpy(b, &s->addr, sizeof(struct sockaddr_storage));
+
+    return sizeof(struct sockaddr_storage);
+  }
+
+  len = nodeid_key(s, &addr, &port);
+  if (len == 0 || max_write_size < 1 + sizeof(port) + len) return -1;
+
+  b[0] = len == 4 ? NODEID_COMPACT_IPV4 : NODEID_COMPACT_IPV6;
+  memcpy(b + 1, &port, sizeof(port));
+  memcpy(b + 1 + sizeof(port), addr, len);
+
+  return 1 + sizeof(port) + len;
+}
+
+/* Decode a serialised nodeID in addr; return its length, or -1 on error */
+static int nodeid_decode(struct sockaddr_storage *addr, const uint8_t *b)
+{
+  if (!(b[0] & NODEID_COMPACT_V1)) {
+    /* Legacy format */
+    memcpy(addr, b, sizeof(struct sockaddr_storage));
+
+    return sizeof(struct sockaddr_storage);
+  }
+
+  if (!ATOMIC_LOAD(&compact_seen) && (b[0] == NODEID_COMPACT_IPV4 || b[0] == NODEID_COMPACT_IPV6)) {
+    /* The sender can parse compact dumps: start sending them */
+    ATOMIC_STORE(&compact_seen, 1);
+  }
+  memset(addr, 0, sizeof(struct sockaddr_storage));
+  switch (b[0]) {
+    case NODEID_COMPACT_IPV4: {
+      struct sockaddr_in *in = (struct sockaddr_in *)addr;
+
+      in->sin_family = AF_INET;
+      memcpy(&in->sin_port, b + 1, 2);
+      memcpy(&in->sin_addr, b + 3, 4);
+
+      return 1 + 2 + 4;
+    }
+    case NODEID_COMPACT_IPV6: {
+      struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)addr;
+
+      in6->sin6_family = AF_INET6;
+      memcpy(&in6->sin6_port, b + 1, 2);
+      memcpy(&in6->sin6_addr, b + 3, 16);
+
+      return 1 + 2 + 16;
+    }
+    default:
+      fprintf(stderr, "net-helper: unknown nodeID format 0x%x\n", b[0]);
+
+      return -1;
+  }
+}
+
+struct nodeID *nodeid_undump(const uint8_t *b, int *len)
+{
+  struct sockaddr_storage addr;
+
+  *len = nodeid_decode(&addr, b);
+  if (*len < 0) {
+    *len = 1;
+
+    return NULL;
+  }
+
+  return nodeid_new(&addr, sizeof(struct sockaddr_storage));
+}
+
+struct nodeID *nodeid_undump_reuse(struct nodeID *s, const uint8_t *b, int *len)
+{
+  struct sockaddr_storage addr;
+
+  if (s == NULL || s->interned || intern_table) {
+    /* Interned nodeIDs are shared, and cannot be modified */
+    nodeid_free(s);
+
+    return nodeid_undump(b, len);
+  }
+  *len = nodeid_decode(&addr, b);
+  if (*len < 0) {
+    *len = 1;
+    nodeid_free(s);
+
+    return NULL;
+  }
+  s->addr = addr;
+  s->fd = -1;
+
+  return s;
+}
+
 void nodeid_free(struct nodeID *s)
 {
+  struct nodeID **p;
+
+  if (s == NULL) {
+    return;
+  }
+  if (s->interned) {
+    INTERN_LOCK();
+    if (--s->refcnt) {
+      INTERN_UNLOCK();
+
+      return;
+    }
+    for (p = &intern_table[nodeid_hash(s) & (intern_size - 1)]; *p; p = &(*p)->next) {
+      if (*p == s) {
+        *p = s->next;
+        intern_count--;
+        break;
+      }
+    }
+    INTERN_UNLOCK();
+  }
   free(s);
 }
 
@@ -519,3 +1886,8 @@ int node_port(const struct nodeID *s)
   }
   return res;
 }
+
+int node_fd(const struct nodeID *s)
+{
+  return s->fd;
+}
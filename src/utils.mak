@@ -35,6 +35,10 @@ CFLAGS += -pg
 LDFLAGS += -pg
 endif
 
+ifdef CACHE_CHECKS
+CFLAGS += -DCACHE_CHECKS
+endif
+
 CPPFLAGS = -I$(BASE)/include -I$(BASE)/src
 
 LIBCOMMON = libgrapes.a